@@ -22,13 +22,20 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
+	exynos_blit.c \
 	exynos_camera.c \
+	exynos_convert.c \
 	exynos_exif.c \
+	exynos_gather.c \
 	exynos_jpeg.c \
 	exynos_param.c \
+	exynos_s5c73m3.c \
+	exynos_stage.c \
+	exynos_trace.c \
 	exynos_utils.c \
 	exynos_v4l2.c \
-	exynos_v4l2_output.c
+	exynos_v4l2_output.c \
+	exynos_worker.c
 
 LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/include \
@@ -52,4 +59,6 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 
+include $(call all-makefiles-under,$(LOCAL_PATH))
+
 endif
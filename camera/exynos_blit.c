@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define LOG_TAG "exynos_blit"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+/*
+ * Copy of a converted preview frame to a window buffer. The source planes
+ * are laid out as FIMC outputs them (see exynos_camera_yuv_planes) while the
+ * window buffer rows are stride pixels long, with the YV12 chroma planes in
+ * Cr, Cb order and their stride aligned to 16 bytes.
+ */
+
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+#define EXYNOS_BLIT_SIMD	1
+#endif
+
+#define EXYNOS_BLIT_PREFETCH_DISTANCE	256
+
+static int exynos_blit_simd_enabled = 1;
+
+// Rows
+
+static void exynos_blit_row_scalar(unsigned char *dst, unsigned char *src,
+	int length)
+{
+	memcpy(dst, src, length);
+}
+
+#ifdef EXYNOS_BLIT_SIMD
+static int exynos_blit_row_simd(unsigned char *dst, unsigned char *src,
+	int length)
+{
+	int streamed = 0;
+	int i = 0;
+
+#if defined(__ARM_NEON__)
+	uint8x16_t a, b, c, d;
+
+	for (; i + 64 <= length; i += 64) {
+		__builtin_prefetch(src + i + EXYNOS_BLIT_PREFETCH_DISTANCE);
+
+		a = vld1q_u8(src + i);
+		b = vld1q_u8(src + i + 16);
+		c = vld1q_u8(src + i + 32);
+		d = vld1q_u8(src + i + 48);
+
+		vst1q_u8(dst + i, a);
+		vst1q_u8(dst + i + 16, b);
+		vst1q_u8(dst + i + 32, c);
+		vst1q_u8(dst + i + 48, d);
+	}
+
+	for (; i + 16 <= length; i += 16)
+		vst1q_u8(dst + i, vld1q_u8(src + i));
+#else
+	__m128i a, b, c, d;
+
+	// The window buffer is not read back, so it is written around the caches
+	if (((uintptr_t) dst & 15) == 0) {
+		for (; i + 64 <= length; i += 64) {
+			__builtin_prefetch(src + i + EXYNOS_BLIT_PREFETCH_DISTANCE);
+
+			a = _mm_loadu_si128((const __m128i *) (src + i));
+			b = _mm_loadu_si128((const __m128i *) (src + i + 16));
+			c = _mm_loadu_si128((const __m128i *) (src + i + 32));
+			d = _mm_loadu_si128((const __m128i *) (src + i + 48));
+
+			_mm_stream_si128((__m128i *) (dst + i), a);
+			_mm_stream_si128((__m128i *) (dst + i + 16), b);
+			_mm_stream_si128((__m128i *) (dst + i + 32), c);
+			_mm_stream_si128((__m128i *) (dst + i + 48), d);
+		}
+
+		streamed = i > 0;
+	}
+
+	for (; i + 16 <= length; i += 16)
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_loadu_si128((const __m128i *) (src + i)));
+#endif
+
+	if (i < length)
+		memcpy(dst + i, src + i, length - i);
+
+	return streamed;
+}
+#endif
+
+void exynos_blit_rows(void *dst, int dst_stride, void *src, int src_stride,
+	int length, int count)
+{
+	unsigned char *dst_p;
+	unsigned char *src_p;
+	int streamed = 0;
+	int i;
+
+	if (dst == NULL || src == NULL || length <= 0 || count <= 0)
+		return;
+
+	dst_p = (unsigned char *) dst;
+	src_p = (unsigned char *) src;
+
+	// Contiguous rows are copied at once
+	if (dst_stride == length && src_stride == length) {
+		length *= count;
+		count = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+#ifdef EXYNOS_BLIT_SIMD
+		if (exynos_blit_simd_enabled)
+			streamed |= exynos_blit_row_simd(dst_p, src_p, length);
+		else
+#endif
+			exynos_blit_row_scalar(dst_p, src_p, length);
+
+		dst_p += dst_stride;
+		src_p += src_stride;
+	}
+
+#if defined(__SSE2__) && !defined(__ARM_NEON__)
+	if (streamed)
+		_mm_sfence();
+#endif
+}
+
+// Chroma swap
+
+static void exynos_blit_swap_row_scalar(unsigned char *dst, unsigned char *src,
+	int length)
+{
+	unsigned char value;
+	int i;
+
+	for (i = 0; i + 1 < length; i += 2) {
+		value = src[i];
+		dst[i] = src[i + 1];
+		dst[i + 1] = value;
+	}
+}
+
+#ifdef EXYNOS_BLIT_SIMD
+static void exynos_blit_swap_row_simd(unsigned char *dst, unsigned char *src,
+	int length)
+{
+	int i = 0;
+
+#if defined(__ARM_NEON__)
+	for (; i + 16 <= length; i += 16) {
+		__builtin_prefetch(src + i + EXYNOS_BLIT_PREFETCH_DISTANCE);
+		vst1q_u8(dst + i, vrev16q_u8(vld1q_u8(src + i)));
+	}
+#else
+	__m128i v;
+
+	for (; i + 16 <= length; i += 16) {
+		__builtin_prefetch(src + i + EXYNOS_BLIT_PREFETCH_DISTANCE);
+
+		v = _mm_loadu_si128((const __m128i *) (src + i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *) (dst + i), v);
+	}
+#endif
+
+	if (i < length)
+		exynos_blit_swap_row_scalar(dst + i, src + i, length - i);
+}
+#endif
+
+void exynos_blit_swap_rows(void *dst, int dst_stride, void *src, int src_stride,
+	int length, int count)
+{
+	unsigned char *dst_p;
+	unsigned char *src_p;
+	int i;
+
+	if (dst == NULL || src == NULL || length <= 0 || count <= 0)
+		return;
+
+	dst_p = (unsigned char *) dst;
+	src_p = (unsigned char *) src;
+
+	if (dst_stride == length && src_stride == length) {
+		length *= count;
+		count = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+#ifdef EXYNOS_BLIT_SIMD
+		if (exynos_blit_simd_enabled)
+			exynos_blit_swap_row_simd(dst_p, src_p, length);
+		else
+#endif
+			exynos_blit_swap_row_scalar(dst_p, src_p, length);
+
+		dst_p += dst_stride;
+		src_p += src_stride;
+	}
+}
+
+// Preview
+
+int exynos_blit_preview(void *dst, int dst_stride, void *src, int width,
+	int height, int format)
+{
+	unsigned char *dst_p;
+	unsigned char *src_p;
+	int offset_cb;
+	int offset_cr;
+	int c_stride;
+
+	if (dst == NULL || src == NULL || width <= 0 || height <= 0 || dst_stride < width)
+		return -EINVAL;
+
+	dst_p = (unsigned char *) dst;
+	src_p = (unsigned char *) src;
+
+	// Chroma planes are where FIMC puts them, e.g. aligned for NV12
+	exynos_camera_yuv_planes(width, height, format, 0, NULL, &offset_cb, &offset_cr);
+
+	switch (format) {
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12:
+			exynos_blit_rows(dst_p, dst_stride, src_p, width, width, height);
+			exynos_blit_rows(dst_p + dst_stride * height, dst_stride, src_p + offset_cb, width, width, height / 2);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			c_stride = ((dst_stride / 2) + 15) & ~15;
+
+			exynos_blit_rows(dst_p, dst_stride, src_p, width, width, height);
+			dst_p += dst_stride * height;
+			exynos_blit_rows(dst_p, c_stride, src_p + offset_cr, width / 2, width / 2, height / 2);
+			dst_p += c_stride * (height / 2);
+			exynos_blit_rows(dst_p, c_stride, src_p + offset_cb, width / 2, width / 2, height / 2);
+			break;
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+		case V4L2_PIX_FMT_VYUY:
+		case V4L2_PIX_FMT_YVYU:
+			exynos_blit_rows(dst_p, dst_stride * 2, src_p, width * 2, width * 2, height);
+			break;
+		case V4L2_PIX_FMT_RGB32:
+			exynos_blit_rows(dst_p, dst_stride * 4, src_p, width * 4, width * 4, height);
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * NV12 and NV21 only differ by the order of the chroma samples, so a frame
+ * in one of them can be shown in a window of the other, swapping them while
+ * it is copied.
+ */
+
+int exynos_blit_preview_compatible(int dst_format, int src_format)
+{
+	if (dst_format == src_format)
+		return 1;
+
+	if ((dst_format == V4L2_PIX_FMT_NV21 && src_format == V4L2_PIX_FMT_NV12) || (dst_format == V4L2_PIX_FMT_NV12 && src_format == V4L2_PIX_FMT_NV21))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * A frame written back to back only has the window buffer layout when rows
+ * are not padded and chroma planes come in the same order with the same
+ * stride. YV12 windows have their chroma planes swapped compared to YUV420
+ * and their stride aligned to 16 bytes, and FIMC aligns the NV12 chroma
+ * plane, so they are always copied to.
+ */
+
+int exynos_blit_preview_direct(int format, int width, int stride)
+{
+	if (width <= 0 || stride != width)
+		return 0;
+
+	switch (format) {
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_RGB32:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+int exynos_blit_preview_format(void *dst, int dst_stride, int dst_format,
+	void *src, int width, int height, int src_format)
+{
+	unsigned char *dst_p;
+	unsigned char *src_p;
+	int offset_cb;
+
+	if (dst_format == src_format)
+		return exynos_blit_preview(dst, dst_stride, src, width, height, src_format);
+
+	if (!exynos_blit_preview_compatible(dst_format, src_format))
+		return -1;
+
+	if (dst == NULL || src == NULL || width <= 0 || height <= 0 || dst_stride < width)
+		return -EINVAL;
+
+	dst_p = (unsigned char *) dst;
+	src_p = (unsigned char *) src;
+
+	exynos_camera_yuv_planes(width, height, src_format, 0, NULL, &offset_cb, NULL);
+
+	exynos_blit_rows(dst_p, dst_stride, src_p, width, width, height);
+	exynos_blit_swap_rows(dst_p + dst_stride * height, dst_stride, src_p + offset_cb, width, width, height / 2);
+
+	return 0;
+}
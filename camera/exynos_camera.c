@@ -30,17 +30,18 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <asm/types.h>
 
 #define LOG_TAG "exynos_camera"
 #include <utils/Log.h>
 #include <utils/Timers.h>
+#include <cutils/properties.h>
 
 #include "exynos_camera.h"
 
-#define BIG2LITTLE_ENDIAN(big)	((big & 0xff) << 24 | (big & 0xff00) << 8 | (big & 0xff0000) >> 8 | (big & 0xff000000) >> 24)
-
 /*
  * Devices configurations
  */
@@ -259,17 +260,20 @@ struct exynos_v4l2_node exynos_v4l2_nodes_smdk4x12[] = {
 		.id = 0,
 		.node = "/dev/video0",
 	},
-	{	// FIMC1 is used for preview output
+	{	// FIMC1 is preferred for preview output
 		.id = 1,
 		.node = "/dev/video1",
+		.output = 1,
 	},
-	{	// FIMC2 is used for picture output
+	{	// FIMC2 is preferred for picture output
 		.id = 2,
 		.node = "/dev/video2",
+		.output = 1,
 	},
-	{	// FIMC3 is used for recording output
+	{	// FIMC3 is preferred for recording output
 		.id = 3,
 		.node = "/dev/video3",
+		.output = 1,
 	},
 };
 
@@ -289,6 +293,7 @@ struct exynox_camera_config *exynos_camera_config =
 
 int exynos_camera_start(struct exynos_camera *exynos_camera, int id)
 {
+	char property[PROPERTY_VALUE_MAX];
 	int rc;
 
 	if (exynos_camera == NULL || id >= exynos_camera->config->presets_count)
@@ -310,6 +315,25 @@ int exynos_camera_start(struct exynos_camera *exynos_camera, int id)
 	}
 #endif
 
+	// Gather
+
+	exynos_gather_init();
+
+	// Jpeg
+
+	property_get("camera.jpeg.persistent", property, "1");
+
+	rc = exynos_jpeg_pool_start(exynos_camera, &exynos_camera->picture_jpeg_pool, atoi(property) > 0);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start jpeg pool", __func__);
+		goto error;
+	}
+
+	// Capture thread
+
+	exynos_camera->capture_poll_fd = -1;
+	exynos_camera->capture_command_fd = -1;
+
 	// V4L2
 
 	rc = exynos_v4l2_init(exynos_camera);
@@ -356,6 +380,16 @@ int exynos_camera_start(struct exynos_camera *exynos_camera, int id)
 		goto error;
 	}
 
+	// S5C73M3 metadata
+
+	if (!exynos_camera->camera_fimc_is) {
+		exynos_camera->capture_metadata_layout = s5c73m3_metadata_layout_select();
+		if (exynos_camera->capture_metadata_layout == NULL) {
+			ALOGE("%s: Unable to select metadata layout", __func__);
+			goto error;
+		}
+	}
+
 	// Gralloc
 
 	rc = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, (const struct hw_module_t **) &exynos_camera->gralloc);
@@ -366,6 +400,9 @@ int exynos_camera_start(struct exynos_camera *exynos_camera, int id)
 	goto complete;
 
 error:
+	if (exynos_camera->picture_jpeg_pool.enabled)
+		exynos_jpeg_pool_stop(exynos_camera, &exynos_camera->picture_jpeg_pool);
+
 	exynos_v4l2_close(exynos_camera, 0);
 
 #ifdef EXYNOS_ION
@@ -386,6 +423,10 @@ void exynos_camera_stop(struct exynos_camera *exynos_camera)
 	if (exynos_camera == NULL || exynos_camera->config == NULL)
 		return;
 
+	// Encoder buffers are ION allocations, released before closing ION
+	if (exynos_camera->picture_jpeg_pool.enabled)
+		exynos_jpeg_pool_stop(exynos_camera, &exynos_camera->picture_jpeg_pool);
+
 	exynos_v4l2_close(exynos_camera, 0);
 
 #ifdef EXYNOS_ION
@@ -1294,195 +1335,250 @@ int exynos_camera_params_apply(struct exynos_camera *exynos_camera, int force)
 
 // Capture
 
-int s5c73m3_interleaved_decode(struct exynos_camera *exynos_camera, void *data, int size,
-	void *yuv_data, int *yuv_size, int yuv_width, int yuv_height,
-	void *jpeg_data, int *jpeg_size, int *decoded, int *auto_focus_result,
-	struct exynos_exif *exif)
+/*
+ * Capture buffers are shared by the preview and recording stages through
+ * references: the V4L2 buffer is queued back once the last one is released.
+ */
+
+void exynos_camera_frame_release(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame)
 {
-	exif_attribute_t *attributes;
-	camera_face_t caface[exynos_camera->max_detected_faces];
-	int yuv_length;
-	int jpeg_length;
-	int num_detected_faces;
-	int face;
-	unsigned char *yuv_p;
-	unsigned char *jpeg_p;
-	unsigned char *data_p;
-	unsigned int *offset_p;
-	unsigned int pointers_array_offset;
-	unsigned int pointers_array_size;
-	unsigned int interleaved_size;
-	unsigned char s5c73m3_auto_focus_result;
-	unsigned int yuv_offset_last;
-	unsigned int yuv_offset;
-	unsigned int yuv_line_size;
-	unsigned short *jpeg_start_p;
-	int gap;
-	unsigned int i;
-
-	if (data == NULL || size <= 0 || yuv_data == NULL || yuv_size == NULL || yuv_width <= 0 || yuv_height <= 0 || jpeg_data == NULL || jpeg_size == NULL || decoded == NULL || auto_focus_result == NULL)
-		return -EINVAL;
+	int rc;
+
+	if (exynos_camera == NULL || frame == NULL)
+		return;
 
-	yuv_length = 0;
-	jpeg_length = 0;
+	if (__sync_sub_and_fetch(&frame->refcount, 1) > 0)
+		return;
 
-	data_p = (unsigned char *) data;
-	data_p += size - 0x1000; // End of the first plane (interleaved buffer)
-	data_p += 4046; // Experimental offset for decoded
+	pthread_mutex_lock(&exynos_camera->capture_queue_mutex);
 
-	*decoded = (int) *data_p;
+	// The queue was made shallower: keep the buffer aside
+	if (exynos_camera->capture_queue_active > exynos_camera->capture_queue_depth) {
+		exynos_camera->capture_queue_parked[exynos_camera->capture_queue_parked_count++] = frame->index;
+		exynos_camera->capture_queue_active--;
 
-	data_p = (unsigned char *) data;
-	data_p += size - 0x1000; // End of the first plane (interleaved buffer)
-	data_p += 50; // Experimental offset for auto-focus result
+		pthread_mutex_unlock(&exynos_camera->capture_queue_mutex);
+		return;
+	}
 
-	*auto_focus_result = (int) *data_p;
+	pthread_mutex_unlock(&exynos_camera->capture_queue_mutex);
 
-	data_p = (unsigned char *) data;
-	data_p += size - 0x1000; // End of the first plane (interleaved buffer)
-	data_p += 4084; // Experimental offset for interleaved size
+	rc = exynos_v4l2_qbuf_cap(exynos_camera, 0, frame->index);
+	if (rc < 0)
+		ALOGE("%s: Unable to queue buffer", __func__);
+}
 
-	// Read the pointers array offset
-	offset_p = (unsigned int *) data_p;
-	pointers_array_offset = BIG2LITTLE_ENDIAN(*offset_p);
-	interleaved_size = pointers_array_offset;
+/*
+ * Frames are dropped when the driver had no buffer queued to fill, which
+ * shows as a gap in the V4L2 sequence numbers, when they can't be decoded or
+ * when a stage is late. Drops are counted by cause and, unless disabled with
+ * the camera.drops.log property (in ms), logged at most once per interval.
+ */
 
-	// Read the pointers array size, it should be 4 * yuv_height
-	data_p += sizeof(pointers_array_offset);
-	offset_p = (unsigned int *) data_p;
-	pointers_array_size = BIG2LITTLE_ENDIAN(*offset_p);
+static char *exynos_camera_drop_causes_names[] = {
+	"no buffer",
+	"decode error",
+	"consumer late",
+};
 
-	// FaceDetection Information
-	data_p = (unsigned char *) data;
-	data_p += size - 0x1000; // End of the first plane (interleaved buffer)
-	data_p += 108; //Number of Faces Detected
+void exynos_camera_capture_drop(struct exynos_camera *exynos_camera,
+	enum exynos_camera_drop_cause cause, unsigned int count)
+{
+	struct exynos_camera_drops *drops;
+	int64_t time;
+	int i;
 
-	num_detected_faces = (int) *data_p;
-	data_p += 2; //Start of Face Detection Info
+	if (exynos_camera == NULL || cause < 0 || cause >= EXYNOS_CAMERA_DROP_CAUSES_COUNT || count == 0)
+		return;
 
-	exynos_camera->mFaceData.faces = caface;
-	if (num_detected_faces > 0 && num_detected_faces < exynos_camera->max_detected_faces)
-	{
-		for (face = 0; face < num_detected_faces; face++) {
-			exynos_camera->mFaceData.faces[face].rect[0] = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-			exynos_camera->mFaceData.faces[face].rect[1] = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-			exynos_camera->mFaceData.faces[face].rect[2] = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-			exynos_camera->mFaceData.faces[face].rect[3] = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-			exynos_camera->mFaceData.faces[face].score = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-			exynos_camera->mFaceData.faces[face].id = (short)(data_p[1] << 8) + data_p[0];
-			data_p += 2;
-		}
-	}
-	exynos_camera->mFaceData.number_of_faces = num_detected_faces;
-
-	if (!*decoded)
-		return 0;
+	drops = &exynos_camera->capture_drops;
+	drops->counts[cause] += count;
 
-	attributes = &exif->attributes;
+	if (drops->log_interval <= 0)
+		return;
 
-	//Extract the EXIF from the Metadata
-	//Flash
-	data_p = (unsigned char *) data;
-	data_p += size - 0x1000; // End of the first plane (interleaved buffer)
-	data_p += 4; // EXIF Flash Offset
-	attributes->flash = (int) data_p[0];
+	time = systemTime(SYSTEM_TIME_MONOTONIC);
+	if (drops->log_time != 0 && time - drops->log_time < drops->log_interval)
+		return;
 
-	//ISO
-	data_p += 4; // EXIF ISO Offset
-	attributes->iso_speed_rating = (data_p[1] << 8) + data_p[0];
+	for (i = 0; i < EXYNOS_CAMERA_DROP_CAUSES_COUNT; i++) {
+		if (drops->counts[i] == drops->log_counts[i])
+			continue;
 
-	//Exposure
-	data_p += 4; // EXIF Exposure Offset
-	attributes->brightness.num = (int) data_p[0];
+		ALOGE("%s: Dropped %u frames (%s), %u total", __func__, drops->counts[i] - drops->log_counts[i], exynos_camera_drop_causes_names[i], drops->counts[i]);
+		drops->log_counts[i] = drops->counts[i];
+	}
 
-	//Exposure Bias
-	data_p += 4; // EXIF Exposure Bias Offset
-	attributes->exposure_bias.num = (data_p[1] << 8) + data_p[0];
+	drops->log_time = time;
+}
 
-	//Exposure Time
-	data_p += 8; // EXIF Exposure Time Offset
-	attributes->exposure_time.den = (data_p[1] << 8) + data_p[0];
+static void exynos_camera_capture_sequence(struct exynos_camera *exynos_camera,
+	unsigned int sequence)
+{
+	struct exynos_camera_drops *drops;
+	unsigned int gap;
 
+	drops = &exynos_camera->capture_drops;
 
-	ALOGD("%s: Interleaved pointers array is at offset 0x%x, 0x%x bytes long\n", __func__, pointers_array_offset, pointers_array_size);
+	// Drivers that don't count frames always report the same sequence
+	if (drops->sequence_valid && sequence != drops->sequence) {
+		gap = sequence - drops->sequence - 1;
 
-	if ((int) pointers_array_offset > size || (int) pointers_array_size > size || (int) pointers_array_size < yuv_height * (int) sizeof(unsigned int)) {
-		ALOGE("%s: Invalid informations", __func__);
-		return -1;
+		// Anything larger is a counter reset rather than a gap
+		if (gap > 0 && gap < 0x10000)
+			exynos_camera_capture_drop(exynos_camera, EXYNOS_CAMERA_DROP_NO_BUFFER, gap);
 	}
 
-	data_p = (unsigned char *) data;
-	data_p += pointers_array_offset;
-	yuv_p = (unsigned char *) yuv_data;
-	jpeg_p = (unsigned char *) jpeg_data;
-	jpeg_start_p = NULL;
+	drops->sequence = sequence;
+	drops->sequence_valid = 1;
+}
+
+/*
+ * In adaptive mode, the capture starts with a shallow queue for low latency.
+ * Buffers that are not queued are parked: one is queued again whenever frames
+ * are dropped for lack of a buffer or because of a late stage, and the queue
+ * is made shallower again after a long run without drops. It never gets
+ * shallower than what a late stage can hold plus one buffer for the capture.
+ * With recording_async, the recording stage also keeps its pending frame.
+ */
 
-	yuv_line_size = yuv_width * 2;
-	yuv_offset_last = 0;
-	yuv_offset = 0;
-	i = 0;
+static int exynos_camera_capture_queue_min(struct exynos_camera *exynos_camera)
+{
+	if (exynos_camera->recording_async)
+		return EXYNOS_CAMERA_CAPTURE_BUFFERS_MIN + 1;
 
-	while (i < pointers_array_size) {
-		offset_p = (unsigned int *) data_p;
-		yuv_offset = BIG2LITTLE_ENDIAN(*offset_p);
+	return EXYNOS_CAMERA_CAPTURE_BUFFERS_MIN;
+}
 
-		if (yuv_offset > size - yuv_line_size)
-			return -1;
+static void exynos_camera_capture_queue_adapt(struct exynos_camera *exynos_camera)
+{
+	struct exynos_camera_drops *drops;
+	unsigned int drops_count;
+	int index = -1;
+	int rc;
 
-		gap = yuv_offset - yuv_offset_last - yuv_line_size;
+	if (!exynos_camera->capture_queue_adaptive)
+		return;
 
-		if (gap > 0) {
-			data_p = (unsigned char *) data + yuv_offset_last + yuv_line_size;
+	drops = &exynos_camera->capture_drops;
+	drops_count = drops->counts[EXYNOS_CAMERA_DROP_NO_BUFFER] + drops->counts[EXYNOS_CAMERA_DROP_LATE];
 
-			if (jpeg_start_p == NULL) {
-				jpeg_start_p = (unsigned short *) data_p;
-				if (*jpeg_start_p != 0xd8ff) {
-					ALOGE("%s: Invalid jpeg start", __func__);
-					return -1;
-				}
-			}
+	exynos_camera->capture_queue_frames++;
+	exynos_camera->capture_queue_stable_frames++;
+
+	if (drops_count != exynos_camera->capture_queue_drops) {
+		exynos_camera->capture_queue_drops = drops_count;
+		exynos_camera->capture_queue_stable_frames = 0;
+
+		// The previous change has to settle before going deeper
+		if (exynos_camera->capture_queue_frames < EXYNOS_CAMERA_QUEUE_SETTLE_FRAMES || exynos_camera->capture_queue_depth >= exynos_camera->capture_buffers_count)
+			return;
+
+		pthread_mutex_lock(&exynos_camera->capture_queue_mutex);
+
+		exynos_camera->capture_queue_depth++;
+
+		if (exynos_camera->capture_queue_active < exynos_camera->capture_queue_depth && exynos_camera->capture_queue_parked_count > 0) {
+			index = exynos_camera->capture_queue_parked[--exynos_camera->capture_queue_parked_count];
+			exynos_camera->capture_queue_active++;
+		}
+
+		pthread_mutex_unlock(&exynos_camera->capture_queue_mutex);
 
-			memcpy(jpeg_p, data_p, gap);
-			jpeg_p += gap;
-			jpeg_length += gap;
+		if (index >= 0) {
+			rc = exynos_v4l2_qbuf_cap(exynos_camera, 0, index);
+			if (rc < 0)
+				ALOGE("%s: Unable to queue buffer", __func__);
 		}
 
-		yuv_offset_last = yuv_offset;
+		exynos_camera->capture_queue_frames = 0;
+
+		ALOGD("%s: Capture queue deepened to %d buffers", __func__, exynos_camera->capture_queue_depth);
+	} else if (exynos_camera->capture_queue_stable_frames >= EXYNOS_CAMERA_QUEUE_SHRINK_FRAMES && exynos_camera->capture_queue_depth > exynos_camera_capture_queue_min(exynos_camera)) {
+		pthread_mutex_lock(&exynos_camera->capture_queue_mutex);
+		exynos_camera->capture_queue_depth--;
+		pthread_mutex_unlock(&exynos_camera->capture_queue_mutex);
 
-		data_p = (unsigned char *) data + yuv_offset;
-		memcpy(yuv_p, data_p, yuv_line_size);
-		yuv_p += yuv_line_size;
-		yuv_length += yuv_line_size;
+		exynos_camera->capture_queue_frames = 0;
+		exynos_camera->capture_queue_stable_frames = 0;
 
-		data_p = (unsigned char *) offset_p;
-		data_p += sizeof(yuv_offset);
-		i += sizeof(yuv_offset);
+		ALOGD("%s: Capture queue reduced to %d buffers", __func__, exynos_camera->capture_queue_depth);
 	}
+}
 
-	gap = interleaved_size - yuv_offset_last - yuv_line_size;
+static int exynos_camera_frame_dispatch(struct exynos_camera *exynos_camera,
+	struct exynos_stage *stage, struct exynos_camera_frame *frame)
+{
+	int rc;
 
-	if (gap > 0) {
-		data_p = (unsigned char *) data + yuv_offset_last + yuv_line_size;
+	if (!stage->enabled)
+		return -1;
 
-		memcpy(jpeg_p, data_p, gap);
-		jpeg_p += gap;
-		jpeg_length += gap;
+	// A late stage skips frames rather than holding on to more buffers
+	if (exynos_stage_pending(stage) >= EXYNOS_CAMERA_STAGE_PENDING_MAX) {
+		exynos_camera_capture_drop(exynos_camera, EXYNOS_CAMERA_DROP_LATE, 1);
+		stage->drops++;
+		return -1;
 	}
 
-	*yuv_size = yuv_length;
-	*jpeg_size = jpeg_length;
+	__sync_fetch_and_add(&frame->refcount, 1);
+
+	rc = exynos_stage_queue(stage, frame->index);
+	if (rc < 0) {
+		ALOGE("%s: Unable to queue %s frame", __func__, stage->name);
+		__sync_fetch_and_sub(&frame->refcount, 1);
+		return -1;
+	}
 
 	return 0;
 }
 
+/*
+ * Buffers are stamped by the driver when the sensor delivered them, but not
+ * always with the monotonic clock that the framework expects: stamps that are
+ * closer to the realtime clock are converted, and unusable ones replaced by
+ * the dequeue time.
+ */
+
+static int64_t exynos_camera_capture_timestamp(struct exynos_camera *exynos_camera,
+	int64_t timestamp)
+{
+	int64_t monotonic;
+	int64_t realtime;
+	int64_t delta_monotonic;
+	int64_t delta_realtime;
+
+	monotonic = systemTime(SYSTEM_TIME_MONOTONIC);
+	realtime = systemTime(SYSTEM_TIME_REALTIME);
+
+	if (timestamp > 0) {
+		delta_monotonic = monotonic - timestamp;
+		delta_realtime = realtime - timestamp;
+
+		if (delta_monotonic < 0)
+			delta_monotonic = -delta_monotonic;
+		if (delta_realtime < 0)
+			delta_realtime = -delta_realtime;
+
+		if (delta_realtime < delta_monotonic)
+			timestamp += monotonic - realtime;
+
+		if (timestamp <= monotonic && monotonic - timestamp < EXYNOS_CAMERA_TIMESTAMP_MAX_AGE)
+			return timestamp;
+	}
+
+	if (exynos_camera->capture_timestamp_fallbacks == 0)
+		ALOGE("%s: Unusable driver timestamp, using dequeue time", __func__);
+
+	exynos_camera->capture_timestamp_fallbacks++;
+
+	return monotonic;
+}
+
 int exynos_camera_capture(struct exynos_camera *exynos_camera)
 {
-	struct exynos_camera_buffer *buffers = NULL;
+	struct exynos_camera_frame *frame = NULL;
 	struct exynos_camera_buffer *buffer;
 	int width, height, format;
 	int yuv_length, jpeg_length;
@@ -1496,9 +1592,12 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 	int busy;
 	void *pointer;
 	void *picture_yuv_pointer = NULL;
+	int picture;
 	int address;
 	int offset;
 	int index;
+	int64_t timestamp;
+	unsigned int sequence;
 	int rc;
 
 	if (exynos_camera == NULL)
@@ -1513,27 +1612,31 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 
 	// V4L2
 
-	index = exynos_v4l2_dqbuf_cap(exynos_camera, 0);
+	// The capture thread only gets here once the capture node is ready
+	index = exynos_v4l2_dqbuf_cap_info(exynos_camera, 0, &timestamp, &sequence);
 	if (index < 0 || index >= buffers_count) {
-		rc = exynos_v4l2_poll(exynos_camera, 0);
-		if (rc < 0) {
-			ALOGE("%s Unable to poll", __func__);
-			goto error;
-		} else if (rc == 0) {
-			// Timeout
-			rc = 0;
-			goto complete;
-		}
-
-		index = exynos_v4l2_dqbuf_cap(exynos_camera, 0);
-		if (index < 0 || index >= buffers_count) {
-			ALOGE("%s: Unable to dequeue buffer", __func__);
-			goto error;
-		}
+		ALOGE("%s: Unable to dequeue buffer", __func__);
+		goto error;
 	}
 
 	exynos_camera->capture_memory_index = index;
 
+	// Frame
+
+	frame = &exynos_camera->capture_frames[index];
+	frame->index = index;
+	frame->timestamp = exynos_camera_capture_timestamp(exynos_camera, timestamp);
+	frame->sequence = sequence;
+	frame->jpeg_enabled = 0;
+	frame->faces_count = 0;
+	frame->trace_id = exynos_trace_frame(&exynos_camera->trace);
+
+	// The capture holds its own reference until the frame is dispatched
+	frame->refcount = 1;
+
+	exynos_camera_capture_sequence(exynos_camera, sequence);
+	exynos_camera_capture_queue_adapt(exynos_camera);
+
 	address = exynos_v4l2_s_ctrl(exynos_camera, 0, V4L2_CID_PADDR_Y, index);
 	if (address == 0 || address == (int) 0xffffffff) {
 		ALOGE("%s: Unable to get address", __func__);
@@ -1546,16 +1649,27 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 
 	pointer = (void *) ((unsigned char *) exynos_camera->capture_memory->data + offset);
 
+	buffer = &frame->yuv;
+
 	// Buffers
 
 	if (!exynos_camera->camera_fimc_is) {
 		yuv_length = jpeg_length = 0;
 		auto_focus_result = decoded = 0;
 
-		rc = s5c73m3_interleaved_decode(exynos_camera, pointer, buffer_length, exynos_camera->capture_yuv_buffer, &yuv_length, width, height, exynos_camera->capture_jpeg_buffer, &jpeg_length, &decoded, &auto_focus_result, &exynos_camera->exif);
+		// The JPEG is only extracted for a pending picture, the metadata always
+		picture = exynos_camera->picture_enabled && !exynos_camera->picture_running;
+
+		rc = s5c73m3_interleaved_decode(exynos_camera, pointer, buffer_length, &yuv_length, width, height, exynos_camera->capture_yuv_offsets, exynos_camera->capture_jpeg_segments, &exynos_camera->capture_jpeg_segments_count, picture ? exynos_camera_picture_jpeg_alloc : NULL, &jpeg_length, &decoded, &auto_focus_result, frame->faces, &frame->faces_count, &exynos_camera->exif);
 		if (rc < 0) {
 			ALOGE("%s: Unable to decode S5C73M3 interleaved", __func__);
-			goto error;
+
+			// A corrupted frame is dropped, the capture goes on
+			exynos_camera_capture_drop(exynos_camera, EXYNOS_CAMERA_DROP_DECODE, 1);
+			exynos_camera_frame_release(exynos_camera, frame);
+
+			rc = 0;
+			goto complete;
 		}
 
 		// AutoFocus
@@ -1606,25 +1720,15 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 			goto error;
 		}
 
-		if (!decoded) {
-			buffers_count = 1;
-			buffers = (struct exynos_camera_buffer *) calloc(buffers_count, sizeof(struct exynos_camera_buffer));
-
-			buffer = buffers;
-
+		if (!decoded || !picture || jpeg_length <= 0) {
 			buffer->pointer = pointer;
 			buffer->address = address;
-			buffer->length = buffer_length;
+			buffer->length = decoded ? yuv_length : buffer_length;
 			buffer->width = width;
 			buffer->height = height;
 			buffer->format = V4L2_PIX_FMT_UYVY;
 		} else {
-			buffers_count = 2;
-			buffers = (struct exynos_camera_buffer *) calloc(buffers_count, sizeof(struct exynos_camera_buffer));
-
-			buffer = buffers;
-
-			memcpy(pointer, exynos_camera->capture_yuv_buffer, yuv_length);
+			// YUV lines were compacted in place, JPEG was gathered to the picture memory
 
 			buffer->pointer = pointer;
 			buffer->address = address;
@@ -1635,31 +1739,19 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 
 			memcpy(&exynos_camera->picture_yuv_buffer, buffer, sizeof(struct exynos_camera_buffer));
 
-			pointer = (void *) ((unsigned char *) pointer + yuv_length);
-			address += yuv_length;
-			buffer = (struct exynos_camera_buffer *) ((unsigned char *) buffer + sizeof(struct exynos_camera_buffer));
-
-			memcpy(pointer, exynos_camera->capture_jpeg_buffer, jpeg_length);
-
-			buffer->pointer = pointer;
-			buffer->address = address;
-			buffer->length = jpeg_length;
-			buffer->width = exynos_camera->picture_width;
-			buffer->height = exynos_camera->picture_height;
-			buffer->format = exynos_camera->picture_format;
+			frame->jpeg.pointer = (unsigned char *) exynos_camera->picture_jpeg_memory->data + EXYNOS_CAMERA_PICTURE_EXIF_LENGTH;
+			frame->jpeg.address = 0;
+			frame->jpeg.length = jpeg_length;
+			frame->jpeg.width = exynos_camera->picture_width;
+			frame->jpeg.height = exynos_camera->picture_height;
+			frame->jpeg.format = exynos_camera->picture_format;
+			frame->jpeg_enabled = 1;
 
-			memcpy(&exynos_camera->picture_jpeg_buffer, buffer, sizeof(struct exynos_camera_buffer));
+			memcpy(&exynos_camera->picture_jpeg_buffer, &frame->jpeg, sizeof(struct exynos_camera_buffer));
 
 			exynos_camera_picture_thread_start(exynos_camera);
-
-			memcpy(buffer, &exynos_camera->picture_yuv_buffer, sizeof(struct exynos_camera_buffer));
 		}
 	} else {
-		buffers_count = 1;
-		buffers = (struct exynos_camera_buffer *) calloc(buffers_count, sizeof(struct exynos_camera_buffer));
-
-		buffer = buffers;
-
 		buffer->pointer = pointer;
 		buffer->address = address;
 		buffer->length = buffer_length;
@@ -1673,73 +1765,182 @@ int exynos_camera_capture(struct exynos_camera *exynos_camera)
 		}
 	}
 
-	// Preview
-	if (exynos_camera->preview_enabled) {
-		memcpy(&exynos_camera->preview_buffer, buffer, sizeof(struct exynos_camera_buffer));
-		if (!exynos_camera->preview_output_enabled) {
-			rc = exynos_camera_preview_output_start(exynos_camera);
-			if (rc < 0) {
-				ALOGE("%s: Unable to start Preview Output", __func__);
-				goto error;
-			}
-		}
-		rc = exynos_camera_preview(exynos_camera);
-		if (rc < 0) {
-			ALOGE("%s: Unable to process Camera Preview", __func__);
-			goto error;
-		}
-	}
-
-	//Recording
-	if (exynos_camera->recording_enabled) {
-		if (exynos_camera->recording_output_enabled) {
-			memcpy(&exynos_camera->recording_buffer, buffer, sizeof(struct exynos_camera_buffer));
-
-			exynos_camera->recording_memory_index = index;
+	exynos_trace_point(&exynos_camera->trace, frame->trace_id, EXYNOS_TRACE_DECODE);
 
-			rc = exynos_camera_recording(exynos_camera);
-			if (rc < 0) {
-				ALOGE("%s: Unable to process Camera Recording", __func__);
-				goto error;
-			}
-		} else {
-			memcpy(&exynos_camera->recording_buffer, buffer, sizeof(struct exynos_camera_buffer));
+	// Stages
 
-			rc = exynos_camera_recording_output_start(exynos_camera);
-			if (rc < 0) {
-				ALOGE("%s: Unable to start recording output", __func__);
-				goto error;
-			}
+	frame->shared = exynos_camera_output_shared_available(exynos_camera);
+	frame->shared_state = EXYNOS_CAMERA_SHARED_PENDING;
+	frame->shared_index = -1;
 
-		}
-	} else {
-		if (exynos_camera->recording_output_enabled)
-			exynos_camera_recording_output_stop(exynos_camera);
+	if (exynos_camera->preview_enabled) {
+		rc = exynos_camera_frame_dispatch(exynos_camera, &exynos_camera->preview_stage, frame);
+		if (rc < 0 && frame->shared)
+			exynos_camera_output_shared_decline(exynos_camera, frame);
 	}
 
-	rc = exynos_v4l2_qbuf_cap(exynos_camera, 0, index);
-	if (rc < 0) {
-		ALOGE("%s: Unable to queue buffer", __func__);
-		goto error;
+	// Recording also gets frames after it was disabled, to stop its output
+	if (exynos_camera->recording_enabled || exynos_camera->recording_output_enabled) {
+		rc = exynos_camera_frame_dispatch(exynos_camera, &exynos_camera->recording_stage, frame);
+		if (rc < 0 && frame->shared)
+			exynos_camera_output_shared_publish(exynos_camera, frame, -1);
 	}
 
+	exynos_camera_frame_release(exynos_camera, frame);
+
 	rc = 0;
 	goto complete;
 
 error:
+	// The dequeued buffer goes back to the driver
+	if (frame != NULL)
+		exynos_camera_frame_release(exynos_camera, frame);
+
 	rc = -1;
 
 complete:
-	if (buffers != NULL)
-		free(buffers);
+	return rc;
+}
+
+/*
+ * Control operations that touch the capture are posted to the capture thread
+ * as commands, which it runs between two frames and acknowledges.
+ *
+ * The capture thread sleeps on a single epoll set, holding an eventfd for the
+ * commands and the V4L2 nodes registered with exynos_camera_capture_poll_add.
+ * Ready events are handled in order: commands, output nodes, then capture.
+ */
+
+int exynos_camera_capture_poll_add(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int events)
+{
+	struct epoll_event event;
+	int fd;
+	int rc;
+
+	if (exynos_camera == NULL || exynos_camera->capture_poll_fd < 0)
+		return -EINVAL;
+
+	fd = exynos_v4l2_fd(exynos_camera, exynos_v4l2_id);
+	if (fd < 0) {
+		ALOGE("%s: Unable to get v4l2 fd for id %d", __func__, exynos_v4l2_id);
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.u32 = (unsigned int) exynos_v4l2_id;
+
+	rc = epoll_ctl(exynos_camera->capture_poll_fd, EPOLL_CTL_ADD, fd, &event);
+	if (rc < 0 && errno == EEXIST)
+		rc = epoll_ctl(exynos_camera->capture_poll_fd, EPOLL_CTL_MOD, fd, &event);
+
+	if (rc < 0) {
+		ALOGE("%s: Unable to add v4l2 fd for id %d", __func__, exynos_v4l2_id);
+		return -1;
+	}
+
+	return 0;
+}
+
+void exynos_camera_capture_poll_remove(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id)
+{
+	int fd;
+
+	if (exynos_camera == NULL || exynos_camera->capture_poll_fd < 0)
+		return;
+
+	fd = exynos_v4l2_fd(exynos_camera, exynos_v4l2_id);
+	if (fd < 0)
+		return;
+
+	epoll_ctl(exynos_camera->capture_poll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int exynos_camera_capture_command_run(struct exynos_camera *exynos_camera,
+	struct exynos_camera_command *command)
+{
+	int rc;
+
+	switch (command->type) {
+		case EXYNOS_CAMERA_COMMAND_CAPTURE_SETUP:
+			rc = exynos_camera_capture_setup(exynos_camera);
+			break;
+		case EXYNOS_CAMERA_COMMAND_CAPTURE_STOP:
+			if (exynos_camera->capture_enabled)
+				exynos_camera_capture_stop(exynos_camera);
+			rc = 0;
+			break;
+		case EXYNOS_CAMERA_COMMAND_PARAMS_APPLY:
+			rc = exynos_camera_params_apply(exynos_camera, command->value);
+			break;
+		case EXYNOS_CAMERA_COMMAND_EXIT:
+			if (exynos_camera->capture_enabled)
+				exynos_camera_capture_stop(exynos_camera);
+			exynos_camera->capture_thread_enabled = 0;
+			rc = 0;
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+	}
 
 	return rc;
 }
 
+int exynos_camera_capture_command(struct exynos_camera *exynos_camera,
+	enum exynos_camera_command_type type, int value)
+{
+	struct exynos_camera_command command;
+	struct list_head *list_end;
+	struct list_head *list;
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	memset(&command, 0, sizeof(command));
+	command.type = type;
+	command.value = value;
+
+	// Without the thread (or from the thread itself), run it right away
+	if (!exynos_camera->capture_thread_enabled || pthread_equal(pthread_self(), exynos_camera->capture_thread))
+		return exynos_camera_capture_command_run(exynos_camera, &command);
+
+	pthread_mutex_lock(&exynos_camera->capture_mutex);
+
+	list_end = (struct list_head *) exynos_camera->capture_commands;
+	while (list_end != NULL && list_end->next != NULL)
+		list_end = list_end->next;
+
+	list = (struct list_head *) &command;
+	list_head_insert(list, list_end, NULL);
+
+	if (exynos_camera->capture_commands == NULL)
+		exynos_camera->capture_commands = &command;
+
+	eventfd_write(exynos_camera->capture_command_fd, 1);
+
+	while (!command.done)
+		pthread_cond_wait(&exynos_camera->capture_command_done_cond, &exynos_camera->capture_mutex);
+
+	pthread_mutex_unlock(&exynos_camera->capture_mutex);
+
+	return command.rc;
+}
+
 void *exynos_camera_capture_thread(void *data)
 {
 	struct exynos_camera *exynos_camera;
+	struct exynos_camera_command *command;
+	struct epoll_event events[EXYNOS_CAMERA_POLL_EVENTS_COUNT];
+	eventfd_t value;
+	int capture_ready;
+	int paused = 0;
+	int count;
+	int id;
 	int rc;
+	int i;
 
 	if (data == NULL)
 		return NULL;
@@ -1749,31 +1950,73 @@ void *exynos_camera_capture_thread(void *data)
 	ALOGE("%s: Starting thread", __func__);
 	exynos_camera->capture_thread_running = 1;
 
+	pthread_mutex_lock(&exynos_camera->capture_mutex);
+
 	while (exynos_camera->capture_thread_enabled) {
-		pthread_mutex_lock(&exynos_camera->capture_lock_mutex);
+		if (exynos_camera->capture_commands != NULL) {
+			command = exynos_camera->capture_commands;
+			exynos_camera->capture_commands = (struct exynos_camera_command *) command->list.next;
+			list_head_remove((struct list_head *) command);
 
-		while (exynos_camera->capture_enabled) {
+			pthread_mutex_unlock(&exynos_camera->capture_mutex);
+			rc = exynos_camera_capture_command_run(exynos_camera, command);
 			pthread_mutex_lock(&exynos_camera->capture_mutex);
 
-			if (!exynos_camera->capture_enabled) {
-				pthread_mutex_unlock(&exynos_camera->capture_mutex);
-				break;
-			}
+			command->rc = rc;
+			command->done = 1;
+			pthread_cond_broadcast(&exynos_camera->capture_command_done_cond);
 
-			rc = exynos_camera_capture(exynos_camera);
-			if (rc < 0) {
-				ALOGE("%s: Unable to capture", __func__);
-				pthread_mutex_unlock(&exynos_camera->capture_mutex);
-				break;
+			// Resume a capture that was paused by an error
+			if (paused && exynos_camera->capture_enabled)
+				exynos_camera_capture_poll_add(exynos_camera, 0, EPOLLIN);
+
+			paused = 0;
+			continue;
+		}
+
+		pthread_mutex_unlock(&exynos_camera->capture_mutex);
+
+		count = epoll_wait(exynos_camera->capture_poll_fd, events, EXYNOS_CAMERA_POLL_EVENTS_COUNT, -1);
+		if (count < 0 && errno != EINTR)
+			ALOGE("%s: Unable to poll", __func__);
+
+		capture_ready = 0;
+
+		for (i = 0; i < count; i++) {
+			id = (int) events[i].data.u32;
+
+			if (id == EXYNOS_CAMERA_POLL_COMMAND) {
+				// Commands are picked from the list, the counter only wakes us
+				eventfd_read(exynos_camera->capture_command_fd, &value);
+			} else if (id == 0) {
+				capture_ready = 1;
+			} else if (id == exynos_camera->recording_output.v4l2_id) {
+				if (exynos_camera_recording_complete(exynos_camera) > 0)
+					exynos_camera->recording_completions++;
 			}
+		}
 
-			pthread_mutex_unlock(&exynos_camera->capture_mutex);
+		pthread_mutex_lock(&exynos_camera->capture_mutex);
+
+		// Pending commands go before the next frame
+		if (!capture_ready || !exynos_camera->capture_enabled || paused || exynos_camera->capture_commands != NULL)
+			continue;
+
+		pthread_mutex_unlock(&exynos_camera->capture_mutex);
 
-			// Wait a bit to let others lock the mutex if they need to
-			usleep(10);
+		rc = exynos_camera_capture(exynos_camera);
+		if (rc < 0) {
+			// Wait for the next command, instead of spinning on the error
+			ALOGE("%s: Unable to capture", __func__);
+			exynos_camera_capture_poll_remove(exynos_camera, 0);
+			paused = 1;
 		}
+
+		pthread_mutex_lock(&exynos_camera->capture_mutex);
 	}
 
+	pthread_mutex_unlock(&exynos_camera->capture_mutex);
+
 	exynos_camera->capture_thread_running = 0;
 	ALOGE("%s: Exiting thread", __func__);
 
@@ -1789,13 +2032,23 @@ void exynos_camera_picture_thread_start(struct exynos_camera *exynos_camera)
 
 	exynos_camera->picture_completed = 0;
 
+	// The pool is released when the picture thread is done
+	rc = exynos_jpeg_pool_hold(exynos_camera, &exynos_camera->picture_jpeg_pool);
+	if (rc < 0) {
+		ALOGE("%s: Unable to hold jpeg pool", __func__);
+		return;
+	}
+
 	pthread_attr_t thread_attr;
 	pthread_attr_init(&thread_attr);
 	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
 
 	rc = pthread_create(&exynos_camera->picture_thread, &thread_attr, exynos_camera_picture, (void *) exynos_camera);
-	if (rc < 0)
+	if (rc != 0) {
 		ALOGE("%s: Unable to create thread", __func__);
+		exynos_jpeg_pool_release(exynos_camera, &exynos_camera->picture_jpeg_pool);
+		return;
+	}
 
 	exynos_camera->picture_running = 1;
 
@@ -1804,7 +2057,7 @@ void exynos_camera_picture_thread_start(struct exynos_camera *exynos_camera)
 
 int exynos_camera_capture_thread_start(struct exynos_camera *exynos_camera)
 {
-	pthread_attr_t thread_attr;
+	struct epoll_event event;
 	int rc;
 
 	if (exynos_camera == NULL)
@@ -1817,19 +2070,43 @@ int exynos_camera_capture_thread_start(struct exynos_camera *exynos_camera)
 		return -1;
 	}
 
-	pthread_mutex_init(&exynos_camera->capture_mutex, NULL);
-	pthread_mutex_init(&exynos_camera->capture_lock_mutex, NULL);
+	exynos_camera->capture_poll_fd = epoll_create(EXYNOS_CAMERA_POLL_EVENTS_COUNT);
+	if (exynos_camera->capture_poll_fd < 0) {
+		ALOGE("%s: Unable to create poll fd", __func__);
+		return -1;
+	}
 
-	// Initial lock
-	pthread_mutex_lock(&exynos_camera->capture_lock_mutex);
+	exynos_camera->capture_command_fd = eventfd(0, 0);
+	if (exynos_camera->capture_command_fd < 0) {
+		ALOGE("%s: Unable to create command fd", __func__);
+		goto error_fd;
+	}
 
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = (unsigned int) EXYNOS_CAMERA_POLL_COMMAND;
 
-	exynos_camera->capture_thread_enabled = 1;
-
-	rc = pthread_create(&exynos_camera->capture_thread, &thread_attr, exynos_camera_capture_thread, (void *) exynos_camera);
+	rc = epoll_ctl(exynos_camera->capture_poll_fd, EPOLL_CTL_ADD, exynos_camera->capture_command_fd, &event);
 	if (rc < 0) {
+		ALOGE("%s: Unable to add command fd", __func__);
+		goto error_fd;
+	}
+
+	pthread_mutex_init(&exynos_camera->capture_mutex, NULL);
+	pthread_mutex_init(&exynos_camera->capture_queue_mutex, NULL);
+	pthread_mutex_init(&exynos_camera->preview_callback_mutex, NULL);
+	pthread_mutex_init(&exynos_camera->preview_window_mutex, NULL);
+	pthread_mutex_init(&exynos_camera->recording_pending_mutex, NULL);
+	pthread_mutex_init(&exynos_camera->output_shared_mutex, NULL);
+	pthread_cond_init(&exynos_camera->capture_command_done_cond, NULL);
+	pthread_cond_init(&exynos_camera->recording_pending_cond, NULL);
+	pthread_cond_init(&exynos_camera->output_shared_cond, NULL);
+
+	exynos_camera->capture_commands = NULL;
+	exynos_camera->capture_thread_enabled = 1;
+
+	rc = pthread_create(&exynos_camera->capture_thread, NULL, exynos_camera_capture_thread, (void *) exynos_camera);
+	if (rc != 0) {
 		ALOGE("%s: Unable to create thread", __func__);
 		goto error;
 	}
@@ -1838,8 +2115,25 @@ int exynos_camera_capture_thread_start(struct exynos_camera *exynos_camera)
 	goto complete;
 
 error:
+	exynos_camera->capture_thread_enabled = 0;
+
+	pthread_cond_destroy(&exynos_camera->output_shared_cond);
+	pthread_cond_destroy(&exynos_camera->recording_pending_cond);
+	pthread_cond_destroy(&exynos_camera->capture_command_done_cond);
+	pthread_mutex_destroy(&exynos_camera->output_shared_mutex);
+	pthread_mutex_destroy(&exynos_camera->recording_pending_mutex);
+	pthread_mutex_destroy(&exynos_camera->preview_window_mutex);
+	pthread_mutex_destroy(&exynos_camera->preview_callback_mutex);
+	pthread_mutex_destroy(&exynos_camera->capture_queue_mutex);
 	pthread_mutex_destroy(&exynos_camera->capture_mutex);
-	pthread_mutex_destroy(&exynos_camera->capture_lock_mutex);
+
+error_fd:
+	if (exynos_camera->capture_command_fd >= 0)
+		close(exynos_camera->capture_command_fd);
+	exynos_camera->capture_command_fd = -1;
+
+	close(exynos_camera->capture_poll_fd);
+	exynos_camera->capture_poll_fd = -1;
 
 	rc = -1;
 
@@ -1849,8 +2143,6 @@ complete:
 
 void exynos_camera_capture_thread_stop(struct exynos_camera *exynos_camera)
 {
-	int i;
-
 	if (exynos_camera == NULL)
 		return;
 
@@ -1861,29 +2153,26 @@ void exynos_camera_capture_thread_stop(struct exynos_camera *exynos_camera)
 		return;
 	}
 
-	exynos_camera->capture_enabled = 0;
-	exynos_camera->capture_thread_enabled = 0;
+	// The capture is stopped by the thread before it ends
+	exynos_camera_capture_command(exynos_camera, EXYNOS_CAMERA_COMMAND_EXIT, 0);
 
-	pthread_mutex_unlock(&exynos_camera->capture_lock_mutex);
+	pthread_join(exynos_camera->capture_thread, NULL);
 
-	// Wait for the thread to end
-	i = 0;
-	while (exynos_camera->capture_thread_running) {
-		if (i++ > 10000) {
-			ALOGE("Capture thread is taking too long to end, something is going wrong");
-			break;
-		}
-		usleep(100);
-	}
+	pthread_cond_destroy(&exynos_camera->output_shared_cond);
+	pthread_cond_destroy(&exynos_camera->recording_pending_cond);
+	pthread_cond_destroy(&exynos_camera->capture_command_done_cond);
+	pthread_mutex_destroy(&exynos_camera->output_shared_mutex);
+	pthread_mutex_destroy(&exynos_camera->recording_pending_mutex);
+	pthread_mutex_destroy(&exynos_camera->preview_window_mutex);
+	pthread_mutex_destroy(&exynos_camera->preview_callback_mutex);
+	pthread_mutex_destroy(&exynos_camera->capture_queue_mutex);
+	pthread_mutex_destroy(&exynos_camera->capture_mutex);
 
-	if (exynos_camera->capture_enabled) {
-		pthread_mutex_lock(&exynos_camera->capture_mutex);
-		exynos_camera_capture_stop(exynos_camera);
-		pthread_mutex_unlock(&exynos_camera->capture_mutex);
-	}
+	close(exynos_camera->capture_command_fd);
+	exynos_camera->capture_command_fd = -1;
 
-	pthread_mutex_destroy(&exynos_camera->capture_mutex);
-	pthread_mutex_destroy(&exynos_camera->capture_lock_mutex);
+	close(exynos_camera->capture_poll_fd);
+	exynos_camera->capture_poll_fd = -1;
 }
 
 int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
@@ -1893,6 +2182,8 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 	int mbus_width, mbus_height;
 	int buffers_count, buffer_length;
 	camera_memory_t *memory = NULL;
+	char property[PROPERTY_VALUE_MAX];
+	int threads_count;
 	int value;
 	int fd;
 	int rc;
@@ -2013,6 +2304,10 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 	buffers_count = rc;
 	ALOGD("Found %d buffers available for capture!", buffers_count);
 
+	// Frames are tracked in a fixed table
+	if (buffers_count > EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT)
+		buffers_count = EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT;
+
 	memset(&fps_param, 0, sizeof(fps_param));
 	fps_param.parm.capture.timeperframe.numerator = 1;
 	fps_param.parm.capture.timeperframe.denominator = exynos_camera->preview_fps;
@@ -2067,15 +2362,74 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 	}
 
 	if (!exynos_camera->camera_fimc_is) {
-		exynos_camera->capture_yuv_buffer = malloc(buffer_length);
-		exynos_camera->capture_jpeg_buffer = malloc(buffer_length);
+		exynos_camera->capture_yuv_offsets = (unsigned int *) calloc(buffer_length / (width * 2), sizeof(unsigned int));
+
+		// At most one JPEG segment before each line, plus the trailing one
+		exynos_camera->capture_jpeg_segments = (struct exynos_camera_jpeg_segment *) calloc(buffer_length / (width * 2) + 1, sizeof(struct exynos_camera_jpeg_segment));
+		exynos_camera->capture_jpeg_segments_count = 0;
+
+		if (exynos_camera->capture_yuv_offsets == NULL || exynos_camera->capture_jpeg_segments == NULL) {
+			ALOGE("%s: Unable to allocate decoding buffers", __func__);
+			goto error;
+		}
+
+		// Decoding threads, including the capture thread
+		property_get("camera.decode.threads", property, "");
+		threads_count = atoi(property);
+		if (threads_count <= 0)
+			threads_count = EXYNOS_CAMERA_DECODE_THREADS_COUNT;
+		if (threads_count > EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1)
+			threads_count = EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1;
+
+		exynos_camera->capture_threads_count = threads_count;
+
+		if (threads_count > 1) {
+			rc = exynos_worker_pool_start(&exynos_camera->capture_workers, threads_count - 1);
+			if (rc < 0)
+				ALOGE("%s: Unable to start decoding workers, decoding serially", __func__);
+		}
 	}
 
 	// Start EXIF
 	memset(&exynos_camera->exif, 0, sizeof(struct exynos_exif));
 	exynos_exif_start(exynos_camera, &exynos_camera->exif);
 
+	memset(&exynos_camera->capture_frames, 0, sizeof(exynos_camera->capture_frames));
+	exynos_trace_reset(&exynos_camera->trace);
+
+	memset(&exynos_camera->capture_drops, 0, sizeof(exynos_camera->capture_drops));
+
+	property_get("camera.drops.log", property, "");
+	value = property[0] != '\0' ? atoi(property) : EXYNOS_CAMERA_DROPS_LOG_INTERVAL;
+	exynos_camera->capture_drops.log_interval = (int64_t) value * 1000000LL;
+
+	property_get("camera.capture.adaptive", property, "0");
+	exynos_camera->capture_queue_adaptive = atoi(property) > 0;
+
+	// Recording conversions are completed from the capture thread
+	property_get("camera.output.async", property, "1");
+	exynos_camera->recording_async = atoi(property) > 0;
+
+	value = exynos_camera_capture_queue_min(exynos_camera);
+	if (exynos_camera->capture_queue_adaptive && buffers_count > value)
+		exynos_camera->capture_queue_depth = value;
+	else
+		exynos_camera->capture_queue_depth = buffers_count;
+
+	exynos_camera->capture_queue_active = exynos_camera->capture_queue_depth;
+	exynos_camera->capture_queue_parked_count = 0;
+	exynos_camera->capture_queue_drops = 0;
+	exynos_camera->capture_queue_frames = 0;
+	exynos_camera->capture_queue_stable_frames = 0;
+
 	for (i = 0; i < buffers_count; i++) {
+		exynos_camera->capture_frames[i].index = i;
+
+		if (i >= exynos_camera->capture_queue_depth) {
+			exynos_camera->capture_queue_parked[exynos_camera->capture_queue_parked_count++] = i;
+			continue;
+		}
+
 		rc = exynos_v4l2_qbuf_cap(exynos_camera, 0, i);
 		if (rc < 0) {
 			ALOGE("%s: Unable to queue buffer", __func__);
@@ -2086,6 +2440,22 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 	exynos_camera->capture_buffers_count = buffers_count;
 	exynos_camera->capture_buffer_length = buffer_length;
 
+	// Preview frames are taken from the recording output when they match
+	property_get("camera.output.shared", property, "1");
+	exynos_camera->output_shared = atoi(property) > 0;
+
+	rc = exynos_stage_start(exynos_camera, &exynos_camera->preview_stage, "preview", exynos_camera_preview_stage);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start preview stage", __func__);
+		goto error;
+	}
+
+	rc = exynos_stage_start(exynos_camera, &exynos_camera->recording_stage, "recording", exynos_camera_recording_stage);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start recording stage", __func__);
+		goto error;
+	}
+
 	rc = exynos_v4l2_s_ctrl(exynos_camera, 0, V4L2_CID_ROTATION,
 		exynos_camera->camera_rotation);
 	if (rc < 0) {
@@ -2113,6 +2483,12 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 		goto error;
 	}
 
+	rc = exynos_camera_capture_poll_add(exynos_camera, 0, EPOLLIN);
+	if (rc < 0) {
+		ALOGE("%s: Unable to poll capture", __func__);
+		goto error;
+	}
+
 	// Few Scene Modes require to be set after stream on
 	rc = exynos_v4l2_s_ctrl(exynos_camera, 0, V4L2_CID_CAMERA_SCENE_MODE, exynos_camera->scene_mode);
 	if (rc < 0) {
@@ -2129,7 +2505,6 @@ int exynos_camera_capture_start(struct exynos_camera *exynos_camera)
 	}
 
 	exynos_camera->capture_enabled = 1;
-	pthread_mutex_unlock(&exynos_camera->capture_lock_mutex);
 
 	rc = 0;
 	goto complete;
@@ -2144,6 +2519,28 @@ error:
 		exynos_camera->capture_memory = NULL;
 	}
 
+	if (exynos_camera->preview_stage.enabled)
+		exynos_stage_stop(&exynos_camera->preview_stage);
+
+	if (exynos_camera->recording_stage.enabled)
+		exynos_stage_stop(&exynos_camera->recording_stage);
+
+	if (exynos_camera->capture_workers.enabled)
+		exynos_worker_pool_stop(&exynos_camera->capture_workers);
+
+	if (exynos_camera->capture_yuv_offsets != NULL) {
+		free(exynos_camera->capture_yuv_offsets);
+		exynos_camera->capture_yuv_offsets = NULL;
+	}
+
+	if (exynos_camera->capture_jpeg_segments != NULL) {
+		free(exynos_camera->capture_jpeg_segments);
+		exynos_camera->capture_jpeg_segments = NULL;
+	}
+
+	if (exynos_camera->exif.enabled)
+		exynos_exif_stop(exynos_camera, &exynos_camera->exif);
+
 	rc = -1;
 
 complete:
@@ -2178,6 +2575,22 @@ void exynos_camera_capture_stop(struct exynos_camera *exynos_camera)
 			ALOGE("%s: Unable to stop face detection", __func__);
 	}
 
+	exynos_camera_capture_poll_remove(exynos_camera, 0);
+
+	// Nothing completes recording conversions once the capture thread is done
+	pthread_mutex_lock(&exynos_camera->recording_pending_mutex);
+	exynos_camera->recording_async = 0;
+	pthread_mutex_unlock(&exynos_camera->recording_pending_mutex);
+
+	exynos_camera_recording_complete(exynos_camera);
+
+	// Stages release their frames while the stream is still on
+	if (exynos_camera->preview_stage.enabled)
+		exynos_stage_stop(&exynos_camera->preview_stage);
+
+	if (exynos_camera->recording_stage.enabled)
+		exynos_stage_stop(&exynos_camera->recording_stage);
+
 	rc = exynos_v4l2_streamoff_cap(exynos_camera, 0);
 	if (rc < 0) {
 		ALOGE("%s: Unable to stop stream", __func__);
@@ -2193,14 +2606,25 @@ void exynos_camera_capture_stop(struct exynos_camera *exynos_camera)
 		exynos_camera->capture_memory = NULL;
 	}
 
-	if (exynos_camera->capture_yuv_buffer != NULL) {
-		free(exynos_camera->capture_yuv_buffer);
-		exynos_camera->capture_yuv_buffer = NULL;
+	if (exynos_camera->capture_workers.enabled)
+		exynos_worker_pool_stop(&exynos_camera->capture_workers);
+
+	if (exynos_camera->capture_yuv_offsets != NULL) {
+		free(exynos_camera->capture_yuv_offsets);
+		exynos_camera->capture_yuv_offsets = NULL;
+	}
+
+	if (exynos_camera->capture_jpeg_segments != NULL) {
+		free(exynos_camera->capture_jpeg_segments);
+		exynos_camera->capture_jpeg_segments = NULL;
 	}
 
-	if (exynos_camera->capture_jpeg_buffer != NULL) {
-		free(exynos_camera->capture_jpeg_buffer);
-		exynos_camera->capture_jpeg_buffer = NULL;
+	// A picture that was never started still holds its memory
+	if (!exynos_camera->picture_running && exynos_camera->picture_jpeg_memory != NULL) {
+		if (exynos_camera->picture_jpeg_memory->release != NULL)
+			exynos_camera->picture_jpeg_memory->release(exynos_camera->picture_jpeg_memory);
+
+		exynos_camera->picture_jpeg_memory = NULL;
 	}
 
 	if (exynos_camera->exif.enabled)
@@ -2258,6 +2682,7 @@ int exynos_camera_capture_setup(struct exynos_camera *exynos_camera)
 int exynos_camera_preview_output_start(struct exynos_camera *exynos_camera)
 {
 	struct exynos_v4l2_output *output;
+	char property[PROPERTY_VALUE_MAX];
 	int rc;
 
 	if (exynos_camera == NULL)
@@ -2281,6 +2706,11 @@ int exynos_camera_preview_output_start(struct exynos_camera *exynos_camera)
 	output->buffer_height = exynos_camera->preview_buffer.height;
 	output->buffer_format = exynos_camera->preview_buffer.format;
 	output->buffers_count = EXYNOS_CAMERA_PREVIEW_BUFFERS_COUNT;
+	output->software_fallback = 1;
+
+	// FIMC keeps streaming between frames, unless disabled for debugging
+	property_get("camera.output.streaming", property, "1");
+	output->streaming = atoi(property) > 0;
 
 	rc = exynos_v4l2_output_start(exynos_camera, output);
 	if (rc < 0) {
@@ -2321,203 +2751,924 @@ void exynos_camera_preview_output_stop(struct exynos_camera *exynos_camera)
 	exynos_camera->preview_output_enabled = 0;
 }
 
-int exynos_camera_preview(struct exynos_camera *exynos_camera)
+/*
+ * Pacers decimate frames down to a target rate, from their timestamps. A frame
+ * is due when it is at most a quarter interval early, so that jitter doesn't
+ * halve a rate that matches the sensor one. The schedule is kept unless frames
+ * fall behind by more than an interval, so the long-term rate stays on target.
+ */
+
+void exynos_camera_pacer_setup(struct exynos_camera_pacer *pacer, int fps)
 {
-	struct exynos_v4l2_output *output;
-	int width, height, format;
-	buffer_handle_t *window_buffer;
-	void *window_data;
-	int window_stride;
-	camera_memory_t *memory;
-	camera_face_t caface[exynos_camera->max_detected_faces];
-	void *memory_pointer;
-	int memory_index;
-	int memory_size;
-	int rc;
+	if (pacer == NULL)
+		return;
 
-	if (exynos_camera == NULL)
-		goto error;
+	memset(pacer, 0, sizeof(struct exynos_camera_pacer));
 
-//     ALOGD("%s()", __func__);
+	if (fps <= 0)
+		return;
 
-	width = exynos_camera->preview_width;
-	height = exynos_camera->preview_height;
-	format = exynos_camera->preview_format;
+	pacer->fps = fps;
+	pacer->interval = 1000000000LL / fps;
+}
 
-	output = &exynos_camera->preview_output;
+int exynos_camera_pacer_due(struct exynos_camera_pacer *pacer,
+	int64_t timestamp)
+{
+	if (pacer == NULL)
+		return 1;
 
-	if (exynos_camera->preview_output_enabled) {
-		rc = exynos_v4l2_output(exynos_camera, output, exynos_camera->preview_buffer.address);
-		if (rc < 0) {
-			ALOGE("%s: Unable to output preview", __func__);
-			goto error;
+	if (pacer->interval > 0 && pacer->passed > 0) {
+		if (timestamp < pacer->next - pacer->interval / 4) {
+			pacer->skipped++;
+			return 0;
 		}
 
-		memory = output->memory;
-		memory_index = output->memory_index;
-		memory_pointer = (void *) ((unsigned char *) memory->data + output->buffer_length * memory_index);
-		memory_size = output->buffer_length;
+		if (timestamp - pacer->next > pacer->interval)
+			pacer->next = timestamp + pacer->interval;
+		else
+			pacer->next += pacer->interval;
 	} else {
-		// In that case, we can directly use the capture memory
-		memory = exynos_camera->capture_memory;
-		memory_index = exynos_camera->capture_memory_index;
-		memory_pointer = exynos_camera->preview_buffer.pointer;
-		memory_size = exynos_camera->preview_buffer.length;
+		pacer->next = timestamp + pacer->interval;
 	}
 
-	if (exynos_camera->preview_window != NULL && exynos_camera->gralloc != NULL) {
-		int ret = exynos_camera->preview_window->dequeue_buffer(exynos_camera->preview_window, &window_buffer, &window_stride);
-		if (ret < 0) {
-			ALOGE("%s: Error in dequeueing buffer", __func__);
-			goto error;
-		}
-		ret = exynos_camera->gralloc->lock(exynos_camera->gralloc, *window_buffer, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, width, height, &window_data);
+	pacer->passed++;
 
-		if (window_data == NULL || ret == -EINVAL) {
-			ALOGE("%s: Unable to lock gralloc", __func__);
-			goto error;
-		}
+	return 1;
+}
 
-		memcpy(window_data, memory_pointer, memory_size);
+/*
+ * In zero-copy mode, FIMC writes the preview straight to the window buffers.
+ * Their physical address is looked up from the ION fd of the gralloc handle
+ * the first time they are dequeued and kept for the window lifetime.
+ * Buffers without a usable address or with another layout than the FIMC
+ * output (e.g. YV12) are copied to, as in the default mode.
+ */
 
-		exynos_camera->gralloc->unlock(exynos_camera->gralloc, *window_buffer);
-		exynos_camera->preview_window->enqueue_buffer(exynos_camera->preview_window, window_buffer);
-	}
+int exynos_camera_preview_window_address(struct exynos_camera *exynos_camera,
+	buffer_handle_t handle)
+{
+	struct exynos_camera_window_buffer *window_buffer;
+	int address = 0;
+	int i;
 
-	if (exynos_camera->camera_fimc_is) {
-		exynos_camera->mFaceData.faces = caface;
-		exynos_v4l2_s_ext_ctrl_face_detection(exynos_camera, 0, &exynos_camera->mFaceData);
-	}
+	if (exynos_camera == NULL || handle == NULL)
+		return 0;
 
-	if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_FRAME) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock) {
-		exynos_camera->callbacks.data(CAMERA_MSG_PREVIEW_FRAME, memory, memory_index, NULL, exynos_camera->callbacks.user);
+	for (i = 0; i < exynos_camera->preview_window_buffers_count; i++) {
+		window_buffer = &exynos_camera->preview_window_buffers[i];
+		if (window_buffer->handle == handle)
+			return window_buffer->address;
 	}
 
-	if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_METADATA) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock) {
-		exynos_camera->callbacks.data(CAMERA_MSG_PREVIEW_METADATA, exynos_camera->face_data, 0, &exynos_camera->mFaceData, exynos_camera->callbacks.user);
+#ifdef EXYNOS_ION
+	if (handle->numFds > 0) {
+		address = exynos_ion_phys(exynos_camera, handle->data[0]);
+		if (address == -1 || address == (int) 0xffffffff)
+			address = 0;
 	}
+#endif
 
-	if (exynos_camera->preview_output_enabled) {
-		rc = exynos_v4l2_output_release(exynos_camera, output);
-		if (rc < 0) {
-			ALOGE("%s: Unable to release preview output", __func__);
-			goto error;
-		}
+	if (address == 0)
+		ALOGE("%s: Unable to get window buffer address, copying", __func__);
+
+	// Buffers beyond the table are looked up again every time
+	if (exynos_camera->preview_window_buffers_count < EXYNOS_CAMERA_WINDOW_BUFFERS_COUNT) {
+		window_buffer = &exynos_camera->preview_window_buffers[exynos_camera->preview_window_buffers_count++];
+		window_buffer->handle = handle;
+		window_buffer->address = address;
 	}
 
-	rc = 0;
-	goto complete;
+	return address;
+}
 
-error:
-	rc = -1;
+/*
+ * Window buffers are dequeued and locked one frame ahead, right after the
+ * previous one is enqueued, so that the next frame can be written as soon as
+ * it is available. Buffers that FIMC can write to directly are not locked.
+ * A buffer left ahead is unlocked and cancelled when the window goes away.
+ * The window, its buffers and the one ahead are only used with
+ * preview_window_mutex held, which is taken to change the window.
+ */
 
-complete:
-	return rc;
+static void exynos_camera_cost_add(struct exynos_camera_cost *cost,
+	int64_t start)
+{
+	int64_t time;
+
+	time = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+	cost->total += time;
+	if (time > cost->max)
+		cost->max = time;
+
+	cost->count++;
 }
 
-int exynos_camera_preview_start(struct exynos_camera *exynos_camera)
+static int64_t exynos_camera_cost_average(struct exynos_camera_cost *cost)
 {
-	if (exynos_camera == NULL)
-		return -EINVAL;
+	if (cost->count == 0)
+		return 0;
 
-	ALOGD("%s()", __func__);
+	return cost->total / cost->count;
+}
 
-	if (exynos_camera->preview_enabled) {
-		ALOGE("Preview was already started!");
+int exynos_camera_preview_window_dequeue(struct exynos_camera *exynos_camera,
+	buffer_handle_t **buffer, int *stride, void **data)
+{
+	struct preview_stream_ops *window;
+	int64_t start;
+	int rc;
+
+	if (exynos_camera == NULL || buffer == NULL || stride == NULL || data == NULL)
+		return -EINVAL;
+
+	window = exynos_camera->preview_window;
+	if (window == NULL)
 		return -1;
+
+	if (exynos_camera->preview_window_next_buffer != NULL && exynos_camera->preview_window_next_window == window) {
+		*buffer = exynos_camera->preview_window_next_buffer;
+		*stride = exynos_camera->preview_window_next_stride;
+		*data = exynos_camera->preview_window_next_data;
+
+		exynos_camera->preview_window_next_buffer = NULL;
+		exynos_camera->preview_window_next_data = NULL;
+
+		return 0;
 	}
 
-	exynos_camera_capture_setup(exynos_camera);
+	start = systemTime(SYSTEM_TIME_MONOTONIC);
 
-	exynos_camera->preview_enabled = 1;
+	rc = window->dequeue_buffer(window, buffer, stride);
+	if (rc < 0)
+		return -1;
+
+	exynos_camera_cost_add(&exynos_camera->preview_window_dequeue_cost, start);
+
+	*data = NULL;
 
 	return 0;
 }
 
-void exynos_camera_preview_stop(struct exynos_camera *exynos_camera)
+int exynos_camera_preview_window_lock(struct exynos_camera *exynos_camera,
+	buffer_handle_t *buffer, void **data)
 {
-	int i;
-
-	if (exynos_camera == NULL)
-		return;
+	int64_t start;
+	int rc;
 
-	ALOGD("%s()", __func__);
+	if (exynos_camera == NULL || exynos_camera->gralloc == NULL || buffer == NULL || data == NULL)
+		return -EINVAL;
 
-	if (!exynos_camera->preview_enabled) {
-		ALOGE("Preview was already stopped!");
-		return;
-	}
+	start = systemTime(SYSTEM_TIME_MONOTONIC);
 
-	exynos_camera->preview_enabled = 0;
+	*data = NULL;
 
-	if (exynos_camera->capture_enabled) {
-		pthread_mutex_lock(&exynos_camera->capture_mutex);
-		exynos_camera_capture_stop(exynos_camera);
-		pthread_mutex_unlock(&exynos_camera->capture_mutex);
-	}
+	rc = exynos_camera->gralloc->lock(exynos_camera->gralloc, *buffer, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, exynos_camera->preview_width, exynos_camera->preview_height, data);
+	if (*data == NULL || rc == -EINVAL)
+		return -1;
 
-	if (exynos_camera->preview_output_enabled)
-		exynos_camera_preview_output_stop(exynos_camera);
+	exynos_camera_cost_add(&exynos_camera->preview_window_lock_cost, start);
 
-	exynos_camera->preview_window = NULL;
+	return 0;
 }
 
-// Picture
+void exynos_camera_preview_window_unlock(struct exynos_camera *exynos_camera,
+	buffer_handle_t *buffer)
+{
+	int64_t start;
 
-void *exynos_camera_picture(void *data)
+	if (exynos_camera == NULL || exynos_camera->gralloc == NULL || buffer == NULL)
+		return;
+
+	start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	exynos_camera->gralloc->unlock(exynos_camera->gralloc, *buffer);
+
+	exynos_camera_cost_add(&exynos_camera->preview_window_unlock_cost, start);
+}
+
+void exynos_camera_preview_window_prefetch(struct exynos_camera *exynos_camera)
 {
-	struct exynos_camera *exynos_camera;
-	struct exynos_camera_buffer *jpeg_buffer;
-	struct exynos_camera_buffer *yuv_buffer;
-	struct exynos_v4l2_output output;
-	struct exynos_jpeg jpeg;
-	int output_enabled = 0;
-	int width, height, format;
-	int buffer_width, buffer_height, buffer_format, buffer_address;
-	camera_memory_t *memory = NULL;
-	int memory_size;
-	unsigned char *p;
-	camera_memory_t *jpeg_memory = NULL;
-	void *jpeg_data = NULL;
-	int jpeg_size = 0;
-	camera_memory_t *jpeg_thumbnail_memory = NULL;
-	void *jpeg_thumbnail_data = NULL;
-	int jpeg_thumbnail_size = 0;
-	void *yuv_data = NULL;
-	int yuv_address = 0;
-	int yuv_size = 0;
-	void *yuv_thumbnail_data = NULL;
-	int yuv_thumbnail_address;
-	int yuv_thumbnail_size = 0;
+	struct preview_stream_ops *window;
+	buffer_handle_t *buffer;
+	void *data = NULL;
+	int address = 0;
+	int stride;
+	int64_t start;
 	int rc;
 
-	exynos_camera = (struct exynos_camera *) data;
-
 	if (exynos_camera == NULL)
-		goto error;
+		return;
 
-	ALOGD("%s()", __func__);
+	window = exynos_camera->preview_window;
+	if (!exynos_camera->preview_window_pipelined || window == NULL || exynos_camera->gralloc == NULL)
+		return;
 
-	jpeg_buffer = &exynos_camera->picture_jpeg_buffer;
-	yuv_buffer = &exynos_camera->picture_yuv_buffer;
+	if (exynos_camera->preview_window_next_buffer != NULL)
+		return;
 
-	if (jpeg_buffer->pointer != NULL && jpeg_buffer->length > 0) {
-		jpeg_data = jpeg_buffer->pointer;
-		jpeg_size = jpeg_buffer->length;
-	}
+	start = systemTime(SYSTEM_TIME_MONOTONIC);
 
-	if (yuv_buffer->pointer != NULL && yuv_buffer->length > 0) {
-		yuv_data = yuv_buffer->pointer;
-		yuv_address = yuv_buffer->address;
-		yuv_size = yuv_buffer->length;
+	rc = window->dequeue_buffer(window, &buffer, &stride);
+	if (rc < 0) {
+		ALOGE("%s: Error in dequeueing buffer", __func__);
+		return;
 	}
 
-	// JPEG
+	exynos_camera_cost_add(&exynos_camera->preview_window_dequeue_cost, start);
 
-	if (jpeg_data == NULL) {
-		if (yuv_data == NULL || yuv_size <= 0) {
-			ALOGE("%s: Unable to create jpeg without an YUV buffer", __func__);
-			goto error;
+	if (exynos_camera->preview_window_zero_copy && exynos_blit_preview_direct(exynos_camera->preview_format, exynos_camera->preview_width, stride))
+		address = exynos_camera_preview_window_address(exynos_camera, *buffer);
+
+	// Frames may still be copied to zero-copy buffers, that are locked then
+	if (address == 0) {
+		rc = exynos_camera_preview_window_lock(exynos_camera, buffer, &data);
+		if (rc < 0) {
+			ALOGE("%s: Unable to lock gralloc", __func__);
+			data = NULL;
+		}
+	}
+
+	exynos_camera->preview_window_next_window = window;
+	exynos_camera->preview_window_next_buffer = buffer;
+	exynos_camera->preview_window_next_stride = stride;
+	exynos_camera->preview_window_next_data = data;
+}
+
+void exynos_camera_preview_window_flush(struct exynos_camera *exynos_camera)
+{
+	struct preview_stream_ops *window;
+	buffer_handle_t *buffer;
+
+	if (exynos_camera == NULL)
+		return;
+
+	window = exynos_camera->preview_window_next_window;
+	buffer = exynos_camera->preview_window_next_buffer;
+
+	if (buffer != NULL) {
+		if (exynos_camera->preview_window_next_data != NULL)
+			exynos_camera_preview_window_unlock(exynos_camera, buffer);
+
+		if (window != NULL && window->cancel_buffer != NULL)
+			window->cancel_buffer(window, buffer);
+	}
+
+	exynos_camera->preview_window_next_window = NULL;
+	exynos_camera->preview_window_next_buffer = NULL;
+	exynos_camera->preview_window_next_data = NULL;
+}
+
+/*
+ * Preview frame callbacks are given buffers from a dedicated pool, that FIMC
+ * writes to directly when they have a physical address. A buffer is held from
+ * the callback until it is released: when the callback returns, since the
+ * framework copies the frame there, or with EXYNOS_CAMERA_CMD_PREVIEW_FRAME_RELEASE
+ * when camera.preview.callback_hold is set. Callbacks are skipped rather than
+ * overwriting a held buffer when the pool is exhausted.
+ */
+
+int exynos_camera_preview_callback_start(struct exynos_camera *exynos_camera)
+{
+	char property[PROPERTY_VALUE_MAX];
+	camera_memory_t *memory = NULL;
+	int memory_address = 0;
+#ifdef EXYNOS_ION
+	int memory_ion_fd = -1;
+#endif
+	int buffer_length;
+	int buffers_count;
+	int rc;
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	ALOGD("%s()", __func__);
+
+	if (exynos_camera->preview_callback_enabled) {
+		ALOGE("Preview callback was already started!");
+		return -1;
+	}
+
+	if (!EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
+		ALOGE("%s: No memory request function!", __func__);
+		goto error;
+	}
+
+	buffer_length = exynos_camera_buffer_length(exynos_camera->preview_width, exynos_camera->preview_height, exynos_camera->preview_format);
+	buffers_count = EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT;
+
+#ifdef EXYNOS_ION
+	memory_ion_fd = exynos_ion_alloc(exynos_camera, buffers_count * buffer_length);
+	if (memory_ion_fd >= 0) {
+		memory = exynos_camera->callbacks.request_memory(memory_ion_fd, buffer_length, buffers_count, exynos_camera->callbacks.user);
+
+		memory_address = exynos_ion_phys(exynos_camera, memory_ion_fd);
+		if (memory_address == -1 || memory_address == (int) 0xffffffff)
+			memory_address = 0;
+	}
+#endif
+
+	// Without ION, frames are copied to the pool after the output
+	if (memory == NULL)
+		memory = exynos_camera->callbacks.request_memory(-1, buffer_length, buffers_count, exynos_camera->callbacks.user);
+
+	if (memory == NULL || memory->data == NULL || memory->data == MAP_FAILED) {
+		ALOGE("%s: Unable to request memory", __func__);
+		goto error;
+	}
+
+	property_get("camera.preview.callback_hold", property, "0");
+	exynos_camera->preview_callback_hold = atoi(property) > 0;
+
+	pthread_mutex_lock(&exynos_camera->preview_callback_mutex);
+
+	exynos_camera->preview_callback_memory = memory;
+	exynos_camera->preview_callback_memory_address = memory_address;
+#ifdef EXYNOS_ION
+	exynos_camera->preview_callback_memory_ion_fd = memory_ion_fd;
+#endif
+	exynos_camera->preview_callback_buffer_length = buffer_length;
+	memset(&exynos_camera->preview_callback_held, 0, sizeof(exynos_camera->preview_callback_held));
+	exynos_camera->preview_callback_held_count = 0;
+	exynos_camera->preview_callback_enabled = 1;
+
+	pthread_mutex_unlock(&exynos_camera->preview_callback_mutex);
+
+	rc = 0;
+	goto complete;
+
+error:
+	if (memory != NULL && memory->release != NULL)
+		memory->release(memory);
+
+#ifdef EXYNOS_ION
+	if (memory_ion_fd >= 0)
+		exynos_ion_free(exynos_camera, memory_ion_fd);
+#endif
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+void exynos_camera_preview_callback_stop(struct exynos_camera *exynos_camera)
+{
+	if (exynos_camera == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!exynos_camera->preview_callback_enabled) {
+		ALOGE("Preview callback was already stopped!");
+		return;
+	}
+
+	pthread_mutex_lock(&exynos_camera->preview_callback_mutex);
+
+	if (exynos_camera->preview_callback_held_count > 0)
+		ALOGD("%s: %d buffers still held", __func__, exynos_camera->preview_callback_held_count);
+
+	if (exynos_camera->preview_callback_memory != NULL && exynos_camera->preview_callback_memory->release != NULL)
+		exynos_camera->preview_callback_memory->release(exynos_camera->preview_callback_memory);
+
+	exynos_camera->preview_callback_memory = NULL;
+
+#ifdef EXYNOS_ION
+	if (exynos_camera->preview_callback_memory_ion_fd >= 0)
+		exynos_ion_free(exynos_camera, exynos_camera->preview_callback_memory_ion_fd);
+
+	exynos_camera->preview_callback_memory_ion_fd = -1;
+#endif
+
+	exynos_camera->preview_callback_memory_address = 0;
+	exynos_camera->preview_callback_held_count = 0;
+	exynos_camera->preview_callback_enabled = 0;
+
+	pthread_mutex_unlock(&exynos_camera->preview_callback_mutex);
+}
+
+int exynos_camera_preview_callback_acquire(struct exynos_camera *exynos_camera)
+{
+	int index = -1;
+	int i;
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&exynos_camera->preview_callback_mutex);
+
+	if (!exynos_camera->preview_callback_enabled)
+		goto complete;
+
+	for (i = 0; i < EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT; i++) {
+		if (!exynos_camera->preview_callback_held[i]) {
+			exynos_camera->preview_callback_held[i] = 1;
+			exynos_camera->preview_callback_held_count++;
+			index = i;
+			break;
+		}
+	}
+
+	if (index < 0)
+		exynos_camera->preview_callback_exhausted++;
+
+complete:
+	pthread_mutex_unlock(&exynos_camera->preview_callback_mutex);
+
+	return index;
+}
+
+void exynos_camera_preview_callback_release(struct exynos_camera *exynos_camera,
+	int index)
+{
+	if (exynos_camera == NULL || index < 0 || index >= EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT)
+		return;
+
+	pthread_mutex_lock(&exynos_camera->preview_callback_mutex);
+
+	if (exynos_camera->preview_callback_held[index]) {
+		exynos_camera->preview_callback_held[index] = 0;
+		exynos_camera->preview_callback_held_count--;
+	}
+
+	pthread_mutex_unlock(&exynos_camera->preview_callback_mutex);
+}
+
+int exynos_camera_preview(struct exynos_camera *exynos_camera, int display,
+	int callback)
+{
+	struct exynos_v4l2_output *shared_output;
+	struct exynos_v4l2_output *output;
+	int width, height, format;
+	buffer_handle_t *window_buffer = NULL;
+	void *window_data = NULL;
+	int window_stride;
+	int window_address = 0;
+	int window_held = 0;
+	void *callback_pointer = NULL;
+	int callback_address = 0;
+	int callback_index = -1;
+	int callback_length;
+	camera_memory_t *memory;
+	camera_face_t caface[exynos_camera->max_detected_faces];
+	void *memory_pointer;
+	int memory_index;
+	int memory_size;
+	int memory_format;
+	unsigned int trace_id;
+	int rc;
+
+	if (exynos_camera == NULL)
+		goto error;
+
+//     ALOGD("%s()", __func__);
+
+	width = exynos_camera->preview_width;
+	height = exynos_camera->preview_height;
+	format = exynos_camera->preview_format;
+
+	output = &exynos_camera->preview_output;
+
+	trace_id = exynos_camera->preview_frame != NULL ? exynos_camera->preview_frame->trace_id : 0;
+
+	if (callback) {
+		if (!exynos_camera->preview_callback_enabled) {
+			rc = exynos_camera_preview_callback_start(exynos_camera);
+			if (rc < 0)
+				ALOGE("%s: Unable to start preview callback", __func__);
+		}
+
+		callback_index = exynos_camera_preview_callback_acquire(exynos_camera);
+		if (callback_index < 0)
+			callback = 0;
+	}
+
+	if (!display && !callback) {
+		rc = 0;
+		goto complete;
+	}
+
+	if (callback) {
+		callback_length = exynos_camera->preview_callback_buffer_length;
+		callback_pointer = (void *) ((unsigned char *) exynos_camera->preview_callback_memory->data + callback_length * callback_index);
+
+		if (exynos_camera->preview_callback_memory_address != 0 && exynos_camera->preview_output_enabled && !output->software)
+			callback_address = exynos_camera->preview_callback_memory_address + callback_length * callback_index;
+	}
+
+	// The window can't be changed while it's in use
+	if (display) {
+		pthread_mutex_lock(&exynos_camera->preview_window_mutex);
+		window_held = 1;
+	}
+
+	// Preview frame callbacks need the result in the output memory
+	if (display && !callback && exynos_camera->preview_shared_index < 0 && exynos_camera->preview_window_zero_copy && exynos_camera->preview_output_enabled && !output->software && exynos_camera->preview_window != NULL && exynos_camera->gralloc != NULL) {
+		rc = exynos_camera_preview_window_dequeue(exynos_camera, &window_buffer, &window_stride, &window_data);
+		if (rc < 0) {
+			ALOGE("%s: Error in dequeueing buffer", __func__);
+			goto error;
+		}
+
+		if (exynos_blit_preview_direct(format, width, window_stride))
+			window_address = exynos_camera_preview_window_address(exynos_camera, *window_buffer);
+
+		if (window_address != 0 && window_data != NULL) {
+			exynos_camera_preview_window_unlock(exynos_camera, window_buffer);
+			window_data = NULL;
+		}
+	}
+
+	if (exynos_camera->preview_shared_index >= 0) {
+		// The recording output was converted for both
+		shared_output = &exynos_camera->recording_output;
+
+		memory = shared_output->memory;
+		memory_index = exynos_camera->preview_shared_index;
+		memory_pointer = (void *) ((unsigned char *) memory->data + shared_output->buffer_length * memory_index);
+		memory_size = shared_output->buffer_length;
+		memory_format = shared_output->format;
+	} else if (exynos_camera->preview_output_enabled) {
+		rc = exynos_v4l2_output_dst(exynos_camera, output, &exynos_camera->preview_buffer, window_address != 0 ? window_address : callback_address);
+		if (rc < 0) {
+			ALOGE("%s: Unable to output preview", __func__);
+			goto error;
+		}
+
+		exynos_trace_point(&exynos_camera->trace, trace_id, EXYNOS_TRACE_OUTPUT);
+
+		memory = output->memory;
+		memory_index = output->memory_index;
+		memory_pointer = (void *) ((unsigned char *) memory->data + output->buffer_length * memory_index);
+		memory_size = output->buffer_length;
+		memory_format = format;
+	} else {
+		// In that case, we can directly use the capture memory
+		memory = exynos_camera->capture_memory;
+		memory_index = exynos_camera->capture_memory_index;
+		memory_pointer = exynos_camera->preview_buffer.pointer;
+		memory_size = exynos_camera->preview_buffer.length;
+		memory_format = exynos_camera->preview_buffer.format;
+	}
+
+	if (callback) {
+		if (callback_address == 0)
+			memcpy(callback_pointer, memory_pointer, memory_size < callback_length ? memory_size : callback_length);
+
+		memory_pointer = callback_pointer;
+	}
+
+	if (display && exynos_camera->preview_window != NULL && exynos_camera->gralloc != NULL) {
+		if (window_buffer == NULL) {
+			rc = exynos_camera_preview_window_dequeue(exynos_camera, &window_buffer, &window_stride, &window_data);
+			if (rc < 0) {
+				ALOGE("%s: Error in dequeueing buffer", __func__);
+				goto error;
+			}
+		}
+
+		// Without an address, the frame is copied to the window buffer
+		if (window_address == 0) {
+			if (window_data == NULL) {
+				rc = exynos_camera_preview_window_lock(exynos_camera, window_buffer, &window_data);
+				if (rc < 0) {
+					ALOGE("%s: Unable to lock gralloc", __func__);
+					goto error;
+				}
+			}
+
+			if (exynos_camera->preview_shared_index >= 0)
+				rc = exynos_blit_preview_format(window_data, window_stride, format, memory_pointer, width, height, memory_format);
+			else
+				rc = exynos_blit_preview(window_data, window_stride, memory_pointer, width, height, memory_format);
+
+			if (rc < 0)
+				memcpy(window_data, memory_pointer, memory_size);
+
+			exynos_camera_preview_window_unlock(exynos_camera, window_buffer);
+			window_data = NULL;
+		}
+
+		exynos_camera->preview_window->enqueue_buffer(exynos_camera->preview_window, window_buffer);
+		window_buffer = NULL;
+
+		exynos_trace_point(&exynos_camera->trace, trace_id, EXYNOS_TRACE_GRALLOC);
+
+		exynos_camera_preview_window_prefetch(exynos_camera);
+	}
+
+	if (window_held) {
+		pthread_mutex_unlock(&exynos_camera->preview_window_mutex);
+		window_held = 0;
+	}
+
+	if (display && exynos_camera->camera_fimc_is) {
+		exynos_camera->mFaceData.faces = caface;
+		exynos_v4l2_s_ext_ctrl_face_detection(exynos_camera, 0, &exynos_camera->mFaceData);
+	}
+
+	if (callback && EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_FRAME) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock) {
+		exynos_camera->callbacks.data(CAMERA_MSG_PREVIEW_FRAME, exynos_camera->preview_callback_memory, callback_index, NULL, exynos_camera->callbacks.user);
+		exynos_camera->preview_callback_sent++;
+
+		// Held buffers are released by the client
+		if (exynos_camera->preview_callback_hold)
+			callback_index = -1;
+
+		exynos_trace_point(&exynos_camera->trace, trace_id, EXYNOS_TRACE_PREVIEW_CALLBACK);
+	}
+
+	if (callback_index >= 0) {
+		exynos_camera_preview_callback_release(exynos_camera, callback_index);
+		callback_index = -1;
+	}
+
+	if (display && EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_METADATA) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock) {
+		exynos_camera->callbacks.data(CAMERA_MSG_PREVIEW_METADATA, exynos_camera->face_data, 0, &exynos_camera->mFaceData, exynos_camera->callbacks.user);
+	}
+
+	if (exynos_camera->preview_output_enabled && exynos_camera->preview_shared_index < 0) {
+		rc = exynos_v4l2_output_release(exynos_camera, output);
+		if (rc < 0) {
+			ALOGE("%s: Unable to release preview output", __func__);
+			goto error;
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	// A dequeued buffer that wasn't enqueued goes back to the window
+	if (window_buffer != NULL) {
+		if (window_data != NULL)
+			exynos_camera_preview_window_unlock(exynos_camera, window_buffer);
+
+		if (exynos_camera->preview_window != NULL && exynos_camera->preview_window->cancel_buffer != NULL)
+			exynos_camera->preview_window->cancel_buffer(exynos_camera->preview_window, window_buffer);
+	}
+
+	if (window_held)
+		pthread_mutex_unlock(&exynos_camera->preview_window_mutex);
+
+	if (callback_index >= 0)
+		exynos_camera_preview_callback_release(exynos_camera, callback_index);
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+int exynos_camera_preview_stage(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame)
+{
+	int display;
+	int callback;
+	int shared;
+	int rc;
+
+	if (exynos_camera == NULL || frame == NULL)
+		return -EINVAL;
+
+	if (!exynos_camera->preview_enabled) {
+		if (frame->shared)
+			exynos_camera_output_shared_decline(exynos_camera, frame);
+
+		return 0;
+	}
+
+	// Face metadata follows the display rate
+	display = (exynos_camera->preview_window != NULL || EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_METADATA)) && exynos_camera_pacer_due(&exynos_camera->preview_display_pacer, frame->timestamp);
+	callback = EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_PREVIEW_FRAME) && exynos_camera_pacer_due(&exynos_camera->preview_callback_pacer, frame->timestamp);
+
+	// Preview callbacks are in the preview format, that takes a conversion
+	shared = frame->shared && display && !callback && exynos_camera->preview_window != NULL;
+	if (frame->shared && !shared)
+		exynos_camera_output_shared_decline(exynos_camera, frame);
+
+	if (!display && !callback)
+		return 0;
+
+	// Faces decoded with the frame, the capture may already be on the next one
+	if (!exynos_camera->camera_fimc_is) {
+		memcpy(exynos_camera->faces, frame->faces, frame->faces_count * sizeof(camera_face_t));
+		exynos_camera->mFaceData.faces = exynos_camera->faces;
+		exynos_camera->mFaceData.number_of_faces = frame->faces_count;
+	}
+
+	memcpy(&exynos_camera->preview_buffer, &frame->yuv, sizeof(struct exynos_camera_buffer));
+	exynos_camera->preview_frame = frame;
+	exynos_camera->preview_shared_index = -1;
+
+	// Without the recording buffer, the frame is converted for the preview
+	if (shared)
+		exynos_camera->preview_shared_index = exynos_camera_output_shared_take(exynos_camera, frame);
+
+	if (exynos_camera->preview_shared_index < 0 && !exynos_camera->preview_output_enabled) {
+		rc = exynos_camera_preview_output_start(exynos_camera);
+		if (rc < 0) {
+			ALOGE("%s: Unable to start Preview Output", __func__);
+			goto error;
+		}
+	}
+
+	rc = exynos_camera_preview(exynos_camera, display, callback);
+	if (rc < 0) {
+		ALOGE("%s: Unable to process Camera Preview", __func__);
+		goto error;
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (exynos_camera->preview_shared_index >= 0) {
+		exynos_camera_output_shared_release(exynos_camera, exynos_camera->preview_shared_index);
+		exynos_camera->preview_shared_index = -1;
+	}
+
+	return rc;
+}
+
+int exynos_camera_preview_start(struct exynos_camera *exynos_camera)
+{
+	char property[PROPERTY_VALUE_MAX];
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	ALOGD("%s()", __func__);
+
+	if (exynos_camera->preview_enabled) {
+		ALOGE("Preview was already started!");
+		return -1;
+	}
+
+	// Target rates for the window and for preview frame callbacks, 0 to keep them all
+	property_get("camera.preview.display_fps", property, "0");
+	exynos_camera_pacer_setup(&exynos_camera->preview_display_pacer, atoi(property));
+
+	property_get("camera.preview.callback_fps", property, "0");
+	exynos_camera_pacer_setup(&exynos_camera->preview_callback_pacer, atoi(property));
+
+	exynos_camera->preview_callback_sent = 0;
+	exynos_camera->preview_callback_exhausted = 0;
+	exynos_camera->preview_shared_index = -1;
+
+	exynos_camera_capture_command(exynos_camera, EXYNOS_CAMERA_COMMAND_CAPTURE_SETUP, 0);
+
+	exynos_camera->preview_enabled = 1;
+
+	return 0;
+}
+
+void exynos_camera_preview_stop(struct exynos_camera *exynos_camera)
+{
+	int i;
+
+	if (exynos_camera == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!exynos_camera->preview_enabled) {
+		ALOGE("Preview was already stopped!");
+		return;
+	}
+
+	exynos_camera->preview_enabled = 0;
+
+	exynos_camera_capture_command(exynos_camera, EXYNOS_CAMERA_COMMAND_CAPTURE_STOP, 0);
+
+	if (exynos_camera->preview_output_enabled)
+		exynos_camera_preview_output_stop(exynos_camera);
+
+	if (exynos_camera->preview_callback_enabled)
+		exynos_camera_preview_callback_stop(exynos_camera);
+
+	pthread_mutex_lock(&exynos_camera->preview_window_mutex);
+
+	exynos_camera_preview_window_flush(exynos_camera);
+
+	exynos_camera->preview_window = NULL;
+
+	pthread_mutex_unlock(&exynos_camera->preview_window_mutex);
+}
+
+// Picture
+
+/*
+ * Pictures are handed out with the EXIF right after the JPEG start marker.
+ * The S5C73M3 JPEG is gathered by the capture thread straight to its final
+ * place, after room for the largest APP1 segment: the EXIF is written in front
+ * of it later on and its segment is padded up to that room.
+ */
+
+void *exynos_camera_picture_jpeg_alloc(struct exynos_camera *exynos_camera,
+	int length)
+{
+	camera_memory_t *memory;
+
+	if (exynos_camera == NULL || length <= 2)
+		return NULL;
+
+	// A picture that was not started does not need its memory anymore
+	if (exynos_camera->picture_jpeg_memory != NULL) {
+		if (exynos_camera->picture_jpeg_memory->release != NULL)
+			exynos_camera->picture_jpeg_memory->release(exynos_camera->picture_jpeg_memory);
+
+		exynos_camera->picture_jpeg_memory = NULL;
+	}
+
+	if (!EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
+		ALOGE("%s: No memory request function!", __func__);
+		return NULL;
+	}
+
+	memory = exynos_camera->callbacks.request_memory(-1, EXYNOS_CAMERA_PICTURE_EXIF_LENGTH + length, 1, exynos_camera->callbacks.user);
+	if (memory == NULL || memory->data == NULL || memory->data == MAP_FAILED) {
+		ALOGE("%s: Unable to request memory", __func__);
+		return NULL;
+	}
+
+	exynos_camera->picture_jpeg_memory = memory;
+
+	return (void *) ((unsigned char *) memory->data + EXYNOS_CAMERA_PICTURE_EXIF_LENGTH);
+}
+
+void *exynos_camera_picture(void *data)
+{
+	struct exynos_camera *exynos_camera;
+	struct exynos_camera_buffer *jpeg_buffer;
+	struct exynos_camera_buffer *yuv_buffer;
+	struct exynos_v4l2_output output;
+	struct exynos_jpeg *jpeg = NULL;
+	struct exynos_jpeg *jpeg_thumbnail = NULL;
+	int output_enabled = 0;
+	int width, height, format;
+	int buffer_width, buffer_height, buffer_format;
+	camera_memory_t *memory = NULL;
+	int memory_size;
+	unsigned char *p;
+	void *jpeg_data = NULL;
+	int jpeg_size = 0;
+	camera_memory_t *jpeg_thumbnail_memory = NULL;
+	void *jpeg_thumbnail_data = NULL;
+	int jpeg_thumbnail_size = 0;
+	void *yuv_data = NULL;
+	int yuv_address = 0;
+	int yuv_size = 0;
+	void *yuv_thumbnail_data = NULL;
+	int yuv_thumbnail_address;
+	int yuv_thumbnail_size = 0;
+	int exif_size;
+	int rc;
+
+	exynos_camera = (struct exynos_camera *) data;
+
+	if (exynos_camera == NULL)
+		goto error;
+
+	ALOGD("%s()", __func__);
+
+	jpeg_buffer = &exynos_camera->picture_jpeg_buffer;
+	yuv_buffer = &exynos_camera->picture_yuv_buffer;
+
+	if (jpeg_buffer->pointer != NULL && jpeg_buffer->length > 0) {
+		jpeg_data = jpeg_buffer->pointer;
+		jpeg_size = jpeg_buffer->length;
+
+		// The JPEG was gathered to the picture memory
+		memory = exynos_camera->picture_jpeg_memory;
+		exynos_camera->picture_jpeg_memory = NULL;
+
+		memset(jpeg_buffer, 0, sizeof(struct exynos_camera_buffer));
+
+		if (memory == NULL) {
+			ALOGE("%s: Missing picture memory", __func__);
+			goto error;
+		}
+	}
+
+	if (yuv_buffer->pointer != NULL && yuv_buffer->length > 0) {
+		yuv_data = yuv_buffer->pointer;
+		yuv_address = yuv_buffer->address;
+		yuv_size = yuv_buffer->length;
+	}
+
+	// JPEG
+
+	if (jpeg_data == NULL) {
+		if (yuv_data == NULL || yuv_size <= 0) {
+			ALOGE("%s: Unable to create jpeg without an YUV buffer", __func__);
+			goto error;
 		}
 
 		width = exynos_camera->picture_width;
@@ -2527,7 +3678,6 @@ void *exynos_camera_picture(void *data)
 		buffer_width = yuv_buffer->width;
 		buffer_height = yuv_buffer->height;
 		buffer_format = yuv_buffer->format;
-		buffer_address = yuv_buffer->address;
 
 		if ((width != buffer_width && height != buffer_height) || exynos_camera->camera_fimc_is) {
 			format = EXYNOS_CAMERA_PICTURE_OUTPUT_FORMAT;
@@ -2541,6 +3691,7 @@ void *exynos_camera_picture(void *data)
 			output.buffer_height = buffer_height;
 			output.buffer_format = buffer_format;
 			output.buffers_count = 1;
+			output.software_fallback = 1;
 
 			rc = exynos_v4l2_output_start(exynos_camera, &output);
 			if (rc < 0) {
@@ -2548,7 +3699,7 @@ void *exynos_camera_picture(void *data)
 				goto error;
 			}
 
-			rc = exynos_v4l2_output(exynos_camera, &output, buffer_address);
+			rc = exynos_v4l2_output(exynos_camera, &output, yuv_buffer);
 			if (rc < 0) {
 				ALOGE("%s: Unable to output picture", __func__);
 				goto error;
@@ -2564,53 +3715,33 @@ void *exynos_camera_picture(void *data)
 				exynos_exif_create(exynos_camera, &exynos_camera->exif);
 		}
 
-		memset(&jpeg, 0, sizeof(jpeg));
-		jpeg.width = width;
-		jpeg.height = height;
-		jpeg.format = format;
-		jpeg.quality = exynos_camera->jpeg_quality;
-
-		rc = exynos_jpeg_start(exynos_camera, &jpeg);
-		if (rc < 0) {
-			ALOGE("%s: Unable to start jpeg", __func__);
+		jpeg = exynos_jpeg_pool_get(exynos_camera, &exynos_camera->picture_jpeg_pool, width, height, format, exynos_camera->jpeg_quality);
+		if (jpeg == NULL) {
+			ALOGE("%s: Unable to get jpeg", __func__);
 			goto error;
 		}
 
-		if (jpeg.memory_in_pointer == NULL) {
+		if (jpeg->memory_in_pointer == NULL) {
 			ALOGE("%s: Invalid memory input pointer", __func__);
 			goto error;
 		}
 
-		memcpy(jpeg.memory_in_pointer, yuv_data, yuv_size);
+		memcpy(jpeg->memory_in_pointer, yuv_data, yuv_size);
 
-		rc = exynos_jpeg(exynos_camera, &jpeg);
+		rc = exynos_jpeg(exynos_camera, jpeg);
 		if (rc < 0) {
 			ALOGE("%s: Unable to jpeg", __func__);
 			goto error;
 		}
 
-		jpeg_size = jpeg.memory_out_size;
+		jpeg_size = jpeg->memory_out_size;
 		if (jpeg_size <= 0) {
 			ALOGE("%s: Invalid jpeg size", __func__);
 			goto error;
 		}
 
-		if (EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
-			jpeg_memory = exynos_camera->callbacks.request_memory(-1, jpeg_size, 1, exynos_camera->callbacks.user);
-			if (jpeg_memory == NULL || jpeg_memory->data == NULL || jpeg_memory->data == MAP_FAILED) {
-				ALOGE("%s: Unable to request memory", __func__);
-				goto error;
-			}
-		} else {
-			ALOGE("%s: No memory request function!", __func__);
-			goto error;
-		}
-
-		jpeg_data = jpeg_memory->data;
-
-		memcpy(jpeg_data, jpeg.memory_out_pointer, jpeg_size);
-
-		exynos_jpeg_stop(exynos_camera, &jpeg);
+		// The encoder output is kept until it is copied to the picture memory
+		jpeg_data = jpeg->memory_out_pointer;
 
 		if (output_enabled) {
 			exynos_v4l2_output_stop(exynos_camera, &output);
@@ -2632,7 +3763,6 @@ void *exynos_camera_picture(void *data)
 	buffer_width = yuv_buffer->width;
 	buffer_height = yuv_buffer->height;
 	buffer_format = yuv_buffer->format;
-	buffer_address = yuv_buffer->address;
 
 	if (width != buffer_width && height != buffer_height) {
 		format = EXYNOS_CAMERA_PICTURE_OUTPUT_FORMAT;
@@ -2646,6 +3776,7 @@ void *exynos_camera_picture(void *data)
 		output.buffer_height = buffer_height;
 		output.buffer_format = buffer_format;
 		output.buffers_count = 1;
+		output.software_fallback = 1;
 
 		rc = exynos_v4l2_output_start(exynos_camera, &output);
 		if (rc < 0) {
@@ -2655,7 +3786,7 @@ void *exynos_camera_picture(void *data)
 
 		output_enabled = 1;
 
-		rc = exynos_v4l2_output(exynos_camera, &output, buffer_address);
+		rc = exynos_v4l2_output(exynos_camera, &output, yuv_buffer);
 		if (rc < 0) {
 			ALOGE("%s: Unable to output thumbnail picture", __func__);
 			goto error;
@@ -2666,32 +3797,26 @@ void *exynos_camera_picture(void *data)
 		yuv_thumbnail_size = output.buffer_length;
 	}
 
-	memset(&jpeg, 0, sizeof(jpeg));
-	jpeg.width = width;
-	jpeg.height = height;
-	jpeg.format = format;
-	jpeg.quality = exynos_camera->jpeg_thumbnail_quality;
-
-	rc = exynos_jpeg_start(exynos_camera, &jpeg);
-	if (rc < 0) {
-		ALOGE("%s: Unable to start jpeg", __func__);
+	jpeg_thumbnail = exynos_jpeg_pool_get(exynos_camera, &exynos_camera->picture_jpeg_pool, width, height, format, exynos_camera->jpeg_thumbnail_quality);
+	if (jpeg_thumbnail == NULL) {
+		ALOGE("%s: Unable to get jpeg", __func__);
 		goto error;
 	}
 
-	if (jpeg.memory_in_pointer == NULL) {
+	if (jpeg_thumbnail->memory_in_pointer == NULL) {
 		ALOGE("%s: Invalid memory input pointer", __func__);
 		goto error;
 	}
 
-	memcpy(jpeg.memory_in_pointer, yuv_thumbnail_data, yuv_thumbnail_size);
+	memcpy(jpeg_thumbnail->memory_in_pointer, yuv_thumbnail_data, yuv_thumbnail_size);
 
-	rc = exynos_jpeg(exynos_camera, &jpeg);
+	rc = exynos_jpeg(exynos_camera, jpeg_thumbnail);
 	if (rc < 0) {
 		ALOGE("%s: Unable to jpeg", __func__);
 		goto error;
 	}
 
-	jpeg_thumbnail_size = jpeg.memory_out_size;
+	jpeg_thumbnail_size = jpeg_thumbnail->memory_out_size;
 	if (jpeg_thumbnail_size <= 0) {
 		ALOGE("%s: Invalid jpeg size", __func__);
 		goto error;
@@ -2710,9 +3835,10 @@ void *exynos_camera_picture(void *data)
 
 	jpeg_thumbnail_data = jpeg_thumbnail_memory->data;
 
-	memcpy(jpeg_thumbnail_data, jpeg.memory_out_pointer, jpeg_thumbnail_size);
+	memcpy(jpeg_thumbnail_data, jpeg_thumbnail->memory_out_pointer, jpeg_thumbnail_size);
 
-	exynos_jpeg_stop(exynos_camera, &jpeg);
+	exynos_jpeg_pool_put(exynos_camera, &exynos_camera->picture_jpeg_pool, jpeg_thumbnail);
+	jpeg_thumbnail = NULL;
 
 	if (output_enabled) {
 		exynos_v4l2_output_stop(exynos_camera, &output);
@@ -2731,37 +3857,71 @@ void *exynos_camera_picture(void *data)
 		goto error;
 	}
 
-	memory_size = exynos_camera->exif.memory_size + jpeg_size;
+	exif_size = exynos_camera->exif.memory_size;
 
-	if (EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
-		memory = exynos_camera->callbacks.request_memory(-1, memory_size, 1, exynos_camera->callbacks.user);
-		if (memory == NULL || memory->data == NULL || memory->data == MAP_FAILED) {
-			ALOGE("%s: Unable to request memory", __func__);
+	if (memory == NULL) {
+		memory_size = exif_size + jpeg_size;
+
+		if (EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
+			memory = exynos_camera->callbacks.request_memory(-1, memory_size, 1, exynos_camera->callbacks.user);
+			if (memory == NULL || memory->data == NULL || memory->data == MAP_FAILED) {
+				ALOGE("%s: Unable to request memory", __func__);
+				goto error;
+			}
+		} else {
+			ALOGE("%s: No memory request function!", __func__);
 			goto error;
 		}
+
+		p = (unsigned char *) memory->data;
+
+		// Copy the first two bytes of the JPEG picture
+		memcpy(p, jpeg_data, 2);
+		p += 2;
+
+		// Copy the EXIF data
+		memcpy(p, exynos_camera->exif.memory->data, exif_size);
+		p += exif_size;
+
+		// Copy the JPEG picture
+		memcpy(p, (void *) ((unsigned char *) jpeg_data + 2), jpeg_size - 2);
 	} else {
-		ALOGE("%s: No memory request function!", __func__);
-		goto error;
-	}
+		if (exif_size > EXYNOS_CAMERA_PICTURE_EXIF_LENGTH) {
+			ALOGE("%s: Invalid EXIF size", __func__);
+			goto error;
+		}
 
-	p = (unsigned char *) memory->data;
+		p = (unsigned char *) memory->data;
 
-	// Copy the first two bytes of the JPEG picture
-	memcpy(p, jpeg_data, 2);
-	p += 2;
+		// Copy the first two bytes of the JPEG picture, the padding covers them
+		memcpy(p, jpeg_data, 2);
+		p += 2;
 
-	// Copy the EXIF data
-	memcpy(p, exynos_camera->exif.memory->data, exynos_camera->exif.memory_size);
-	p += exynos_camera->exif.memory_size;
+		// Copy the EXIF data in front of the JPEG picture
+		memcpy(p, exynos_camera->exif.memory->data, exif_size);
+		memset(p + exif_size, 0, EXYNOS_CAMERA_PICTURE_EXIF_LENGTH - exif_size);
 
-	// Copy the JPEG picture
-	memcpy(p, (void *) ((unsigned char *) jpeg_data + 2), jpeg_size - 2);
+		// The APP1 segment spans the whole room, padding included
+		p[2] = ((EXYNOS_CAMERA_PICTURE_EXIF_LENGTH - 2) >> 8) & 0xff;
+		p[3] = (EXYNOS_CAMERA_PICTURE_EXIF_LENGTH - 2) & 0xff;
+	}
+
+	if (jpeg != NULL) {
+		exynos_jpeg_pool_put(exynos_camera, &exynos_camera->picture_jpeg_pool, jpeg);
+		jpeg = NULL;
+	}
 
 	exynos_camera->picture_memory = memory;
 
 	goto complete;
 
 error:
+	if (jpeg != NULL)
+		exynos_jpeg_pool_put(exynos_camera, &exynos_camera->picture_jpeg_pool, jpeg);
+
+	if (jpeg_thumbnail != NULL)
+		exynos_jpeg_pool_put(exynos_camera, &exynos_camera->picture_jpeg_pool, jpeg_thumbnail);
+
 	if (output_enabled)
 		exynos_v4l2_output_stop(exynos_camera, &output);
 
@@ -2774,9 +3934,6 @@ error:
 		exynos_camera->callbacks.notify(CAMERA_MSG_ERROR, -1, 0, exynos_camera->callbacks.user);
 
 complete:
-	if (jpeg_memory != NULL && jpeg_memory->release != NULL)
-		jpeg_memory->release(jpeg_memory);
-
 	if (jpeg_thumbnail_memory != NULL && jpeg_thumbnail_memory->release != NULL)
 		jpeg_thumbnail_memory->release(jpeg_thumbnail_memory);
 
@@ -2786,6 +3943,8 @@ complete:
 	exynos_camera_picture_stop(exynos_camera);
 	exynos_camera->picture_running = 0;
 
+	exynos_jpeg_pool_release(exynos_camera, &exynos_camera->picture_jpeg_pool);
+
 	return NULL;
 }
 
@@ -2837,182 +3996,534 @@ void exynos_camera_picture_stop(struct exynos_camera *exynos_camera)
 		return;
 	}
 
-	memory = exynos_camera->picture_memory;
+	memory = exynos_camera->picture_memory;
+
+	if (exynos_camera->picture_completed && memory != NULL) {
+		// It is important to return at this point (and not before) for burst
+
+		if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_SHUTTER) && EXYNOS_CAMERA_CALLBACK_DEFINED(notify) && !exynos_camera->callback_lock)
+			exynos_camera->callbacks.notify(CAMERA_MSG_SHUTTER, 0, 0, exynos_camera->callbacks.user);
+
+		if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_COMPRESSED_IMAGE) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock)
+			exynos_camera->callbacks.data(CAMERA_MSG_COMPRESSED_IMAGE, memory, 0, NULL, exynos_camera->callbacks.user);
+
+		if (memory->release != NULL) {
+			memory->release(memory);
+			exynos_camera->picture_memory = NULL;
+		}
+	}
+
+	rc = exynos_v4l2_s_ctrl(exynos_camera, 0, V4L2_CID_CAMERA_AEAWB_LOCK_UNLOCK, AE_UNLOCK_AWB_UNLOCK);
+	if (rc < 0)
+		ALOGE("%s: Unable to set AEAWB lock", __func__);
+
+	exynos_camera->picture_enabled = 0;
+}
+
+// Recording
+
+int exynos_camera_recording_output_start(struct exynos_camera *exynos_camera)
+{
+	struct exynos_v4l2_output *output;
+	char property[PROPERTY_VALUE_MAX];
+	int rc;
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	ALOGD("%s()", __func__);
+
+	if (exynos_camera->recording_output_enabled) {
+		ALOGE("Recording was already started!");
+		return -1;
+	}
+
+	output = &exynos_camera->recording_output;
+
+	memset(output, 0, sizeof(struct exynos_v4l2_output));
+	output->v4l2_id = 3;
+	output->width = exynos_camera->recording_width;
+	output->height = exynos_camera->recording_height;
+	output->format = exynos_camera->recording_format;
+	output->buffer_width = exynos_camera->recording_buffer.width;
+	output->buffer_height = exynos_camera->recording_buffer.height;
+	output->buffer_format = exynos_camera->recording_buffer.format;
+	output->buffers_count = EXYNOS_CAMERA_RECORDING_BUFFERS_COUNT;
+
+	property_get("camera.output.streaming", property, "1");
+	output->streaming = atoi(property) > 0;
+
+	rc = exynos_v4l2_output_start(exynos_camera, output);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start recording output", __func__);
+		goto error;
+	}
+
+	memset(&exynos_camera->recording_buffer_refs, 0, sizeof(exynos_camera->recording_buffer_refs));
+	exynos_camera->recording_buffer_last = -1;
+
+	exynos_camera->recording_output_enabled = 1;
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+void exynos_camera_recording_output_stop(struct exynos_camera *exynos_camera)
+{
+	struct exynos_v4l2_output *output;
+
+	if (exynos_camera == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!exynos_camera->recording_output_enabled) {
+		ALOGE("Recording was already stopped!");
+		return;
+	}
+
+	output = &exynos_camera->recording_output;
+
+	exynos_camera_recording_complete(exynos_camera);
+	exynos_camera_capture_poll_remove(exynos_camera, output->v4l2_id);
+
+	// The preview may still be showing a frame from the output memory
+	pthread_mutex_lock(&exynos_camera->output_shared_mutex);
+
+	while (exynos_camera->output_shared_held > 0)
+		pthread_cond_wait(&exynos_camera->output_shared_cond, &exynos_camera->output_shared_mutex);
+
+	exynos_camera->recording_output_enabled = 0;
+
+	pthread_mutex_unlock(&exynos_camera->output_shared_mutex);
+
+	exynos_v4l2_output_stop(exynos_camera, output);
+}
+
+/*
+ * Recording output buffers are counted references: one for the conversion
+ * until it's sent, then one for the video encoder until the frame is
+ * released, and one for the preview when it shows the frame from there.
+ * Conversions go to the next buffer that is no longer referenced and the
+ * frame is dropped if there is none. Only the recording stage takes a buffer
+ * that is not referenced, the other references are taken on top of its own.
+ */
+
+int exynos_camera_recording_buffer_acquire(struct exynos_camera *exynos_camera)
+{
+	int buffers_count;
+	int index;
+	int i;
+
+	if (exynos_camera == NULL)
+		return -EINVAL;
+
+	buffers_count = exynos_camera->recording_output.buffers_count;
+
+	for (i = 1; i <= buffers_count; i++) {
+		index = (exynos_camera->recording_buffer_last + i) % buffers_count;
+		if (exynos_camera->recording_buffer_refs[index] > 0)
+			continue;
+
+		// The buffer must not be written before it was let go
+		__sync_synchronize();
+
+		__sync_fetch_and_add(&exynos_camera->recording_buffer_refs[index], 1);
+		exynos_camera->recording_buffer_last = index;
+
+		return index;
+	}
+
+	exynos_camera->recording_buffer_exhausted++;
+
+	return -1;
+}
+
+void exynos_camera_recording_buffer_release(struct exynos_camera *exynos_camera,
+	int index)
+{
+	if (exynos_camera == NULL)
+		return;
+
+	if (index < 0 || index >= exynos_camera->recording_output.buffers_count) {
+		ALOGE("%s: Invalid buffer index: %d", __func__, index);
+		return;
+	}
+
+	if (__sync_sub_and_fetch(&exynos_camera->recording_buffer_refs[index], 1) < 0) {
+		ALOGE("%s: Buffer %d was not held", __func__, index);
+		__sync_fetch_and_add(&exynos_camera->recording_buffer_refs[index], 1);
+	}
+}
+
+void exynos_camera_recording_frame_release(struct exynos_camera *exynos_camera,
+	const void *opaque)
+{
+	camera_memory_t *memory;
+	int buffer_length;
+	int offset;
+
+	if (exynos_camera == NULL)
+		return;
+
+//	ALOGD("%s()", __func__);
+
+	if (!exynos_camera->recording_output_enabled) {
+		ALOGE("%s: Recording output should always be enabled", __func__);
+		return;
+	}
+
+	// Frames are sent from the slot matching their buffer in both modes
+	if (exynos_camera->recording_metadata) {
+		memory = exynos_camera->recording_memory;
+		buffer_length = exynos_camera->recording_buffer_length;
+	} else {
+		memory = exynos_camera->recording_output.memory;
+		buffer_length = exynos_camera->recording_output.buffer_length;
+	}
+
+	if (memory == NULL || memory->data == NULL || opaque == NULL || buffer_length <= 0)
+		return;
+
+	offset = (int) ((unsigned char *) opaque - (unsigned char *) memory->data);
+	if (offset < 0) {
+		ALOGE("%s: Invalid frame: %p", __func__, opaque);
+		return;
+	}
+
+	exynos_camera_recording_buffer_release(exynos_camera, offset / buffer_length);
+}
+
+/*
+ * Recording timestamps have to keep increasing: frames stamped earlier than
+ * the previous one are moved right after it. The inter-frame interval and
+ * its jitter are tracked as rolling averages over the recording session.
+ */
+
+void exynos_camera_recording_timing(struct exynos_camera *exynos_camera,
+	int64_t *timestamp)
+{
+	struct exynos_camera_timing *timing;
+	int64_t interval;
+	int64_t deviation;
+
+	if (exynos_camera == NULL || timestamp == NULL)
+		return;
+
+	timing = &exynos_camera->recording_timing;
+
+	if (timing->count > 0 && *timestamp <= timing->last) {
+		*timestamp = timing->last + 1000;
+		timing->reordered++;
+	}
+
+	if (timing->count > 0) {
+		interval = *timestamp - timing->last;
+
+		if (timing->count == 1) {
+			timing->interval = interval;
+			timing->interval_min = interval;
+			timing->interval_max = interval;
+		} else {
+			deviation = interval - timing->interval;
+			if (deviation < 0)
+				deviation = -deviation;
+
+			timing->interval += (interval - timing->interval) >> EXYNOS_CAMERA_TIMING_SHIFT;
+			timing->jitter += (deviation - timing->jitter) >> EXYNOS_CAMERA_TIMING_SHIFT;
+
+			if (interval < timing->interval_min)
+				timing->interval_min = interval;
+			if (interval > timing->interval_max)
+				timing->interval_max = interval;
+		}
+	}
+
+	timing->last = *timestamp;
+	timing->count++;
+}
+
+/*
+ * With recording_async, the conversion is only submitted from the recording
+ * stage: the hardware works on it while the next frames are captured and
+ * decoded, and the capture thread completes it and sends the frame as soon
+ * as the output node polls ready. The stage waits for the previous frame to
+ * be completed before submitting the next one, and completes it itself if
+ * that takes longer than EXYNOS_CAMERA_OUTPUT_TIMEOUT, e.g. with a driver
+ * that doesn't poll output nodes, in which case it stays synchronous.
+ */
+
+static void exynos_camera_recording_send(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame, int64_t timestamp, unsigned int trace_id,
+	int index)
+{
+	struct exynos_v4l2_output *output;
+	struct exynos_camera_addrs *addrs;
+	int width, height, format;
+	camera_memory_t *memory;
+	int memory_address;
+	int memory_index;
+	int buffer_length;
+
+	width = exynos_camera->recording_width;
+	height = exynos_camera->recording_height;
+	format = exynos_camera->recording_format;
+
+	output = &exynos_camera->recording_output;
+
+	buffer_length = exynos_camera->recording_buffer_length;
 
-	if (exynos_camera->picture_completed && memory != NULL) {
-		// It is important to return at this point (and not before) for burst
+	if (frame != NULL && frame->shared)
+		exynos_camera_output_shared_publish(exynos_camera, frame, index);
 
-		if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_SHUTTER) && EXYNOS_CAMERA_CALLBACK_DEFINED(notify) && !exynos_camera->callback_lock)
-			exynos_camera->callbacks.notify(CAMERA_MSG_SHUTTER, 0, 0, exynos_camera->callbacks.user);
+	if (exynos_camera->recording_metadata) {
+		memory = exynos_camera->recording_memory;
+		memory_index = index;
+		memory_address = output->memory_address + output->buffer_length * index;
 
-		if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_COMPRESSED_IMAGE) && EXYNOS_CAMERA_CALLBACK_DEFINED(data) && !exynos_camera->callback_lock)
-			exynos_camera->callbacks.data(CAMERA_MSG_COMPRESSED_IMAGE, memory, 0, NULL, exynos_camera->callbacks.user);
+		addrs = (struct exynos_camera_addrs *) ((unsigned char *) memory->data + buffer_length * memory_index);
+		memset(addrs, 0, sizeof(struct exynos_camera_addrs));
+		addrs->type = 0; // kMetadataBufferTypeCameraSource
+		addrs->index = memory_index;
 
-		if (memory->release != NULL) {
-			memory->release(memory);
-			exynos_camera->picture_memory = NULL;
-		}
+		exynos_camera_yuv_planes(width, height, format, memory_address, (int *) &addrs->y, (int *) &addrs->cbcr, NULL);
+	} else {
+		memory = output->memory;
+		memory_index = index;
 	}
 
-	rc = exynos_v4l2_s_ctrl(exynos_camera, 0, V4L2_CID_CAMERA_AEAWB_LOCK_UNLOCK, AE_UNLOCK_AWB_UNLOCK);
-	if (rc < 0)
-		ALOGE("%s: Unable to set AEAWB lock", __func__);
+	// The conversion reference goes to the encoder
+	if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_VIDEO_FRAME) && EXYNOS_CAMERA_CALLBACK_DEFINED(data_timestamp) && !exynos_camera->callback_lock) {
+		exynos_camera->callbacks.data_timestamp(timestamp, CAMERA_MSG_VIDEO_FRAME, memory, memory_index, exynos_camera->callbacks.user);
 
-	exynos_camera->picture_enabled = 0;
+		exynos_trace_point(&exynos_camera->trace, trace_id, EXYNOS_TRACE_RECORDING_CALLBACK);
+	} else {
+		exynos_camera_recording_buffer_release(exynos_camera, index);
+	}
 }
 
-// Recording
-
-int exynos_camera_recording_output_start(struct exynos_camera *exynos_camera)
+static void exynos_camera_recording_pending_complete(struct exynos_camera *exynos_camera)
 {
-	struct exynos_v4l2_output *output;
+	struct exynos_camera_frame *frame;
 	int rc;
 
-	if (exynos_camera == NULL)
-		return -EINVAL;
-
-	ALOGD("%s()", __func__);
+	if (!exynos_camera->recording_pending)
+		return;
 
-	if (exynos_camera->recording_output_enabled) {
-		ALOGE("Recording was already started!");
-		return -1;
-	}
+	frame = exynos_camera->recording_pending_frame;
 
-	output = &exynos_camera->recording_output;
+	rc = exynos_v4l2_output_complete(exynos_camera, &exynos_camera->recording_output);
+	if (rc < 0) {
+		ALOGE("%s: Unable to complete recording output", __func__);
 
-	memset(output, 0, sizeof(struct exynos_v4l2_output));
-	output->v4l2_id = 3;
-	output->width = exynos_camera->recording_width;
-	output->height = exynos_camera->recording_height;
-	output->format = exynos_camera->recording_format;
-	output->buffer_width = exynos_camera->recording_buffer.width;
-	output->buffer_height = exynos_camera->recording_buffer.height;
-	output->buffer_format = exynos_camera->recording_buffer.format;
-	output->buffers_count = EXYNOS_CAMERA_RECORDING_BUFFERS_COUNT;
+		if (frame->shared)
+			exynos_camera_output_shared_publish(exynos_camera, frame, -1);
 
-	rc = exynos_v4l2_output_start(exynos_camera, output);
-	if (rc < 0) {
-		ALOGE("%s: Unable to start recording output", __func__);
-		goto error;
+		exynos_camera_recording_buffer_release(exynos_camera, exynos_camera->recording_pending_index);
+	} else {
+		exynos_camera_recording_send(exynos_camera, frame, exynos_camera->recording_pending_timestamp, exynos_camera->recording_pending_trace_id, exynos_camera->recording_pending_index);
 	}
 
-	exynos_camera->recording_output_enabled = 1;
-
-	rc = 0;
-	goto complete;
+	exynos_camera->recording_pending_frame = NULL;
+	exynos_camera->recording_pending = 0;
 
-error:
-	rc = -1;
+	// The capture buffer was read by the hardware until now
+	exynos_camera_frame_release(exynos_camera, frame);
 
-complete:
-	return rc;
+	pthread_cond_broadcast(&exynos_camera->recording_pending_cond);
 }
 
-void exynos_camera_recording_output_stop(struct exynos_camera *exynos_camera)
+static void exynos_camera_recording_pending_wait(struct exynos_camera *exynos_camera)
 {
-	struct exynos_v4l2_output *output;
+	struct timespec time;
+	int64_t deadline;
+	int rc;
 
-	if (exynos_camera == NULL)
+	if (!exynos_camera->recording_pending)
 		return;
 
-	ALOGD("%s()", __func__);
+	clock_gettime(CLOCK_REALTIME, &time);
+	deadline = (int64_t) time.tv_sec * 1000000000LL + time.tv_nsec + EXYNOS_CAMERA_OUTPUT_TIMEOUT;
 
-	if (!exynos_camera->recording_output_enabled) {
-		ALOGE("Recording was already stopped!");
-		return;
-	}
+	time.tv_sec = (time_t) (deadline / 1000000000LL);
+	time.tv_nsec = (long) (deadline % 1000000000LL);
 
-	output = &exynos_camera->recording_output;
+	while (exynos_camera->recording_pending) {
+		rc = pthread_cond_timedwait(&exynos_camera->recording_pending_cond, &exynos_camera->recording_pending_mutex, &time);
+		if (rc == ETIMEDOUT && exynos_camera->recording_pending) {
+			ALOGE("%s: Recording output didn't poll ready, completing synchronously", __func__);
 
-	exynos_v4l2_output_stop(exynos_camera, output);
+			exynos_camera_capture_poll_remove(exynos_camera, exynos_camera->recording_output.v4l2_id);
+			exynos_camera->recording_async = 0;
+			exynos_camera->recording_timeouts++;
 
-	exynos_camera->recording_output_enabled = 0;
+			exynos_camera_recording_pending_complete(exynos_camera);
+		}
+	}
 }
 
-void exynos_camera_recording_frame_release(struct exynos_camera *exynos_camera)
+int exynos_camera_recording_complete(struct exynos_camera *exynos_camera)
 {
-	struct exynos_v4l2_output *output;
-	int rc;
+	int completed;
 
 	if (exynos_camera == NULL)
-		return;
+		return -EINVAL;
 
-//	ALOGD("%s()", __func__);
+	pthread_mutex_lock(&exynos_camera->recording_pending_mutex);
 
-	output = &exynos_camera->recording_output;
+	completed = exynos_camera->recording_pending;
+	exynos_camera_recording_pending_complete(exynos_camera);
 
-	if (!exynos_camera->recording_output_enabled) {
-		ALOGE("%s: Recording output should always be enabled", __func__);
-		return;
-	}
+	pthread_mutex_unlock(&exynos_camera->recording_pending_mutex);
 
-	rc = exynos_v4l2_output_release(exynos_camera, output);
-	if (rc < 0) {
-		ALOGE("%s: Unable to release recording output", __func__);
-		return;
-	}
+	return completed;
 }
 
 int exynos_camera_recording(struct exynos_camera *exynos_camera)
 {
 	struct exynos_v4l2_output *output;
-	struct exynos_camera_addrs *addrs;
-	int width, height, format;
-	camera_memory_t *memory;
-	int memory_address;
-	int memory_index;
-	int buffer_length;
-	int buffers_count;
+	struct exynos_camera_frame *frame;
 	nsecs_t timestamp;
+	unsigned int trace_id;
+	int index;
 	int rc;
 
 	if (exynos_camera == NULL)
-		goto error;
+		return -EINVAL;
 
 //	ALOGD("%s()", __func__);
 
-	width = exynos_camera->recording_width;
-	height = exynos_camera->recording_height;
-	format = exynos_camera->recording_format;
-
 	output = &exynos_camera->recording_output;
+	frame = exynos_camera->recording_frame;
 
-	buffer_length = exynos_camera->recording_buffer_length;
-	buffers_count = exynos_camera->recording_buffers_count;
+	if (frame != NULL) {
+		timestamp = frame->timestamp;
+		trace_id = frame->trace_id;
+	} else {
+		timestamp = systemTime(1);
+		trace_id = 0;
+	}
 
-	timestamp = systemTime(1);
+	exynos_camera_recording_timing(exynos_camera, &timestamp);
 
 	if (!exynos_camera->recording_output_enabled) {
 		ALOGE("%s: Recording output should always be enabled", __func__);
 		goto error;
 	}
 
-	rc = exynos_v4l2_output(exynos_camera, output, exynos_camera->recording_buffer.address);
+	pthread_mutex_lock(&exynos_camera->recording_pending_mutex);
+
+	exynos_camera_recording_pending_wait(exynos_camera);
+
+	index = exynos_camera_recording_buffer_acquire(exynos_camera);
+	if (index < 0) {
+		pthread_mutex_unlock(&exynos_camera->recording_pending_mutex);
+
+		// The encoder holds all the buffers, it can't keep up anyway
+		exynos_camera_capture_drop(exynos_camera, EXYNOS_CAMERA_DROP_LATE, 1);
+		exynos_camera->recording_stage.drops++;
+
+		if (frame != NULL && frame->shared)
+			exynos_camera_output_shared_publish(exynos_camera, frame, -1);
+
+		rc = 0;
+		goto complete;
+	}
+
+	output->memory_index = index;
+
+	if (exynos_camera->recording_async && frame != NULL)
+		rc = exynos_v4l2_output_submit(exynos_camera, output, &exynos_camera->recording_buffer, 0);
+	else
+		rc = exynos_v4l2_output(exynos_camera, output, &exynos_camera->recording_buffer);
+
 	if (rc < 0) {
+		exynos_camera_recording_buffer_release(exynos_camera, index);
+		pthread_mutex_unlock(&exynos_camera->recording_pending_mutex);
+
 		ALOGE("%s: Unable to output recording", __func__);
 		goto error;
 	}
 
-	if (exynos_camera->recording_metadata) {
-		memory = exynos_camera->recording_memory;
-		memory_index = exynos_camera->recording_memory_index;
-		memory_address = output->memory_address + output->buffer_length * output->memory_index;
+	if (rc > 0) {
+		__sync_fetch_and_add(&frame->refcount, 1);
 
-		addrs = (struct exynos_camera_addrs *) ((unsigned char *) memory->data + buffer_length * memory_index);
-		memset(addrs, 0, sizeof(struct exynos_camera_addrs));
-		addrs->type = 0; // kMetadataBufferTypeCameraSource
-		addrs->index = memory_index;
+		exynos_camera->recording_pending_frame = frame;
+		exynos_camera->recording_pending_timestamp = timestamp;
+		exynos_camera->recording_pending_trace_id = trace_id;
+		exynos_camera->recording_pending_index = index;
+		exynos_camera->recording_pending = 1;
 
-		exynos_camera_yuv_planes(width, height, format, memory_address, (int *) &addrs->y, (int *) &addrs->cbcr, NULL);
+		rc = exynos_camera_capture_poll_add(exynos_camera, output->v4l2_id, EPOLLOUT | EPOLLONESHOT);
+		if (rc < 0) {
+			ALOGE("%s: Unable to poll recording output, completing synchronously", __func__);
+
+			exynos_camera->recording_async = 0;
+			exynos_camera_recording_pending_complete(exynos_camera);
+		}
 	} else {
-		memory = output->memory;
-		memory_index = output->memory_index;
+		exynos_camera_recording_send(exynos_camera, frame, timestamp, trace_id, index);
 	}
 
-	if (EXYNOS_CAMERA_MSG_ENABLED(CAMERA_MSG_VIDEO_FRAME) && EXYNOS_CAMERA_CALLBACK_DEFINED(data_timestamp) && !exynos_camera->callback_lock)
-		exynos_camera->callbacks.data_timestamp(timestamp, CAMERA_MSG_VIDEO_FRAME, memory, memory_index, exynos_camera->callbacks.user);
-	else
-		exynos_camera_recording_frame_release(exynos_camera);
+	pthread_mutex_unlock(&exynos_camera->recording_pending_mutex);
+
+	rc = 0;
+	goto complete;
+
+error:
+	// The preview can't wait for a frame that won't be converted
+	if (frame != NULL && frame->shared)
+		exynos_camera_output_shared_publish(exynos_camera, frame, -1);
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+int exynos_camera_recording_stage(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame)
+{
+	int rc;
+
+	if (exynos_camera == NULL || frame == NULL)
+		return -EINVAL;
+
+	if (!exynos_camera->recording_enabled) {
+		if (frame->shared)
+			exynos_camera_output_shared_publish(exynos_camera, frame, -1);
+
+		if (exynos_camera->recording_output_enabled)
+			exynos_camera_recording_output_stop(exynos_camera);
+
+		return 0;
+	}
+
+	memcpy(&exynos_camera->recording_buffer, &frame->yuv, sizeof(struct exynos_camera_buffer));
+	exynos_camera->recording_frame = frame;
+
+	if (!exynos_camera->recording_output_enabled) {
+		rc = exynos_camera_recording_output_start(exynos_camera);
+		if (rc < 0) {
+			ALOGE("%s: Unable to start recording output", __func__);
+			goto error;
+		}
+
+		// The first frame only sets the output up
+		goto complete;
+	}
+
+	rc = exynos_camera_recording(exynos_camera);
+	if (rc < 0) {
+		ALOGE("%s: Unable to process Camera Recording", __func__);
+		goto error;
+	}
 
 	rc = 0;
 	goto complete;
@@ -3042,6 +4553,12 @@ int exynos_camera_recording_start(struct exynos_camera *exynos_camera)
 		return -1;
 	}
 
+	memset(&exynos_camera->recording_timing, 0, sizeof(exynos_camera->recording_timing));
+	exynos_camera->recording_completions = 0;
+	exynos_camera->recording_timeouts = 0;
+	exynos_camera->recording_buffer_exhausted = 0;
+	exynos_camera->output_shared_frames = 0;
+
 	exynos_camera->recording_enabled = 1;
 
 	if (exynos_camera->recording_metadata) {
@@ -3081,6 +4598,7 @@ complete:
 
 void exynos_camera_recording_stop(struct exynos_camera *exynos_camera)
 {
+	struct exynos_camera_timing *timing;
 	int i;
 
 	if (exynos_camera == NULL)
@@ -3095,6 +4613,136 @@ void exynos_camera_recording_stop(struct exynos_camera *exynos_camera)
 
 	exynos_camera->recording_enabled = 0;
 
+	timing = &exynos_camera->recording_timing;
+	if (timing->count > 1)
+		ALOGD("Recorded %u frames, interval %lld us (%lld-%lld us), jitter %lld us, %u reordered",
+			timing->count, timing->interval / 1000, timing->interval_min / 1000,
+			timing->interval_max / 1000, timing->jitter / 1000, timing->reordered);
+}
+
+// Shared output
+
+/*
+ * When the preview has the geometry of the recording, each frame is only
+ * converted once, by the recording output: the capture thread flags the
+ * frames it sends to both stages and the recording publishes its buffer on
+ * the frame, with a reference for the preview. The preview waits for it,
+ * copies it to the window and lets it go, or declines the frame so that no
+ * reference is kept, e.g. when it needs a preview callback in its own format.
+ */
+
+int exynos_camera_output_shared_available(struct exynos_camera *exynos_camera)
+{
+	struct exynos_v4l2_output *output;
+
+	if (exynos_camera == NULL)
+		return 0;
+
+	if (!exynos_camera->output_shared || !exynos_camera->preview_enabled || !exynos_camera->recording_enabled || !exynos_camera->recording_output_enabled)
+		return 0;
+
+	output = &exynos_camera->recording_output;
+
+	if (output->width != exynos_camera->preview_width || output->height != exynos_camera->preview_height)
+		return 0;
+
+	return exynos_blit_preview_compatible(exynos_camera->preview_format, output->format);
+}
+
+void exynos_camera_output_shared_publish(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame, int index)
+{
+	if (exynos_camera == NULL || frame == NULL)
+		return;
+
+	pthread_mutex_lock(&exynos_camera->output_shared_mutex);
+
+	if (frame->shared_state == EXYNOS_CAMERA_SHARED_PENDING) {
+		if (index >= 0) {
+			__sync_fetch_and_add(&exynos_camera->recording_buffer_refs[index], 1);
+
+			frame->shared_index = index;
+			frame->shared_state = EXYNOS_CAMERA_SHARED_READY;
+		} else {
+			frame->shared_state = EXYNOS_CAMERA_SHARED_DONE;
+		}
+
+		pthread_cond_broadcast(&exynos_camera->output_shared_cond);
+	}
+
+	pthread_mutex_unlock(&exynos_camera->output_shared_mutex);
+}
+
+void exynos_camera_output_shared_decline(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame)
+{
+	if (exynos_camera == NULL || frame == NULL)
+		return;
+
+	pthread_mutex_lock(&exynos_camera->output_shared_mutex);
+
+	// References are dropped along with the output when it was stopped
+	if (frame->shared_state == EXYNOS_CAMERA_SHARED_READY && exynos_camera->recording_output_enabled)
+		exynos_camera_recording_buffer_release(exynos_camera, frame->shared_index);
+
+	frame->shared_state = EXYNOS_CAMERA_SHARED_DONE;
+
+	pthread_mutex_unlock(&exynos_camera->output_shared_mutex);
+}
+
+int exynos_camera_output_shared_take(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame)
+{
+	struct timespec time;
+	int64_t deadline;
+	int index = -1;
+	int rc;
+
+	if (exynos_camera == NULL || frame == NULL)
+		return -EINVAL;
+
+	clock_gettime(CLOCK_REALTIME, &time);
+	deadline = (int64_t) time.tv_sec * 1000000000LL + time.tv_nsec + EXYNOS_CAMERA_OUTPUT_TIMEOUT;
+
+	time.tv_sec = (time_t) (deadline / 1000000000LL);
+	time.tv_nsec = (long) (deadline % 1000000000LL);
+
+	pthread_mutex_lock(&exynos_camera->output_shared_mutex);
+
+	while (frame->shared_state == EXYNOS_CAMERA_SHARED_PENDING) {
+		rc = pthread_cond_timedwait(&exynos_camera->output_shared_cond, &exynos_camera->output_shared_mutex, &time);
+		if (rc == ETIMEDOUT)
+			break;
+	}
+
+	if (frame->shared_state == EXYNOS_CAMERA_SHARED_READY && exynos_camera->recording_output_enabled) {
+		index = frame->shared_index;
+		exynos_camera->output_shared_held++;
+	}
+
+	frame->shared_state = EXYNOS_CAMERA_SHARED_DONE;
+
+	pthread_mutex_unlock(&exynos_camera->output_shared_mutex);
+
+	return index;
+}
+
+void exynos_camera_output_shared_release(struct exynos_camera *exynos_camera,
+	int index)
+{
+	if (exynos_camera == NULL || index < 0)
+		return;
+
+	pthread_mutex_lock(&exynos_camera->output_shared_mutex);
+
+	exynos_camera_recording_buffer_release(exynos_camera, index);
+
+	exynos_camera->output_shared_held--;
+	exynos_camera->output_shared_frames++;
+
+	pthread_cond_broadcast(&exynos_camera->output_shared_cond);
+
+	pthread_mutex_unlock(&exynos_camera->output_shared_mutex);
 }
 
 // Auto-focus
@@ -3239,6 +4887,9 @@ int exynos_camera_set_preview_window(struct camera_device *dev,
 	int stride;
 	void *addr = NULL;
 
+	char property[PROPERTY_VALUE_MAX];
+	int usage;
+	int count;
 	int rc;
 
 	ALOGD("%s(%p, %p)", __func__, dev, w);
@@ -3248,21 +4899,57 @@ int exynos_camera_set_preview_window(struct camera_device *dev,
 
 	exynos_camera = (struct exynos_camera *) dev->priv;
 
+	// The preview stage is done with the previous window once this is held
+	pthread_mutex_lock(&exynos_camera->preview_window_mutex);
+
+	// Window buffers addresses belong to the previous window
+	exynos_camera_preview_window_flush(exynos_camera);
+	exynos_camera->preview_window_buffers_count = 0;
+	exynos_camera->preview_window = NULL;
+
 	if (w == NULL) {
-		exynos_camera->preview_window = NULL;
-		return 0;
+		rc = 0;
+		goto complete;
 	}
 
 	if (w->set_buffer_count == NULL || w->set_usage == NULL || w->set_buffers_geometry == NULL)
 		goto error;
 
-	rc = w->set_buffer_count(w, EXYNOS_CAMERA_GRALLOC_BUFFERS_COUNT);
+#ifdef EXYNOS_ION
+	property_get("camera.preview.zerocopy", property, "0");
+	exynos_camera->preview_window_zero_copy = atoi(property) > 0;
+#else
+	exynos_camera->preview_window_zero_copy = 0;
+#endif
+
+	usage = GRALLOC_USAGE_SW_WRITE_OFTEN;
+	if (exynos_camera->preview_window_zero_copy)
+		usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
+
+	property_get("camera.preview.window_buffers", property, "");
+	count = atoi(property);
+	if (count <= 0)
+		count = EXYNOS_CAMERA_GRALLOC_BUFFERS_COUNT;
+	else if (count < 2)
+		count = 2;
+	else if (count > EXYNOS_CAMERA_WINDOW_BUFFERS_COUNT)
+		count = EXYNOS_CAMERA_WINDOW_BUFFERS_COUNT;
+
+	property_get("camera.preview.pipeline", property, "1");
+	exynos_camera->preview_window_pipelined = atoi(property) > 0;
+
+	rc = w->set_buffer_count(w, count);
 	if (rc) {
-		ALOGE("%s: Unable to set buffer count: %d", __func__, EXYNOS_CAMERA_GRALLOC_BUFFERS_COUNT);
+		ALOGE("%s: Unable to set buffer count: %d", __func__, count);
 		goto error;
 	}
 
-	rc = w->set_usage(w, GRALLOC_USAGE_SW_WRITE_OFTEN);
+	exynos_camera->preview_window_count = count;
+	memset(&exynos_camera->preview_window_dequeue_cost, 0, sizeof(struct exynos_camera_cost));
+	memset(&exynos_camera->preview_window_lock_cost, 0, sizeof(struct exynos_camera_cost));
+	memset(&exynos_camera->preview_window_unlock_cost, 0, sizeof(struct exynos_camera_cost));
+
+	rc = w->set_usage(w, usage);
 	if (rc) {
 		ALOGE("%s: Unable to set usage", __func__);
 		goto error;
@@ -3306,6 +4993,8 @@ error:
 	rc = -1;
 
 complete:
+	pthread_mutex_unlock(&exynos_camera->preview_window_mutex);
+
 	return rc;
 }
 
@@ -3487,7 +5176,7 @@ int exynos_camera_recording_enabled(struct camera_device *dev)
 }
 
 void exynos_camera_release_recording_frame(struct camera_device *dev,
-	const void __unused *opaque)
+	const void *opaque)
 {
 	struct exynos_camera *exynos_camera;
 
@@ -3498,7 +5187,7 @@ void exynos_camera_release_recording_frame(struct camera_device *dev,
 
 	exynos_camera = (struct exynos_camera *) dev->priv;
 
-	exynos_camera_recording_frame_release(exynos_camera);
+	exynos_camera_recording_frame_release(exynos_camera, opaque);
 }
 
 int exynos_camera_start_auto_focus(struct camera_device *dev)
@@ -3597,7 +5286,7 @@ int exynos_camera_set_parameters(struct camera_device *dev,
 		return -1;
 	}
 
-	rc = exynos_camera_params_apply(exynos_camera, 0);
+	rc = exynos_camera_capture_command(exynos_camera, EXYNOS_CAMERA_COMMAND_PARAMS_APPLY, 0);
 	if (rc < 0) {
 		ALOGE("%s: Unable to apply params", __func__);
 		return -1;
@@ -3689,6 +5378,9 @@ int exynos_camera_send_command(struct camera_device *dev,
 				return 0;
 			}
 			break;
+		case EXYNOS_CAMERA_CMD_PREVIEW_FRAME_RELEASE:
+			exynos_camera_preview_callback_release(exynos_camera, arg1);
+			return 0;
 		default:
 			break;
 	}
@@ -3714,8 +5406,114 @@ void exynos_camera_release(struct camera_device *dev)
 
 int exynos_camera_dump(struct camera_device *dev, int fd)
 {
+	struct exynos_camera_timing *timing;
+	struct exynos_camera_drops *drops;
+	struct exynos_v4l2_sched *sched;
+	struct exynos_camera *exynos_camera;
+	char buffer[256];
+	int64_t time;
+	int64_t held;
+	int length;
+	int i;
+
 	ALOGD("%s(%p, %d)", __func__, dev, fd);
 
+	if (dev == NULL || dev->priv == NULL)
+		return -EINVAL;
+
+	exynos_camera = (struct exynos_camera *) dev->priv;
+
+	exynos_trace_dump(&exynos_camera->trace, fd);
+
+	drops = &exynos_camera->capture_drops;
+
+	length = snprintf(buffer, sizeof(buffer), "Drops: %u no buffer, %u decode error, %u consumer late (preview %u, recording %u)\n",
+		drops->counts[EXYNOS_CAMERA_DROP_NO_BUFFER], drops->counts[EXYNOS_CAMERA_DROP_DECODE],
+		drops->counts[EXYNOS_CAMERA_DROP_LATE], exynos_camera->preview_stage.drops,
+		exynos_camera->recording_stage.drops);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Preview: display %d fps (%u shown, %u skipped), callback %d fps (%u sent, %u skipped)\n",
+		exynos_camera->preview_display_pacer.fps, exynos_camera->preview_display_pacer.passed,
+		exynos_camera->preview_display_pacer.skipped, exynos_camera->preview_callback_pacer.fps,
+		exynos_camera->preview_callback_pacer.passed, exynos_camera->preview_callback_pacer.skipped);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Preview window: %d buffers (%s), dequeue %lld us (max %lld us), lock %lld us (max %lld us), unlock %lld us (max %lld us)\n",
+		exynos_camera->preview_window_count, exynos_camera->preview_window_pipelined ? "pipelined" : "synchronous",
+		exynos_camera_cost_average(&exynos_camera->preview_window_dequeue_cost) / 1000, exynos_camera->preview_window_dequeue_cost.max / 1000,
+		exynos_camera_cost_average(&exynos_camera->preview_window_lock_cost) / 1000, exynos_camera->preview_window_lock_cost.max / 1000,
+		exynos_camera_cost_average(&exynos_camera->preview_window_unlock_cost) / 1000, exynos_camera->preview_window_unlock_cost.max / 1000);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Preview callbacks: %d of %d buffers held (%s release), %u sent, %u skipped with the pool exhausted\n",
+		exynos_camera->preview_callback_held_count, EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT,
+		exynos_camera->preview_callback_hold ? "explicit" : "on return",
+		exynos_camera->preview_callback_sent, exynos_camera->preview_callback_exhausted);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Capture queue: %d of %d buffers (%s)\n",
+		exynos_camera->capture_queue_depth, exynos_camera->capture_buffers_count,
+		exynos_camera->capture_queue_adaptive ? "adaptive" : "fixed");
+	if (length > 0)
+		write(fd, buffer, length);
+
+	sched = &exynos_camera->v4l2_sched;
+	time = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	// Busy time is given against the time each node was held by an output
+	for (i = 0; i < exynos_camera->config->v4l2_nodes_count; i++) {
+		if (!exynos_camera->config->v4l2_nodes[i].output)
+			continue;
+
+		held = sched->held[i];
+		if (sched->owners[i] != NULL)
+			held += time - sched->acquire_times[i];
+
+		length = snprintf(buffer, sizeof(buffer), "Output node %s: %s, %lld%% busy over %lld ms held, %u conversions (%lld us average)\n",
+			exynos_camera->config->v4l2_nodes[i].node, sched->owners[i] != NULL ? "in use" : "free",
+			held > 0 ? sched->busy[i] * 100 / held : 0, held / 1000000,
+			sched->jobs[i], sched->jobs[i] > 0 ? sched->busy[i] / sched->jobs[i] / 1000 : 0);
+		if (length > 0)
+			write(fd, buffer, length);
+	}
+
+	length = snprintf(buffer, sizeof(buffer), "Output nodes: %u outputs moved off their preferred node, %u found none free\n",
+		sched->moved, sched->exhausted);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	timing = &exynos_camera->recording_timing;
+
+	length = snprintf(buffer, sizeof(buffer), "Recording: %u frames, interval %lld us (%lld-%lld us), jitter %lld us, %u reordered, %u timestamp fallbacks\n",
+		timing->count, timing->interval / 1000, timing->interval_min / 1000,
+		timing->interval_max / 1000, timing->jitter / 1000, timing->reordered,
+		exynos_camera->capture_timestamp_fallbacks);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Recording output: %s, %u completed on poll, %u timed out, %u frames dropped with all buffers held\n",
+		exynos_camera->recording_async ? "asynchronous" : "synchronous",
+		exynos_camera->recording_completions, exynos_camera->recording_timeouts,
+		exynos_camera->recording_buffer_exhausted);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Shared output: %s, %u preview frames shown from the recording output\n",
+		exynos_camera->output_shared ? "enabled" : "disabled", exynos_camera->output_shared_frames);
+	if (length > 0)
+		write(fd, buffer, length);
+
+	length = snprintf(buffer, sizeof(buffer), "Jpeg encoder: %s, %u encodes on a configured context, %u configurations\n",
+		exynos_camera->picture_jpeg_pool.persistent ? "persistent" : "per shot",
+		exynos_camera->picture_jpeg_pool.reused, exynos_camera->picture_jpeg_pool.configured);
+	if (length > 0)
+		write(fd, buffer, length);
+
 	return 0;
 }
 
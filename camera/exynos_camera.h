@@ -41,12 +41,50 @@
 #define EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT	4
 
 #define EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT	6
+// A stage may hold all of its buffers, the capture needs one more to go on
+// (one more again with asynchronous recording, for its pending frame)
+#define EXYNOS_CAMERA_CAPTURE_BUFFERS_MIN	(EXYNOS_CAMERA_STAGE_HELD_MAX + 1)
 #define EXYNOS_CAMERA_PREVIEW_BUFFERS_COUNT	6
+#define EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT	4
 #define EXYNOS_CAMERA_RECORDING_BUFFERS_COUNT	6
 #define EXYNOS_CAMERA_GRALLOC_BUFFERS_COUNT	3
+#define EXYNOS_CAMERA_WINDOW_BUFFERS_COUNT	8
+#define EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT	2
+
+#define EXYNOS_CAMERA_POLL_EVENTS_COUNT		(EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT + 1)
+#define EXYNOS_CAMERA_POLL_COMMAND		-1
+
+#define EXYNOS_CAMERA_MAX_WORKERS_COUNT		3
+#define EXYNOS_CAMERA_DECODE_THREADS_COUNT	4
+#define EXYNOS_CAMERA_DECODE_THREAD_MIN_LENGTH	0x80000
+#define EXYNOS_CAMERA_CONVERT_THREADS_COUNT	2
+
+#define EXYNOS_CAMERA_RING_ENTRIES_COUNT	8
+#define EXYNOS_CAMERA_STAGE_PENDING_MAX		2
+#define EXYNOS_CAMERA_STAGE_HELD_MAX		(EXYNOS_CAMERA_STAGE_PENDING_MAX + 1)
+
+#define EXYNOS_TRACE_ENTRIES_COUNT		64
+
+#define EXYNOS_CAMERA_OUTPUT_TIMEOUT		100000000LL
+#define EXYNOS_CAMERA_TIMESTAMP_MAX_AGE		1000000000LL
+#define EXYNOS_CAMERA_TIMING_SHIFT		4
+
+#define EXYNOS_CAMERA_DROPS_LOG_INTERVAL	1000
+
+#define EXYNOS_CAMERA_QUEUE_SETTLE_FRAMES	15
+#define EXYNOS_CAMERA_QUEUE_SHRINK_FRAMES	300
 
 #define EXYNOS_CAMERA_PICTURE_OUTPUT_FORMAT	V4L2_PIX_FMT_YUYV
 
+// The EXIF APP1 segment length is 16-bit, not counting its marker
+#define EXYNOS_CAMERA_PICTURE_EXIF_LENGTH	(0xffff + 2)
+
+#define EXYNOS_CAMERA_CMD_PREVIEW_FRAME_RELEASE	0x1000
+
+#define S5C73M3_METADATA_LENGTH			0x1000
+#define S5C73M3_METADATA_FACES_COUNT		16
+#define S5C73M3_FIRMWARE_PATH			"/sys/class/camera/rear/rear_camfw"
+
 #define EXYNOS_CAMERA_MSG_ENABLED(msg) (exynos_camera->messages_enabled & msg)
 #define EXYNOS_CAMERA_CALLBACK_DEFINED(cb) (exynos_camera->callbacks.cb != NULL)
 
@@ -83,6 +121,23 @@ struct exynos_param {
 	enum exynos_param_type type;
 };
 
+enum exynos_camera_command_type {
+	EXYNOS_CAMERA_COMMAND_CAPTURE_SETUP,
+	EXYNOS_CAMERA_COMMAND_CAPTURE_STOP,
+	EXYNOS_CAMERA_COMMAND_PARAMS_APPLY,
+	EXYNOS_CAMERA_COMMAND_EXIT,
+};
+
+struct exynos_camera_command {
+	struct list_head list;
+
+	enum exynos_camera_command_type type;
+	int value;
+
+	int rc;
+	int done;
+};
+
 struct exynos_camera_buffer {
 	void *pointer;
 	int address;
@@ -93,6 +148,249 @@ struct exynos_camera_buffer {
 	int format;
 };
 
+enum exynos_camera_shared_state {
+	EXYNOS_CAMERA_SHARED_PENDING,
+	EXYNOS_CAMERA_SHARED_READY,
+	EXYNOS_CAMERA_SHARED_DONE,
+};
+
+struct exynos_camera_frame {
+	int index;
+	int64_t timestamp;
+	unsigned int sequence;
+
+	struct exynos_camera_buffer yuv;
+	struct exynos_camera_buffer jpeg;
+	int jpeg_enabled;
+
+	int refcount;
+	unsigned int trace_id;
+
+	camera_face_t faces[S5C73M3_METADATA_FACES_COUNT];
+	int faces_count;
+
+	int shared;
+	enum exynos_camera_shared_state shared_state;
+	int shared_index;
+};
+
+enum exynos_camera_drop_cause {
+	EXYNOS_CAMERA_DROP_NO_BUFFER,
+	EXYNOS_CAMERA_DROP_DECODE,
+	EXYNOS_CAMERA_DROP_LATE,
+	EXYNOS_CAMERA_DROP_CAUSES_COUNT,
+};
+
+struct exynos_camera_drops {
+	unsigned int counts[EXYNOS_CAMERA_DROP_CAUSES_COUNT];
+	unsigned int sequence;
+	int sequence_valid;
+
+	int64_t log_interval;
+	int64_t log_time;
+	unsigned int log_counts[EXYNOS_CAMERA_DROP_CAUSES_COUNT];
+};
+
+struct exynos_camera_window_buffer {
+	buffer_handle_t handle;
+	int address;
+};
+
+struct exynos_camera_timing {
+	int64_t last;
+	int64_t interval;
+	int64_t interval_min;
+	int64_t interval_max;
+	int64_t jitter;
+	unsigned int count;
+	unsigned int reordered;
+};
+
+struct exynos_camera_cost {
+	int64_t total;
+	int64_t max;
+	unsigned int count;
+};
+
+struct exynos_camera_pacer {
+	int fps;
+	int64_t interval;
+	int64_t next;
+	unsigned int passed;
+	unsigned int skipped;
+};
+
+struct exynos_camera_jpeg_segment {
+	int offset;
+	int length;
+};
+
+enum s5c73m3_metadata_type {
+	S5C73M3_METADATA_U8,
+	S5C73M3_METADATA_LE16,
+	S5C73M3_METADATA_BE32,
+};
+
+struct s5c73m3_metadata_face {
+	short rect[4];
+	short score;
+	short id;
+} __attribute__ ((packed));
+
+struct s5c73m3_metadata {
+	unsigned char decoded;
+	unsigned char auto_focus_result;
+
+	unsigned char flash;
+	unsigned short iso;
+	unsigned char brightness;
+	unsigned short exposure_bias;
+	unsigned short exposure_time;
+
+	unsigned char faces_count;
+	struct s5c73m3_metadata_face faces[S5C73M3_METADATA_FACES_COUNT];
+
+	unsigned int pointers_array_offset;
+	unsigned int pointers_array_size;
+} __attribute__ ((packed));
+
+struct s5c73m3_metadata_field {
+	int offset;
+	int type;
+	int count;
+	int metadata_offset;
+};
+
+struct s5c73m3_metadata_layout {
+	char *firmware;
+	struct s5c73m3_metadata_field *fields;
+	int fields_count;
+};
+
+struct s5c73m3_interleaved_range {
+	int start;
+	int end;
+
+	int segments_start;
+	int segments_count;
+	int jpeg_start;
+	int jpeg_length;
+	int first_offset;
+
+	int rc;
+};
+
+struct s5c73m3_interleaved_job {
+	unsigned char *data;
+	int size;
+	int interleaved_size;
+
+	unsigned int *pointers;
+	unsigned int *offsets;
+	int count;
+	int line_size;
+
+	struct exynos_camera_jpeg_segment *jpeg_segments;
+	int jpeg_segments_count;
+	unsigned char *jpeg_data;
+
+	struct s5c73m3_interleaved_range ranges[EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1];
+	int ranges_count;
+
+	int compact_start;
+	int compact_end;
+};
+
+struct exynos_worker_pool;
+
+struct exynos_worker {
+	struct exynos_worker_pool *pool;
+	pthread_t thread;
+	int index;
+};
+
+struct exynos_worker_pool {
+	struct exynos_worker workers[EXYNOS_CAMERA_MAX_WORKERS_COUNT];
+	int workers_count;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+
+	void (*job)(void *data, int index, int count);
+	void *job_data;
+	int job_sequence;
+	int job_pending;
+
+	int enabled;
+};
+
+struct exynos_convert {
+	int src_width;
+	int src_height;
+	int src_chroma_height;
+	int src_format;
+
+	int dst_width;
+	int dst_height;
+	int dst_format;
+
+	unsigned char *src_planes[3];
+	unsigned char *dst_planes[3];
+	int *positions[2];
+	int scaled;
+
+	unsigned char *src;
+	unsigned char *dst;
+
+	struct exynos_worker_pool workers;
+
+	int enabled;
+};
+
+struct exynos_ring {
+	int entries[EXYNOS_CAMERA_RING_ENTRIES_COUNT];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+};
+
+enum exynos_trace_point {
+	EXYNOS_TRACE_DQBUF,
+	EXYNOS_TRACE_DECODE,
+	EXYNOS_TRACE_OUTPUT,
+	EXYNOS_TRACE_GRALLOC,
+	EXYNOS_TRACE_PREVIEW_CALLBACK,
+	EXYNOS_TRACE_RECORDING_CALLBACK,
+	EXYNOS_TRACE_POINTS_COUNT,
+};
+
+struct exynos_trace_entry {
+	volatile unsigned int id;
+	int64_t times[EXYNOS_TRACE_POINTS_COUNT];
+};
+
+struct exynos_trace {
+	struct exynos_trace_entry entries[EXYNOS_TRACE_ENTRIES_COUNT];
+	unsigned int id;
+};
+
+struct exynos_stage {
+	struct exynos_camera *exynos_camera;
+	char *name;
+
+	int (*process)(struct exynos_camera *exynos_camera,
+		struct exynos_camera_frame *frame);
+
+	struct exynos_ring ring;
+	pthread_t thread;
+	int event_fd;
+	int exiting;
+
+	unsigned int drops;
+
+	int enabled;
+};
+
 struct exynos_camera_mbus_resolution {
 	int width;
 	int height;
@@ -211,6 +509,7 @@ struct exynos_camera_preset {
 struct exynos_v4l2_node {
 	int id;
 	char *node;
+	int output;
 };
 
 struct exynos_v4l2_output {
@@ -234,6 +533,27 @@ struct exynos_v4l2_output {
 	int memory_index;
 	int buffers_count;
 	int buffer_length;
+
+	int streaming;
+	int stream_enabled;
+	int stream_address;
+	int pending;
+
+	int software_fallback;
+	int software;
+	struct exynos_convert convert;
+
+	int64_t submit_time;
+};
+
+struct exynos_v4l2_sched {
+	struct exynos_v4l2_output *owners[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	int64_t acquire_times[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	int64_t held[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	int64_t busy[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	unsigned int jobs[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	unsigned int moved;
+	unsigned int exhausted;
 };
 
 struct exynos_exif {
@@ -272,6 +592,23 @@ struct exynos_jpeg {
 
 	int quality;
 };
+
+struct exynos_jpeg_pool {
+	struct exynos_jpeg contexts[EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT];
+	int busy[EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT];
+	unsigned int used[EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT];
+	int busy_count;
+	unsigned int sequence;
+
+	unsigned int reused;
+	unsigned int configured;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	int persistent;
+	int enabled;
+};
 #endif
 
 struct exynox_camera_config {
@@ -292,6 +629,7 @@ struct exynos_camera_callbacks {
 
 struct exynos_camera {
 	int v4l2_fds[EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT];
+	struct exynos_v4l2_sched v4l2_sched;
 	int ion_fd;
 
 	struct exynox_camera_config *config;
@@ -307,7 +645,10 @@ struct exynos_camera {
 
 	pthread_t capture_thread;
 	pthread_mutex_t capture_mutex;
-	pthread_mutex_t capture_lock_mutex;
+	pthread_cond_t capture_command_done_cond;
+	struct exynos_camera_command *capture_commands;
+	int capture_poll_fd;
+	int capture_command_fd;
 	int capture_thread_running;
 	int capture_thread_enabled;
 
@@ -316,13 +657,33 @@ struct exynos_camera {
 	camera_memory_t *capture_memory;
 	int capture_memory_address;
 	int capture_memory_index;
-	void *capture_yuv_buffer;
-	void *capture_jpeg_buffer;
+	struct exynos_camera_frame capture_frames[EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT];
+	unsigned int *capture_yuv_offsets;
+	struct exynos_camera_jpeg_segment *capture_jpeg_segments;
+	int capture_jpeg_segments_count;
+	struct exynos_worker_pool capture_workers;
+	int capture_threads_count;
+	struct s5c73m3_metadata_layout *capture_metadata_layout;
+	struct s5c73m3_metadata capture_metadata;
+	struct exynos_stage preview_stage;
+	struct exynos_stage recording_stage;
+	struct exynos_trace trace;
 	int capture_width;
 	int capture_height;
 	int capture_format;
 	int capture_buffers_count;
 	int capture_buffer_length;
+	unsigned int capture_timestamp_fallbacks;
+	struct exynos_camera_drops capture_drops;
+	pthread_mutex_t capture_queue_mutex;
+	int capture_queue_adaptive;
+	int capture_queue_depth;
+	int capture_queue_active;
+	int capture_queue_parked[EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT];
+	int capture_queue_parked_count;
+	unsigned int capture_queue_drops;
+	int capture_queue_frames;
+	int capture_queue_stable_frames;
 
 	// Preview
 	int preview_enabled;
@@ -330,8 +691,39 @@ struct exynos_camera {
 
 	int preview_output_enabled;
 	struct preview_stream_ops *preview_window;
+	int preview_window_zero_copy;
+	struct exynos_camera_window_buffer preview_window_buffers[EXYNOS_CAMERA_WINDOW_BUFFERS_COUNT];
+	int preview_window_buffers_count;
+	int preview_window_count;
+	int preview_window_pipelined;
+	pthread_mutex_t preview_window_mutex;
+	struct preview_stream_ops *preview_window_next_window;
+	buffer_handle_t *preview_window_next_buffer;
+	int preview_window_next_stride;
+	void *preview_window_next_data;
+	struct exynos_camera_cost preview_window_dequeue_cost;
+	struct exynos_camera_cost preview_window_lock_cost;
+	struct exynos_camera_cost preview_window_unlock_cost;
 	struct exynos_camera_buffer preview_buffer;
+	struct exynos_camera_frame *preview_frame;
+	int preview_shared_index;
 	struct exynos_v4l2_output preview_output;
+	struct exynos_camera_pacer preview_display_pacer;
+	struct exynos_camera_pacer preview_callback_pacer;
+
+	pthread_mutex_t preview_callback_mutex;
+	int preview_callback_enabled;
+	int preview_callback_hold;
+	camera_memory_t *preview_callback_memory;
+	int preview_callback_memory_address;
+#ifdef EXYNOS_ION
+	int preview_callback_memory_ion_fd;
+#endif
+	int preview_callback_buffer_length;
+	int preview_callback_held[EXYNOS_CAMERA_CALLBACK_BUFFERS_COUNT];
+	int preview_callback_held_count;
+	unsigned int preview_callback_sent;
+	unsigned int preview_callback_exhausted;
 
 	// Picture
 
@@ -341,11 +733,14 @@ struct exynos_camera {
 
 	int picture_completed;
 	camera_memory_t *picture_memory;
+	camera_memory_t *picture_jpeg_memory;
 	struct exynos_camera_buffer picture_jpeg_buffer;
 	struct exynos_camera_buffer picture_yuv_buffer;
+	struct exynos_jpeg_pool picture_jpeg_pool;
 
 	// Face Detection
 	camera_frame_metadata_t mFaceData;
+	camera_face_t faces[S5C73M3_METADATA_FACES_COUNT];
 	camera_memory_t *face_data;
 	int max_detected_faces;
 
@@ -356,13 +751,36 @@ struct exynos_camera {
 
 	int recording_output_enabled;
 	camera_memory_t *recording_memory;
-	int recording_memory_index;
+	int recording_buffer_refs[EXYNOS_CAMERA_RECORDING_BUFFERS_COUNT];
+	int recording_buffer_last;
+	unsigned int recording_buffer_exhausted;
 	struct exynos_camera_buffer recording_buffer;
+	struct exynos_camera_frame *recording_frame;
+	struct exynos_camera_timing recording_timing;
 	struct exynos_v4l2_output recording_output;
 	int recording_buffers_count;
 	int recording_buffer_length;
 	int recording_metadata;
 
+	int recording_async;
+	int recording_pending;
+	struct exynos_camera_frame *recording_pending_frame;
+	int64_t recording_pending_timestamp;
+	unsigned int recording_pending_trace_id;
+	int recording_pending_index;
+	unsigned int recording_completions;
+	unsigned int recording_timeouts;
+	pthread_mutex_t recording_pending_mutex;
+	pthread_cond_t recording_pending_cond;
+
+	// Shared output
+
+	int output_shared;
+	int output_shared_held;
+	unsigned int output_shared_frames;
+	pthread_mutex_t output_shared_mutex;
+	pthread_cond_t output_shared_cond;
+
 	// Auto-focus
 
 	int auto_focus_enabled;
@@ -456,6 +874,16 @@ int exynos_camera_params_init(struct exynos_camera *exynos_camera, int id);
 int exynos_camera_params_apply(struct exynos_camera *exynos_camera, int force);
 
 // Capture
+int exynos_camera_capture_command(struct exynos_camera *exynos_camera,
+	enum exynos_camera_command_type type, int value);
+int exynos_camera_capture_poll_add(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int events);
+void exynos_camera_capture_poll_remove(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id);
+void exynos_camera_frame_release(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame);
+void exynos_camera_capture_drop(struct exynos_camera *exynos_camera,
+	enum exynos_camera_drop_cause cause, unsigned int count);
 int exynos_camera_capture(struct exynos_camera *exynos_camera);
 int exynos_camera_capture_start(struct exynos_camera *exynos_camera);
 void exynos_camera_capture_stop(struct exynos_camera *exynos_camera);
@@ -464,12 +892,35 @@ int exynos_camera_capture_setup(struct exynos_camera *exynos_camera);
 // Preview
 int exynos_camera_preview_output_start(struct exynos_camera *exynos_camera);
 void exynos_camera_preview_output_stop(struct exynos_camera *exynos_camera);
-int exynos_camera_preview(struct exynos_camera *exynos_camera);
+int exynos_camera_preview_window_address(struct exynos_camera *exynos_camera,
+	buffer_handle_t handle);
+int exynos_camera_preview_window_dequeue(struct exynos_camera *exynos_camera,
+	buffer_handle_t **buffer, int *stride, void **data);
+int exynos_camera_preview_window_lock(struct exynos_camera *exynos_camera,
+	buffer_handle_t *buffer, void **data);
+void exynos_camera_preview_window_unlock(struct exynos_camera *exynos_camera,
+	buffer_handle_t *buffer);
+void exynos_camera_preview_window_prefetch(struct exynos_camera *exynos_camera);
+void exynos_camera_preview_window_flush(struct exynos_camera *exynos_camera);
+void exynos_camera_pacer_setup(struct exynos_camera_pacer *pacer, int fps);
+int exynos_camera_pacer_due(struct exynos_camera_pacer *pacer,
+	int64_t timestamp);
+int exynos_camera_preview_callback_start(struct exynos_camera *exynos_camera);
+void exynos_camera_preview_callback_stop(struct exynos_camera *exynos_camera);
+int exynos_camera_preview_callback_acquire(struct exynos_camera *exynos_camera);
+void exynos_camera_preview_callback_release(struct exynos_camera *exynos_camera,
+	int index);
+int exynos_camera_preview(struct exynos_camera *exynos_camera, int display,
+	int callback);
+int exynos_camera_preview_stage(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame);
 int exynos_camera_preview_start(struct exynos_camera *exynos_camera);
 void exynos_camera_preview_stop(struct exynos_camera *exynos_camera);
 
 // Picture
 void *exynos_camera_picture(void *data);
+void *exynos_camera_picture_jpeg_alloc(struct exynos_camera *exynos_camera,
+	int length);
 int exynos_camera_picture_start(struct exynos_camera *exynos_camera);
 void exynos_camera_picture_thread_start(struct exynos_camera *exynos_camera);
 void exynos_camera_picture_stop(struct exynos_camera *exynos_camera);
@@ -477,11 +928,31 @@ void exynos_camera_picture_stop(struct exynos_camera *exynos_camera);
 // Recording
 int exynos_camera_recording_output_start(struct exynos_camera *exynos_camera);
 void exynos_camera_recording_output_stop(struct exynos_camera *exynos_camera);
-void exynos_camera_recording_frame_release(struct exynos_camera *exynos_camera);
+int exynos_camera_recording_buffer_acquire(struct exynos_camera *exynos_camera);
+void exynos_camera_recording_buffer_release(struct exynos_camera *exynos_camera,
+	int index);
+void exynos_camera_recording_frame_release(struct exynos_camera *exynos_camera,
+	const void *opaque);
+void exynos_camera_recording_timing(struct exynos_camera *exynos_camera,
+	int64_t *timestamp);
+int exynos_camera_recording_complete(struct exynos_camera *exynos_camera);
 int exynos_camera_recording(struct exynos_camera *exynos_camera);
+int exynos_camera_recording_stage(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame);
 int exynos_camera_recording_start(struct exynos_camera *exynos_camera);
 void exynos_camera_recording_stop(struct exynos_camera *exynos_camera);
 
+// Shared output
+int exynos_camera_output_shared_available(struct exynos_camera *exynos_camera);
+void exynos_camera_output_shared_publish(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame, int index);
+void exynos_camera_output_shared_decline(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame);
+int exynos_camera_output_shared_take(struct exynos_camera *exynos_camera,
+	struct exynos_camera_frame *frame);
+void exynos_camera_output_shared_release(struct exynos_camera *exynos_camera,
+	int index);
+
 // Auto-focus
 int exynos_camera_auto_focus(struct exynos_camera *exynos_camera, int auto_focus_status);
 int exynos_camera_continuous_auto_focus(struct exynos_camera *exynos_camera, int auto_focus_status);
@@ -489,6 +960,31 @@ int exynos_camera_auto_focus_start(struct exynos_camera *exynos_camera);
 void exynos_camera_auto_focus_finish(struct exynos_camera *exynos_camera);
 void exynos_camera_auto_focus_stop(struct exynos_camera *exynos_camera);
 
+/*
+ * Blit
+ */
+
+void exynos_blit_rows(void *dst, int dst_stride, void *src, int src_stride,
+	int length, int count);
+void exynos_blit_swap_rows(void *dst, int dst_stride, void *src, int src_stride,
+	int length, int count);
+int exynos_blit_preview(void *dst, int dst_stride, void *src, int width,
+	int height, int format);
+int exynos_blit_preview_compatible(int dst_format, int src_format);
+int exynos_blit_preview_direct(int format, int width, int stride);
+int exynos_blit_preview_format(void *dst, int dst_stride, int dst_format,
+	void *src, int width, int height, int src_format);
+
+/*
+ * Convert
+ */
+
+int exynos_convert_start(struct exynos_convert *convert, int src_width,
+	int src_height, int src_format, int dst_width, int dst_height,
+	int dst_format, int threads_count);
+void exynos_convert_stop(struct exynos_convert *convert);
+int exynos_convert(struct exynos_convert *convert, void *src, void *dst);
+
 /*
  * EXIF
  */
@@ -499,6 +995,76 @@ void exynos_exif_stop(struct exynos_camera *exynos_camera,
 	struct exynos_exif *exif);
 int exynos_exif(struct exynos_camera *exynos_camera, struct exynos_exif *exif);
 
+/*
+ * Gather
+ */
+
+int exynos_gather_selftest(void);
+void exynos_gather_init(void);
+void exynos_gather_swab32(unsigned int *dst, unsigned int *src, int count);
+void exynos_gather_rows(void *dst, void *src, unsigned int *offsets, int count,
+	int line_size);
+
+/*
+ * S5C73M3
+ */
+
+struct s5c73m3_metadata_layout *s5c73m3_metadata_layout_select(void);
+int s5c73m3_metadata_parse(struct s5c73m3_metadata_layout *layout,
+	void *data, int length, struct s5c73m3_metadata *metadata);
+int s5c73m3_interleaved_jpeg_gather(void *data,
+	struct exynos_camera_jpeg_segment *jpeg_segments, int jpeg_segments_count,
+	void *jpeg_data);
+void s5c73m3_interleaved_scan(void *data, int index, int count);
+void s5c73m3_interleaved_extract(void *data, int index, int count);
+void s5c73m3_interleaved_compact(void *data, int index, int count);
+void s5c73m3_interleaved_run(struct exynos_camera *exynos_camera,
+	struct s5c73m3_interleaved_job *job,
+	void (*function)(void *data, int index, int count));
+int s5c73m3_interleaved_decode(struct exynos_camera *exynos_camera, void *data, int size,
+	int *yuv_size, int yuv_width, int yuv_height, unsigned int *yuv_offsets,
+	struct exynos_camera_jpeg_segment *jpeg_segments, int *jpeg_segments_count,
+	void *(*jpeg_alloc)(struct exynos_camera *exynos_camera, int length),
+	int *jpeg_size, int *decoded, int *auto_focus_result,
+	camera_face_t *faces, int *faces_count, struct exynos_exif *exif);
+
+/*
+ * Stage
+ */
+
+int exynos_ring_push(struct exynos_ring *ring, int value);
+int exynos_ring_pop(struct exynos_ring *ring, int *value);
+int exynos_ring_count(struct exynos_ring *ring);
+void *exynos_stage_thread(void *data);
+int exynos_stage_start(struct exynos_camera *exynos_camera,
+	struct exynos_stage *stage, char *name,
+	int (*process)(struct exynos_camera *exynos_camera,
+		struct exynos_camera_frame *frame));
+void exynos_stage_stop(struct exynos_stage *stage);
+int exynos_stage_queue(struct exynos_stage *stage, int index);
+int exynos_stage_pending(struct exynos_stage *stage);
+
+/*
+ * Trace
+ */
+
+void exynos_trace_reset(struct exynos_trace *trace);
+unsigned int exynos_trace_frame(struct exynos_trace *trace);
+void exynos_trace_point(struct exynos_trace *trace, unsigned int id,
+	enum exynos_trace_point point);
+void exynos_trace_dump(struct exynos_trace *trace, int fd);
+
+/*
+ * Worker
+ */
+
+void *exynos_worker_thread(void *data);
+int exynos_worker_pool_start(struct exynos_worker_pool *pool, int count);
+void exynos_worker_pool_stop(struct exynos_worker_pool *pool);
+int exynos_worker_pool_count(struct exynos_worker_pool *pool);
+int exynos_worker_pool_run(struct exynos_worker_pool *pool,
+	void (*job)(void *data, int index, int count), void *data);
+
 /*
  * ION
  */
@@ -523,6 +1089,19 @@ int exynos_jpeg_start(struct exynos_camera *exynos_camera,
 void exynos_jpeg_stop(struct exynos_camera *exynos_camera,
 	struct exynos_jpeg *jpeg);
 int exynos_jpeg(struct exynos_camera *exynos_camera, struct exynos_jpeg *jpeg);
+int exynos_jpeg_pool_start(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, int persistent);
+void exynos_jpeg_pool_stop(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool);
+struct exynos_jpeg *exynos_jpeg_pool_get(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, int width, int height, int format,
+	int quality);
+void exynos_jpeg_pool_put(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, struct exynos_jpeg *jpeg);
+int exynos_jpeg_pool_hold(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool);
+void exynos_jpeg_pool_release(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool);
 
 /*
  * Param
@@ -564,6 +1143,12 @@ int exynos_v4l2_fd(struct exynos_camera *exynos_camera, int exynos_v4l2_id);
 
 int exynos_v4l2_open(struct exynos_camera *exynos_camera, int exynos_v4l2_id);
 void exynos_v4l2_close(struct exynos_camera *exynos_camera, int exynos_v4l2_id);
+int exynos_v4l2_sched_acquire(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int exynos_v4l2_id);
+void exynos_v4l2_sched_release(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output);
+void exynos_v4l2_sched_busy(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int64_t time);
 int exynos_v4l2_ioctl(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
 	int request, void *data);
 int exynos_v4l2_poll(struct exynos_camera *exynos_camera, int exynos_v4l2_id);
@@ -575,10 +1160,14 @@ int exynos_v4l2_qbuf_cap(struct exynos_camera *exynos_camera, int exynos_v4l2_id
 	int index);
 int exynos_v4l2_qbuf_out(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
 	int index, unsigned long userptr);
+int exynos_v4l2_dqbuf_info(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
+	int type, int memory, int64_t *timestamp, unsigned int *sequence);
 int exynos_v4l2_dqbuf(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
 	int type, int memory);
 int exynos_v4l2_dqbuf_cap(struct exynos_camera *exynos_camera,
 	int exynos_v4l2_id);
+int exynos_v4l2_dqbuf_cap_info(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int64_t *timestamp, unsigned int *sequence);
 int exynos_v4l2_dqbuf_out(struct exynos_camera *exynos_camera,
 	int exynos_v4l2_id);
 int exynos_v4l2_reqbufs(struct exynos_camera *exynos_camera,
@@ -667,8 +1256,16 @@ int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output);
 void exynos_v4l2_output_stop(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output);
+int exynos_v4l2_output_dst(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer,
+	int dst_address);
 int exynos_v4l2_output(struct exynos_camera *exynos_camera,
-	struct exynos_v4l2_output *output, int buffer_address);
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer);
+int exynos_v4l2_output_submit(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer,
+	int dst_address);
+int exynos_v4l2_output_complete(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output);
 int exynos_v4l2_output_release(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output);
 
@@ -0,0 +1,865 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define LOG_TAG "exynos_convert"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+/*
+ * Software replacement for the FIMC color conversion and scaling. Frames go
+ * through planar 4:2:2 intermediate buffers: the source is unpacked at its
+ * own size, the planes are scaled with a bilinear filter and then packed to
+ * the destination format, with the same layout as FIMC would write it (see
+ * exynos_camera_yuv_planes). Each step is split by rows on a worker pool.
+ * The scalar kernels are the reference for the vectorized ones, which the
+ * host tests check them against.
+ */
+
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+#define EXYNOS_CONVERT_SIMD	1
+#endif
+
+// Planes are padded so that kernels may read a vector past the end of a row
+#define EXYNOS_CONVERT_PADDING	16
+
+static int exynos_convert_simd_enabled = 1;
+
+// Scalar
+
+static void exynos_convert_unpack_row_scalar(unsigned char *src,
+	unsigned char *y, unsigned char *cb, unsigned char *cr, int width,
+	int format)
+{
+	int i;
+
+	for (i = 0; i < width / 2; i++) {
+		if (format == V4L2_PIX_FMT_UYVY) {
+			cb[i] = src[0];
+			y[0] = src[1];
+			cr[i] = src[2];
+			y[1] = src[3];
+		} else {
+			y[0] = src[0];
+			cb[i] = src[1];
+			y[1] = src[2];
+			cr[i] = src[3];
+		}
+
+		src += 4;
+		y += 2;
+	}
+}
+
+static void exynos_convert_average_row_scalar(unsigned char *dst,
+	unsigned char *a, unsigned char *b, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		dst[i] = (a[i] + b[i] + 1) >> 1;
+}
+
+static void exynos_convert_interleave_row_scalar(unsigned char *dst,
+	unsigned char *first_a, unsigned char *first_b, unsigned char *second_a,
+	unsigned char *second_b, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++) {
+		dst[2 * i] = (first_a[i] + first_b[i] + 1) >> 1;
+		dst[2 * i + 1] = (second_a[i] + second_b[i] + 1) >> 1;
+	}
+}
+
+static void exynos_convert_blend_row_scalar(unsigned char *dst,
+	unsigned char *a, unsigned char *b, int weight, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+		dst[i] = (a[i] * (256 - weight) + b[i] * weight + 128) >> 8;
+}
+
+static inline unsigned char exynos_convert_clamp(int value)
+{
+	return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// BT.601 limited range, with 6 bits coefficients that fit in 16 bits lanes
+static void exynos_convert_rgb_row_scalar(unsigned char *dst,
+	unsigned char *y, unsigned char *cb, unsigned char *cr, int width,
+	int format)
+{
+	unsigned short *dst_rgb565;
+	int r, g, b;
+	int c, d, e;
+	int i;
+
+	dst_rgb565 = (unsigned short *) dst;
+
+	for (i = 0; i < width; i++) {
+		c = 74 * (y[i] - 16) + 32;
+		d = cb[i / 2] - 128;
+		e = cr[i / 2] - 128;
+
+		r = exynos_convert_clamp((c + 102 * e) >> 6);
+		g = exynos_convert_clamp((c - 25 * d - 52 * e) >> 6);
+		b = exynos_convert_clamp((c + 129 * d) >> 6);
+
+		if (format == V4L2_PIX_FMT_RGB565) {
+			dst_rgb565[i] = (r >> 3) << 11 | (g >> 2) << 5 | (b >> 3);
+		} else {
+			dst[4 * i] = r;
+			dst[4 * i + 1] = g;
+			dst[4 * i + 2] = b;
+			dst[4 * i + 3] = 0xff;
+		}
+	}
+}
+
+// SIMD
+
+#ifdef EXYNOS_CONVERT_SIMD
+static void exynos_convert_unpack_row_simd(unsigned char *src,
+	unsigned char *y, unsigned char *cb, unsigned char *cr, int width,
+	int format)
+{
+	int i;
+
+#if defined(__ARM_NEON__)
+	uint8x8x4_t v;
+	uint8x8x2_t l;
+
+	for (i = 0; i + 16 <= width; i += 16) {
+		v = vld4_u8(src + i * 2);
+
+		if (format == V4L2_PIX_FMT_UYVY) {
+			l.val[0] = v.val[1];
+			l.val[1] = v.val[3];
+			vst1_u8(cb + i / 2, v.val[0]);
+			vst1_u8(cr + i / 2, v.val[2]);
+		} else {
+			l.val[0] = v.val[0];
+			l.val[1] = v.val[2];
+			vst1_u8(cb + i / 2, v.val[1]);
+			vst1_u8(cr + i / 2, v.val[3]);
+		}
+
+		vst2_u8(y + i, l);
+	}
+#else
+	__m128i mask = _mm_set1_epi16(0x00ff);
+	__m128i zero = _mm_setzero_si128();
+	__m128i a, b, l, c;
+
+	for (i = 0; i + 16 <= width; i += 16) {
+		a = _mm_loadu_si128((const __m128i *) (src + i * 2));
+		b = _mm_loadu_si128((const __m128i *) (src + i * 2 + 16));
+
+		if (format == V4L2_PIX_FMT_UYVY) {
+			l = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+			c = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+		} else {
+			l = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+			c = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		}
+
+		_mm_storeu_si128((__m128i *) (y + i), l);
+		_mm_storel_epi64((__m128i *) (cb + i / 2), _mm_packus_epi16(_mm_and_si128(c, mask), zero));
+		_mm_storel_epi64((__m128i *) (cr + i / 2), _mm_packus_epi16(_mm_srli_epi16(c, 8), zero));
+	}
+#endif
+
+	if (i < width)
+		exynos_convert_unpack_row_scalar(src + i * 2, y + i, cb + i / 2, cr + i / 2, width - i, format);
+}
+
+static void exynos_convert_average_row_simd(unsigned char *dst,
+	unsigned char *a, unsigned char *b, int length)
+{
+	int i;
+
+#if defined(__ARM_NEON__)
+	for (i = 0; i + 16 <= length; i += 16)
+		vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+#else
+	for (i = 0; i + 16 <= length; i += 16)
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_avg_epu8(_mm_loadu_si128((const __m128i *) (a + i)), _mm_loadu_si128((const __m128i *) (b + i))));
+#endif
+
+	if (i < length)
+		exynos_convert_average_row_scalar(dst + i, a + i, b + i, length - i);
+}
+
+static void exynos_convert_interleave_row_simd(unsigned char *dst,
+	unsigned char *first_a, unsigned char *first_b, unsigned char *second_a,
+	unsigned char *second_b, int length)
+{
+	int i;
+
+#if defined(__ARM_NEON__)
+	uint8x16x2_t v;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		v.val[0] = vrhaddq_u8(vld1q_u8(first_a + i), vld1q_u8(first_b + i));
+		v.val[1] = vrhaddq_u8(vld1q_u8(second_a + i), vld1q_u8(second_b + i));
+		vst2q_u8(dst + 2 * i, v);
+	}
+#else
+	__m128i first, second;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		first = _mm_avg_epu8(_mm_loadu_si128((const __m128i *) (first_a + i)), _mm_loadu_si128((const __m128i *) (first_b + i)));
+		second = _mm_avg_epu8(_mm_loadu_si128((const __m128i *) (second_a + i)), _mm_loadu_si128((const __m128i *) (second_b + i)));
+
+		_mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_unpacklo_epi8(first, second));
+		_mm_storeu_si128((__m128i *) (dst + 2 * i + 16), _mm_unpackhi_epi8(first, second));
+	}
+#endif
+
+	if (i < length)
+		exynos_convert_interleave_row_scalar(dst + 2 * i, first_a + i, first_b + i, second_a + i, second_b + i, length - i);
+}
+
+static void exynos_convert_blend_row_simd(unsigned char *dst,
+	unsigned char *a, unsigned char *b, int weight, int length)
+{
+	int i;
+
+#if defined(__ARM_NEON__)
+	uint8x8_t weight_a = vdup_n_u8(256 - weight);
+	uint8x8_t weight_b = vdup_n_u8(weight);
+	uint16x8_t v;
+
+	// A zero weight is handled by the caller, so both fit in 8 bits
+	for (i = 0; i + 8 <= length; i += 8) {
+		v = vmull_u8(vld1_u8(a + i), weight_a);
+		v = vmlal_u8(v, vld1_u8(b + i), weight_b);
+		vst1_u8(dst + i, vrshrn_n_u16(v, 8));
+	}
+#else
+	__m128i weight_a = _mm_set1_epi16(256 - weight);
+	__m128i weight_b = _mm_set1_epi16(weight);
+	__m128i round = _mm_set1_epi16(128);
+	__m128i zero = _mm_setzero_si128();
+	__m128i va, vb, lo, hi;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		va = _mm_loadu_si128((const __m128i *) (a + i));
+		vb = _mm_loadu_si128((const __m128i *) (b + i));
+
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), weight_a), _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), weight_b));
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), weight_a), _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), weight_b));
+
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	if (i < length)
+		exynos_convert_blend_row_scalar(dst + i, a + i, b + i, weight, length - i);
+}
+
+static void exynos_convert_rgb_row_simd(unsigned char *dst,
+	unsigned char *y, unsigned char *cb, unsigned char *cr, int width,
+	int format)
+{
+	int i;
+
+#if defined(__ARM_NEON__)
+	int16x8_t c, d, e;
+	int16x8_t r, g, b;
+	uint8x8x2_t zip;
+	uint8x8x4_t rgbx;
+	uint8x8_t r8, g8, b8;
+	uint16x8_t rgb565;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		c = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i)));
+		c = vaddq_s16(vmulq_n_s16(vsubq_s16(c, vdupq_n_s16(16)), 74), vdupq_n_s16(32));
+
+		zip = vzip_u8(vld1_u8(cb + i / 2), vld1_u8(cb + i / 2));
+		d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(zip.val[0])), vdupq_n_s16(128));
+		zip = vzip_u8(vld1_u8(cr + i / 2), vld1_u8(cr + i / 2));
+		e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(zip.val[0])), vdupq_n_s16(128));
+
+		r = vshrq_n_s16(vqaddq_s16(c, vmulq_n_s16(e, 102)), 6);
+		g = vshrq_n_s16(vqsubq_s16(vqsubq_s16(c, vmulq_n_s16(d, 25)), vmulq_n_s16(e, 52)), 6);
+		b = vshrq_n_s16(vqaddq_s16(c, vmulq_n_s16(d, 129)), 6);
+
+		r8 = vqmovun_s16(r);
+		g8 = vqmovun_s16(g);
+		b8 = vqmovun_s16(b);
+
+		if (format == V4L2_PIX_FMT_RGB565) {
+			rgb565 = vshll_n_u8(r8, 8);
+			rgb565 = vsriq_n_u16(rgb565, vshll_n_u8(g8, 8), 5);
+			rgb565 = vsriq_n_u16(rgb565, vshll_n_u8(b8, 8), 11);
+			vst1q_u16((uint16_t *) (dst + 2 * i), rgb565);
+		} else {
+			rgbx.val[0] = r8;
+			rgbx.val[1] = g8;
+			rgbx.val[2] = b8;
+			rgbx.val[3] = vdup_n_u8(0xff);
+			vst4_u8(dst + 4 * i, rgbx);
+		}
+	}
+#else
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha = _mm_set1_epi8((char) 0xff);
+	__m128i c, d, e;
+	__m128i r, g, b;
+	__m128i rg, bx;
+	int value;
+
+	for (i = 0; i + 8 <= width; i += 8) {
+		c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (y + i)), zero);
+		c = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(c, _mm_set1_epi16(16)), _mm_set1_epi16(74)), _mm_set1_epi16(32));
+
+		memcpy(&value, cb + i / 2, sizeof(value));
+		d = _mm_cvtsi32_si128(value);
+		d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(d, d), zero), _mm_set1_epi16(128));
+
+		memcpy(&value, cr + i / 2, sizeof(value));
+		e = _mm_cvtsi32_si128(value);
+		e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(e, e), zero), _mm_set1_epi16(128));
+
+		r = _mm_srai_epi16(_mm_adds_epi16(c, _mm_mullo_epi16(e, _mm_set1_epi16(102))), 6);
+		g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(25))), _mm_mullo_epi16(e, _mm_set1_epi16(52))), 6);
+		b = _mm_srai_epi16(_mm_adds_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(129))), 6);
+
+		// Clamp to 8 bits, back in 16 bits lanes
+		r = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), zero);
+		g = _mm_unpacklo_epi8(_mm_packus_epi16(g, g), zero);
+		b = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), zero);
+
+		if (format == V4L2_PIX_FMT_RGB565) {
+			r = _mm_slli_epi16(_mm_srli_epi16(r, 3), 11);
+			g = _mm_slli_epi16(_mm_srli_epi16(g, 2), 5);
+			b = _mm_srli_epi16(b, 3);
+
+			_mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_or_si128(_mm_or_si128(r, g), b));
+		} else {
+			rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+			bx = _mm_or_si128(b, _mm_slli_epi16(alpha, 8));
+
+			_mm_storeu_si128((__m128i *) (dst + 4 * i), _mm_unpacklo_epi16(rg, bx));
+			_mm_storeu_si128((__m128i *) (dst + 4 * i + 16), _mm_unpackhi_epi16(rg, bx));
+		}
+	}
+#endif
+
+	if (i < width)
+		exynos_convert_rgb_row_scalar(dst + (format == V4L2_PIX_FMT_RGB565 ? 2 : 4) * i, y + i, cb + i / 2, cr + i / 2, width - i, format);
+}
+#endif
+
+// Kernels
+
+static void exynos_convert_unpack_row(unsigned char *src, unsigned char *y,
+	unsigned char *cb, unsigned char *cr, int width, int format)
+{
+#ifdef EXYNOS_CONVERT_SIMD
+	if (exynos_convert_simd_enabled) {
+		exynos_convert_unpack_row_simd(src, y, cb, cr, width, format);
+		return;
+	}
+#endif
+
+	exynos_convert_unpack_row_scalar(src, y, cb, cr, width, format);
+}
+
+static void exynos_convert_average_row(unsigned char *dst, unsigned char *a,
+	unsigned char *b, int length)
+{
+#ifdef EXYNOS_CONVERT_SIMD
+	if (exynos_convert_simd_enabled) {
+		exynos_convert_average_row_simd(dst, a, b, length);
+		return;
+	}
+#endif
+
+	exynos_convert_average_row_scalar(dst, a, b, length);
+}
+
+static void exynos_convert_interleave_row(unsigned char *dst,
+	unsigned char *first_a, unsigned char *first_b, unsigned char *second_a,
+	unsigned char *second_b, int length)
+{
+#ifdef EXYNOS_CONVERT_SIMD
+	if (exynos_convert_simd_enabled) {
+		exynos_convert_interleave_row_simd(dst, first_a, first_b, second_a, second_b, length);
+		return;
+	}
+#endif
+
+	exynos_convert_interleave_row_scalar(dst, first_a, first_b, second_a, second_b, length);
+}
+
+static void exynos_convert_blend_row(unsigned char *dst, unsigned char *a,
+	unsigned char *b, int weight, int length)
+{
+	if (weight == 0) {
+		memcpy(dst, a, length);
+		return;
+	}
+
+#ifdef EXYNOS_CONVERT_SIMD
+	if (exynos_convert_simd_enabled) {
+		exynos_convert_blend_row_simd(dst, a, b, weight, length);
+		return;
+	}
+#endif
+
+	exynos_convert_blend_row_scalar(dst, a, b, weight, length);
+}
+
+static void exynos_convert_rgb_row(unsigned char *dst, unsigned char *y,
+	unsigned char *cb, unsigned char *cr, int width, int format)
+{
+#ifdef EXYNOS_CONVERT_SIMD
+	if (exynos_convert_simd_enabled) {
+		exynos_convert_rgb_row_simd(dst, y, cb, cr, width, format);
+		return;
+	}
+#endif
+
+	exynos_convert_rgb_row_scalar(dst, y, cb, cr, width, format);
+}
+
+// Positions are in 8.8 fixed point and the right neighbour may be padding
+static void exynos_convert_scale_row(unsigned char *dst, unsigned char *src,
+	int *positions, int width)
+{
+	int index;
+	int weight;
+	int i;
+
+	for (i = 0; i < width; i++) {
+		index = positions[i] >> 8;
+		weight = positions[i] & 0xff;
+
+		dst[i] = (src[index] * (256 - weight) + src[index + 1] * weight + 128) >> 8;
+	}
+}
+
+// Jobs
+
+static void exynos_convert_range(int length, int align, int index, int count,
+	int *start, int *end)
+{
+	int units;
+
+	units = length / align;
+
+	*start = ((units * index) / count) * align;
+	*end = ((units * (index + 1)) / count) * align;
+}
+
+static void exynos_convert_unpack(void *data, int index, int count)
+{
+	struct exynos_convert *convert;
+	unsigned char *src;
+	unsigned char *row;
+	int width, height;
+	int start, end;
+	int i, j;
+
+	convert = (struct exynos_convert *) data;
+	src = convert->src;
+	width = convert->src_width;
+	height = convert->src_height;
+
+	exynos_convert_range(height, 2, index, count, &start, &end);
+
+	switch (convert->src_format) {
+		case V4L2_PIX_FMT_UYVY:
+		case V4L2_PIX_FMT_YUYV:
+			for (i = start; i < end; i++)
+				exynos_convert_unpack_row(src + i * width * 2, convert->src_planes[0] + i * width, convert->src_planes[1] + i * (width / 2), convert->src_planes[2] + i * (width / 2), width, convert->src_format);
+			break;
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12:
+			memcpy(convert->src_planes[0] + start * width, src + start * width, (end - start) * width);
+
+			for (i = start / 2; i < end / 2; i++) {
+				row = src + width * height + i * width;
+
+				for (j = 0; j < width / 2; j++) {
+					if (convert->src_format == V4L2_PIX_FMT_NV21) {
+						convert->src_planes[2][i * (width / 2) + j] = row[2 * j];
+						convert->src_planes[1][i * (width / 2) + j] = row[2 * j + 1];
+					} else {
+						convert->src_planes[1][i * (width / 2) + j] = row[2 * j];
+						convert->src_planes[2][i * (width / 2) + j] = row[2 * j + 1];
+					}
+				}
+			}
+			break;
+	}
+}
+
+static void exynos_convert_scale(void *data, int index, int count)
+{
+	struct exynos_convert *convert;
+	unsigned char *src_plane;
+	unsigned char *dst_plane;
+	int src_width, src_height;
+	int width;
+	int *positions;
+	int position;
+	int weight;
+	int start, end;
+	int line;
+	int plane;
+	int i;
+
+	unsigned char row[((struct exynos_convert *) data)->src_width + EXYNOS_CONVERT_PADDING];
+
+	convert = (struct exynos_convert *) data;
+
+	exynos_convert_range(convert->dst_height, 2, index, count, &start, &end);
+
+	for (plane = 0; plane < 3; plane++) {
+		src_plane = convert->src_planes[plane];
+		dst_plane = convert->dst_planes[plane];
+
+		src_width = plane == 0 ? convert->src_width : convert->src_width / 2;
+		src_height = plane == 0 ? convert->src_height : convert->src_chroma_height;
+		width = plane == 0 ? convert->dst_width : convert->dst_width / 2;
+		positions = plane == 0 ? convert->positions[0] : convert->positions[1];
+
+		for (i = start; i < end; i++) {
+			// Pixel centers are aligned, in 8.8 fixed point
+			position = ((2 * i + 1) * src_height * 128) / convert->dst_height - 128;
+			if (position < 0)
+				position = 0;
+
+			line = position >> 8;
+			weight = position & 0xff;
+
+			if (line >= src_height - 1) {
+				line = src_height - 1;
+				weight = 0;
+			}
+
+			// Lines are blended first, then columns unless the width is kept
+			if (src_width == width) {
+				exynos_convert_blend_row(dst_plane + i * width, src_plane + line * src_width, src_plane + (line + 1) * src_width, weight, width);
+			} else {
+				exynos_convert_blend_row(row, src_plane + line * src_width, src_plane + (line + 1) * src_width, weight, src_width);
+				row[src_width] = row[src_width - 1];
+
+				exynos_convert_scale_row(dst_plane + i * width, row, positions, width);
+			}
+		}
+	}
+}
+
+static void exynos_convert_pack(void *data, int index, int count)
+{
+	struct exynos_convert *convert;
+	unsigned char *dst;
+	unsigned char *y, *cb, *cr;
+	unsigned char *dst_y, *dst_c, *dst_cb, *dst_cr;
+	int width, height;
+	int start, end;
+	int i, j;
+
+	convert = (struct exynos_convert *) data;
+	dst = convert->dst;
+	width = convert->dst_width;
+	height = convert->dst_height;
+
+	y = convert->dst_planes[0];
+	cb = convert->dst_planes[1];
+	cr = convert->dst_planes[2];
+
+	exynos_convert_range(height, 2, index, count, &start, &end);
+
+	switch (convert->dst_format) {
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12:
+			memcpy(dst + start * width, y + start * width, (end - start) * width);
+
+			if (convert->dst_format == V4L2_PIX_FMT_NV21) {
+				dst_c = dst + width * height;
+				for (i = start; i < end; i += 2)
+					exynos_convert_interleave_row(dst_c + (i / 2) * width, cr + i * (width / 2), cr + (i + 1) * (width / 2), cb + i * (width / 2), cb + (i + 1) * (width / 2), width / 2);
+			} else {
+				dst_c = dst + EXYNOS_CAMERA_ALIGN(width * height);
+				for (i = start; i < end; i += 2)
+					exynos_convert_interleave_row(dst_c + (i / 2) * width, cb + i * (width / 2), cb + (i + 1) * (width / 2), cr + i * (width / 2), cr + (i + 1) * (width / 2), width / 2);
+			}
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			dst_y = dst;
+			dst_cb = dst_y + EXYNOS_CAMERA_ALIGN(width * height);
+			dst_cr = dst_cb + EXYNOS_CAMERA_ALIGN(width * height / 4);
+
+			memcpy(dst_y + start * width, y + start * width, (end - start) * width);
+
+			for (i = start; i < end; i += 2) {
+				exynos_convert_average_row(dst_cb + (i / 2) * (width / 2), cb + i * (width / 2), cb + (i + 1) * (width / 2), width / 2);
+				exynos_convert_average_row(dst_cr + (i / 2) * (width / 2), cr + i * (width / 2), cr + (i + 1) * (width / 2), width / 2);
+			}
+			break;
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_UYVY:
+			for (i = start; i < end; i++) {
+				dst_y = dst + i * width * 2;
+
+				for (j = 0; j < width / 2; j++) {
+					if (convert->dst_format == V4L2_PIX_FMT_YUYV) {
+						dst_y[4 * j] = y[i * width + 2 * j];
+						dst_y[4 * j + 1] = cb[i * (width / 2) + j];
+						dst_y[4 * j + 2] = y[i * width + 2 * j + 1];
+						dst_y[4 * j + 3] = cr[i * (width / 2) + j];
+					} else {
+						dst_y[4 * j] = cb[i * (width / 2) + j];
+						dst_y[4 * j + 1] = y[i * width + 2 * j];
+						dst_y[4 * j + 2] = cr[i * (width / 2) + j];
+						dst_y[4 * j + 3] = y[i * width + 2 * j + 1];
+					}
+				}
+			}
+			break;
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_RGB32:
+			for (i = start; i < end; i++)
+				exynos_convert_rgb_row(dst + i * width * (convert->dst_format == V4L2_PIX_FMT_RGB565 ? 2 : 4), y + i * width, cb + i * (width / 2), cr + i * (width / 2), width, convert->dst_format);
+			break;
+	}
+}
+
+// Convert
+
+static int exynos_convert_format_supported(int format, int destination)
+{
+	switch (format) {
+		case V4L2_PIX_FMT_UYVY:
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_NV21:
+		case V4L2_PIX_FMT_NV12:
+			return 1;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_RGB565:
+		case V4L2_PIX_FMT_RGB32:
+			return destination;
+		default:
+			return 0;
+	}
+}
+
+static int *exynos_convert_positions(int src_width, int dst_width)
+{
+	int *positions;
+	int position;
+	int i;
+
+	positions = (int *) calloc(dst_width, sizeof(int));
+	if (positions == NULL)
+		return NULL;
+
+	for (i = 0; i < dst_width; i++) {
+		position = ((2 * i + 1) * src_width * 128) / dst_width - 128;
+		if (position < 0)
+			position = 0;
+
+		if ((position >> 8) >= src_width - 1)
+			position = (src_width - 1) << 8;
+
+		positions[i] = position;
+	}
+
+	return positions;
+}
+
+static void exynos_convert_free(struct exynos_convert *convert)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (convert->scaled && convert->dst_planes[i] != NULL)
+			free(convert->dst_planes[i]);
+
+		if (convert->src_planes[i] != NULL)
+			free(convert->src_planes[i]);
+
+		convert->dst_planes[i] = NULL;
+		convert->src_planes[i] = NULL;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (convert->positions[i] != NULL)
+			free(convert->positions[i]);
+
+		convert->positions[i] = NULL;
+	}
+}
+
+int exynos_convert_start(struct exynos_convert *convert, int src_width,
+	int src_height, int src_format, int dst_width, int dst_height,
+	int dst_format, int threads_count)
+{
+	int src_chroma_height;
+	int rc;
+	int i;
+
+	if (convert == NULL)
+		return -EINVAL;
+
+	ALOGD("%s(%dx%d, %dx%d)", __func__, src_width, src_height, dst_width, dst_height);
+
+	if (convert->enabled) {
+		ALOGE("Convert was already started!");
+		return -1;
+	}
+
+	if (src_width < 4 || src_height < 2 || dst_width < 2 || dst_height < 2 || src_width % 2 || src_height % 2 || dst_width % 2 || dst_height % 2) {
+		ALOGE("%s: Unsupported size", __func__);
+		return -1;
+	}
+
+	if (!exynos_convert_format_supported(src_format, 0) || !exynos_convert_format_supported(dst_format, 1)) {
+		ALOGE("%s: Unsupported format", __func__);
+		return -1;
+	}
+
+	memset(convert, 0, sizeof(struct exynos_convert));
+
+	src_chroma_height = (src_format == V4L2_PIX_FMT_NV21 || src_format == V4L2_PIX_FMT_NV12) ? src_height / 2 : src_height;
+
+	convert->src_width = src_width;
+	convert->src_height = src_height;
+	convert->src_chroma_height = src_chroma_height;
+	convert->src_format = src_format;
+	convert->dst_width = dst_width;
+	convert->dst_height = dst_height;
+	convert->dst_format = dst_format;
+
+	convert->src_planes[0] = (unsigned char *) memalign(16, src_width * src_height + EXYNOS_CONVERT_PADDING);
+	convert->src_planes[1] = (unsigned char *) memalign(16, (src_width / 2) * src_chroma_height + EXYNOS_CONVERT_PADDING);
+	convert->src_planes[2] = (unsigned char *) memalign(16, (src_width / 2) * src_chroma_height + EXYNOS_CONVERT_PADDING);
+
+	for (i = 0; i < 3; i++)
+		if (convert->src_planes[i] == NULL)
+			goto error;
+
+	// Without scaling, the planes are packed straight from the source ones
+	convert->scaled = src_width != dst_width || src_height != dst_height || src_chroma_height != src_height;
+
+	if (convert->scaled) {
+		convert->dst_planes[0] = (unsigned char *) memalign(16, dst_width * dst_height + EXYNOS_CONVERT_PADDING);
+		convert->dst_planes[1] = (unsigned char *) memalign(16, (dst_width / 2) * dst_height + EXYNOS_CONVERT_PADDING);
+		convert->dst_planes[2] = (unsigned char *) memalign(16, (dst_width / 2) * dst_height + EXYNOS_CONVERT_PADDING);
+
+		for (i = 0; i < 3; i++)
+			if (convert->dst_planes[i] == NULL)
+				goto error;
+
+		convert->positions[0] = exynos_convert_positions(src_width, dst_width);
+		convert->positions[1] = exynos_convert_positions(src_width / 2, dst_width / 2);
+		if (convert->positions[0] == NULL || convert->positions[1] == NULL)
+			goto error;
+	} else {
+		for (i = 0; i < 3; i++)
+			convert->dst_planes[i] = convert->src_planes[i];
+	}
+
+	if (threads_count > 1) {
+		if (threads_count > EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1)
+			threads_count = EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1;
+
+		rc = exynos_worker_pool_start(&convert->workers, threads_count - 1);
+		if (rc < 0)
+			ALOGE("%s: Unable to start workers, converting serially", __func__);
+	}
+
+	convert->enabled = 1;
+
+	rc = 0;
+	goto complete;
+
+error:
+	ALOGE("%s: Unable to allocate buffers", __func__);
+
+	// Nothing else was started yet
+	exynos_convert_free(convert);
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+void exynos_convert_stop(struct exynos_convert *convert)
+{
+	if (convert == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!convert->enabled) {
+		ALOGE("Convert was already stopped!");
+		return;
+	}
+
+	if (convert->workers.enabled)
+		exynos_worker_pool_stop(&convert->workers);
+
+	exynos_convert_free(convert);
+
+	convert->enabled = 0;
+}
+
+int exynos_convert(struct exynos_convert *convert, void *src, void *dst)
+{
+	if (convert == NULL || src == NULL || dst == NULL)
+		return -EINVAL;
+
+	if (!convert->enabled) {
+		ALOGE("%s: Convert was not started", __func__);
+		return -1;
+	}
+
+	convert->src = (unsigned char *) src;
+	convert->dst = (unsigned char *) dst;
+
+	exynos_worker_pool_run(&convert->workers, exynos_convert_unpack, convert);
+
+	if (convert->scaled)
+		exynos_worker_pool_run(&convert->workers, exynos_convert_scale, convert);
+
+	exynos_worker_pool_run(&convert->workers, exynos_convert_pack, convert);
+
+	return 0;
+}
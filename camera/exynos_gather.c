@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define LOG_TAG "exynos_gather"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+/*
+ * Row gather for the S5C73M3 interleaved buffer: the pointers array is big
+ * endian and line i at src + offsets[i] is copied to dst + i * line_size.
+ * In place, every line is moved to a lower (or the same) address than its
+ * source, so copies are always done forward with all the loads of a block
+ * issued before its stores.
+ */
+
+#if defined(__ARM_NEON__) || defined(__SSE2__)
+#define EXYNOS_GATHER_SIMD	1
+#endif
+
+#define EXYNOS_GATHER_PREFETCH_STRIDE	64
+
+static int exynos_gather_simd_enabled = 0;
+
+// Scalar
+
+static void exynos_gather_swab32_scalar(unsigned int *dst, unsigned int *src,
+	int count)
+{
+	unsigned int value;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		value = src[i];
+		dst[i] = (value & 0xff) << 24 | (value & 0xff00) << 8 | (value & 0xff0000) >> 8 | (value & 0xff000000) >> 24;
+	}
+}
+
+static void exynos_gather_rows_scalar(void *dst_data, void *src_data,
+	unsigned int *offsets, int count, int line_size)
+{
+	unsigned char *dst;
+	unsigned char *src;
+	int i;
+
+	dst = (unsigned char *) dst_data;
+
+	for (i = 0; i < count; i++) {
+		src = (unsigned char *) src_data + offsets[i];
+		if (src != dst)
+			memmove(dst, src, line_size);
+
+		dst += line_size;
+	}
+}
+
+// SIMD
+
+#ifdef EXYNOS_GATHER_SIMD
+#if defined(__ARM_NEON__)
+typedef uint8x16_t exynos_gather_vector;
+#define exynos_gather_load(p)		vld1q_u8((const uint8_t *) (p))
+#define exynos_gather_store(p, v)	vst1q_u8((uint8_t *) (p), v)
+#define exynos_gather_swab(v)		vrev32q_u8(v)
+#else
+typedef __m128i exynos_gather_vector;
+#define exynos_gather_load(p)		_mm_loadu_si128((const __m128i *) (p))
+#define exynos_gather_store(p, v)	_mm_storeu_si128((__m128i *) (p), v)
+
+static inline __m128i exynos_gather_swab(__m128i v)
+{
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+
+	return v;
+}
+#endif
+
+static void exynos_gather_swab32_simd(unsigned int *dst, unsigned int *src,
+	int count)
+{
+	exynos_gather_vector v;
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		v = exynos_gather_load(src + i);
+		exynos_gather_store(dst + i, exynos_gather_swab(v));
+	}
+
+	if (i < count)
+		exynos_gather_swab32_scalar(dst + i, src + i, count - i);
+}
+
+static void exynos_gather_row_simd(unsigned char *dst, unsigned char *src,
+	int length, unsigned char *prefetch)
+{
+	exynos_gather_vector a, b, c, d;
+	exynos_gather_vector tail;
+	int i;
+
+	// The tail may get overwritten by the stores below when the line overlaps
+	tail = exynos_gather_load(src + length - 16);
+
+	for (i = 0; i + 64 <= length; i += 64) {
+		if (prefetch != NULL)
+			__builtin_prefetch(prefetch + i);
+
+		a = exynos_gather_load(src + i);
+		b = exynos_gather_load(src + i + 16);
+		c = exynos_gather_load(src + i + 32);
+		d = exynos_gather_load(src + i + 48);
+
+		exynos_gather_store(dst + i, a);
+		exynos_gather_store(dst + i + 16, b);
+		exynos_gather_store(dst + i + 32, c);
+		exynos_gather_store(dst + i + 48, d);
+	}
+
+	for (; i + 16 <= length; i += 16) {
+		a = exynos_gather_load(src + i);
+		exynos_gather_store(dst + i, a);
+	}
+
+	if (i < length)
+		exynos_gather_store(dst + length - 16, tail);
+}
+
+static void exynos_gather_rows_simd(void *dst_data, void *src_data,
+	unsigned int *offsets, int count, int line_size)
+{
+	unsigned char *prefetch;
+	unsigned char *dst;
+	unsigned char *src;
+	int i;
+
+	if (line_size < 16) {
+		exynos_gather_rows_scalar(dst_data, src_data, offsets, count, line_size);
+		return;
+	}
+
+	dst = (unsigned char *) dst_data;
+
+	for (i = 0; i < count; i++) {
+		src = (unsigned char *) src_data + offsets[i];
+		prefetch = i + 1 < count ? (unsigned char *) src_data + offsets[i + 1] : NULL;
+
+		if (src != dst)
+			exynos_gather_row_simd(dst, src, line_size, prefetch);
+		else if (prefetch != NULL)
+			__builtin_prefetch(prefetch);
+
+		dst += line_size;
+	}
+}
+#endif
+
+// Self-test
+
+static unsigned int exynos_gather_selftest_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+
+	return (*seed >> 16) & 0x7fff;
+}
+
+int exynos_gather_selftest(void)
+{
+#ifdef EXYNOS_GATHER_SIMD
+	int line_sizes[] = { 16, 40, 352, 1920, 2562 };
+	unsigned char *reference = NULL;
+	unsigned char *data = NULL;
+	unsigned int *pointers = NULL;
+	unsigned int *offsets_reference = NULL;
+	unsigned int *offsets = NULL;
+	unsigned int seed = 0x73;
+	unsigned int offset;
+	int line_size;
+	int count;
+	int size;
+	int gap;
+	int i, j;
+	int rc;
+
+	count = 37;
+	size = count * (line_sizes[sizeof(line_sizes) / sizeof(int) - 1] + 128) + 16;
+
+	reference = (unsigned char *) malloc(size);
+	data = (unsigned char *) malloc(size);
+	pointers = (unsigned int *) calloc(count, sizeof(unsigned int));
+	offsets_reference = (unsigned int *) calloc(count, sizeof(unsigned int));
+	offsets = (unsigned int *) calloc(count, sizeof(unsigned int));
+
+	if (reference == NULL || data == NULL || pointers == NULL || offsets_reference == NULL || offsets == NULL)
+		goto error;
+
+	for (j = 0; j < (int) (sizeof(line_sizes) / sizeof(int)); j++) {
+		line_size = line_sizes[j];
+
+		// Gaps both smaller and larger than a vector, so that lines overlap
+		offset = exynos_gather_selftest_random(&seed) % 64;
+		for (i = 0; i < count; i++) {
+			pointers[i] = offset;
+			gap = exynos_gather_selftest_random(&seed) % 128;
+			if (gap > 96)
+				gap = 0;
+
+			offset += line_size + gap;
+		}
+
+		for (i = 0; i < size; i++)
+			reference[i] = (unsigned char) exynos_gather_selftest_random(&seed);
+
+		memcpy(data, reference, size);
+
+		for (i = 0; i < count; i++)
+			pointers[i] = (pointers[i] & 0xff) << 24 | (pointers[i] & 0xff00) << 8 | (pointers[i] & 0xff0000) >> 8 | (pointers[i] & 0xff000000) >> 24;
+
+		exynos_gather_swab32_scalar(offsets_reference, pointers, count);
+		exynos_gather_swab32_simd(offsets, pointers, count);
+
+		if (memcmp(offsets_reference, offsets, count * sizeof(unsigned int)) != 0) {
+			ALOGE("%s: Pointers swap mismatch", __func__);
+			goto error;
+		}
+
+		exynos_gather_rows_scalar(reference, reference, offsets_reference, count, line_size);
+		exynos_gather_rows_simd(data, data, offsets, count, line_size);
+
+		if (memcmp(reference, data, size) != 0) {
+			ALOGE("%s: Rows gather mismatch for %d bytes lines", __func__, line_size);
+			goto error;
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (reference != NULL)
+		free(reference);
+
+	if (data != NULL)
+		free(data);
+
+	if (pointers != NULL)
+		free(pointers);
+
+	if (offsets_reference != NULL)
+		free(offsets_reference);
+
+	if (offsets != NULL)
+		free(offsets);
+
+	return rc;
+#else
+	return 0;
+#endif
+}
+
+// Gather
+
+void exynos_gather_init(void)
+{
+#ifdef EXYNOS_GATHER_SIMD
+	int rc;
+
+	if (exynos_gather_simd_enabled)
+		return;
+
+	rc = exynos_gather_selftest();
+	if (rc < 0) {
+		ALOGE("%s: Self-test failed, falling back to scalar gather", __func__);
+		return;
+	}
+
+	exynos_gather_simd_enabled = 1;
+#endif
+}
+
+void exynos_gather_swab32(unsigned int *dst, unsigned int *src, int count)
+{
+	if (dst == NULL || src == NULL || count <= 0)
+		return;
+
+#ifdef EXYNOS_GATHER_SIMD
+	if (exynos_gather_simd_enabled) {
+		exynos_gather_swab32_simd(dst, src, count);
+		return;
+	}
+#endif
+
+	exynos_gather_swab32_scalar(dst, src, count);
+}
+
+void exynos_gather_rows(void *dst, void *src, unsigned int *offsets, int count,
+	int line_size)
+{
+	if (dst == NULL || src == NULL || offsets == NULL || count <= 0 || line_size <= 0)
+		return;
+
+#ifdef EXYNOS_GATHER_SIMD
+	if (exynos_gather_simd_enabled) {
+		exynos_gather_rows_simd(dst, src, offsets, count, line_size);
+		return;
+	}
+#endif
+
+	exynos_gather_rows_scalar(dst, src, offsets, count, line_size);
+}
@@ -15,6 +15,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -34,6 +36,18 @@
 #include "exynos_camera.h"
 
 #ifdef EXYNOS_JPEG_HW
+static int exynos_jpeg_quality_level(int quality)
+{
+	if (quality >= 90)
+		return QUALITY_LEVEL_1;
+	else if (quality >= 80)
+		return QUALITY_LEVEL_2;
+	else if (quality >= 70)
+		return QUALITY_LEVEL_3;
+	else
+		return QUALITY_LEVEL_4;
+}
+
 int exynos_jpeg_start(struct exynos_camera *exynos_camera,
 	struct exynos_jpeg *jpeg)
 {
@@ -81,15 +95,7 @@ int exynos_jpeg_start(struct exynos_camera *exynos_camera,
 	config.num_planes = 1;
 	config.pix.enc_fmt.in_fmt = jpeg->format;
 	config.pix.enc_fmt.out_fmt = V4L2_PIX_FMT_JPEG_420;
-
-	if (jpeg->quality >= 90)
-		config.enc_qual = QUALITY_LEVEL_1;
-	else if (jpeg->quality >= 80)
-		config.enc_qual = QUALITY_LEVEL_2;
-	else if (jpeg->quality >= 70)
-		config.enc_qual = QUALITY_LEVEL_3;
-	else
-		config.enc_qual = QUALITY_LEVEL_4;
+	config.enc_qual = exynos_jpeg_quality_level(jpeg->quality);
 
 	rc = jpeghal_enc_setconfig(fd, &config);
 	if (rc < 0) {
@@ -396,9 +402,216 @@ error:
 #endif
 	}
 
+	jpeg->enabled = 0;
+
 	rc = -1;
 
 complete:
 	return rc;
 }
+
+/*
+ * Encoder contexts are kept configured across shots, so that the device
+ * setup and buffers allocation only happen again when the width, height,
+ * format or quality level of the picture or its thumbnail change.
+ */
+
+int exynos_jpeg_pool_start(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, int persistent)
+{
+	if (exynos_camera == NULL || pool == NULL)
+		return -EINVAL;
+
+	ALOGD("%s(%d)", __func__, persistent);
+
+	if (pool->enabled) {
+		ALOGE("Jpeg pool was already started!");
+		return -1;
+	}
+
+	memset(pool, 0, sizeof(struct exynos_jpeg_pool));
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	pool->persistent = persistent;
+	pool->enabled = 1;
+
+	return 0;
+}
+
+void exynos_jpeg_pool_stop(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool)
+{
+	int i;
+
+	if (exynos_camera == NULL || pool == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!pool->enabled) {
+		ALOGE("Jpeg pool was already stopped!");
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	// The picture thread is detached, so a shot may still be going on
+	while (pool->busy_count > 0)
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+
+	for (i = 0; i < EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT; i++)
+		if (pool->contexts[i].enabled)
+			exynos_jpeg_stop(exynos_camera, &pool->contexts[i]);
+
+	pool->enabled = 0;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+struct exynos_jpeg *exynos_jpeg_pool_get(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, int width, int height, int format,
+	int quality)
+{
+	struct exynos_jpeg *jpeg;
+	int index = -1;
+	int rc;
+	int i;
+
+	if (exynos_camera == NULL || pool == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->enabled)
+		goto error;
+
+	for (i = 0; i < EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT; i++) {
+		jpeg = &pool->contexts[i];
+
+		if (pool->busy[i])
+			continue;
+
+		if (jpeg->enabled && jpeg->width == width && jpeg->height == height && jpeg->format == format &&
+			exynos_jpeg_quality_level(jpeg->quality) == exynos_jpeg_quality_level(quality)) {
+			pool->reused++;
+			index = i;
+			goto complete;
+		}
+
+		// Stopped contexts first, then the least recently used one
+		if (index < 0 || (pool->contexts[index].enabled && (!jpeg->enabled || pool->used[i] < pool->used[index])))
+			index = i;
+	}
+
+	if (index < 0) {
+		ALOGE("%s: No free jpeg context", __func__);
+		goto error;
+	}
+
+	jpeg = &pool->contexts[index];
+
+	if (jpeg->enabled)
+		exynos_jpeg_stop(exynos_camera, jpeg);
+
+	memset(jpeg, 0, sizeof(struct exynos_jpeg));
+	jpeg->width = width;
+	jpeg->height = height;
+	jpeg->format = format;
+	jpeg->quality = quality;
+
+	rc = exynos_jpeg_start(exynos_camera, jpeg);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start jpeg", __func__);
+		goto error;
+	}
+
+	pool->configured++;
+
+complete:
+	pool->busy[index] = 1;
+	pool->busy_count++;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return &pool->contexts[index];
+
+error:
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+void exynos_jpeg_pool_put(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool, struct exynos_jpeg *jpeg)
+{
+	int index;
+
+	if (exynos_camera == NULL || pool == NULL || jpeg == NULL)
+		return;
+
+	index = jpeg - pool->contexts;
+	if (index < 0 || index >= EXYNOS_CAMERA_JPEG_CONTEXTS_COUNT)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->persistent && jpeg->enabled)
+		exynos_jpeg_stop(exynos_camera, jpeg);
+
+	pool->used[index] = ++pool->sequence;
+	pool->busy[index] = 0;
+	pool->busy_count--;
+
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * A shot holds the pool from the start of the picture thread to its end, so
+ * that the pool is not stopped between the picture and thumbnail encodes.
+ */
+
+int exynos_jpeg_pool_hold(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool)
+{
+	int rc;
+
+	if (exynos_camera == NULL || pool == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->enabled) {
+		rc = -1;
+		goto complete;
+	}
+
+	pool->busy_count++;
+
+	rc = 0;
+
+complete:
+	pthread_mutex_unlock(&pool->mutex);
+
+	return rc;
+}
+
+void exynos_jpeg_pool_release(struct exynos_camera *exynos_camera,
+	struct exynos_jpeg_pool *pool)
+{
+	if (exynos_camera == NULL || pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->busy_count--;
+
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
 #endif
@@ -0,0 +1,591 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#define LOG_TAG "exynos_s5c73m3"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+#define BIG2LITTLE_ENDIAN(big)	((big & 0xff) << 24 | (big & 0xff00) << 8 | (big & 0xff0000) >> 8 | (big & 0xff000000) >> 24)
+
+/*
+ * The S5C73M3 appends a 4 KiB block of embedded data at the end of each
+ * interleaved frame. Its layout depends on the sensor firmware: each layout
+ * lists the fields sorted by offset, so that the block is read in one pass.
+ */
+
+#define S5C73M3_METADATA_FIELD(field) \
+	offsetof(struct s5c73m3_metadata, field)
+
+struct s5c73m3_metadata_field s5c73m3_metadata_fields_default[] = {
+	{ 4,	S5C73M3_METADATA_U8,	1,	S5C73M3_METADATA_FIELD(flash) },
+	{ 8,	S5C73M3_METADATA_LE16,	1,	S5C73M3_METADATA_FIELD(iso) },
+	{ 12,	S5C73M3_METADATA_U8,	1,	S5C73M3_METADATA_FIELD(brightness) },
+	{ 16,	S5C73M3_METADATA_LE16,	1,	S5C73M3_METADATA_FIELD(exposure_bias) },
+	{ 24,	S5C73M3_METADATA_LE16,	1,	S5C73M3_METADATA_FIELD(exposure_time) },
+	{ 50,	S5C73M3_METADATA_U8,	1,	S5C73M3_METADATA_FIELD(auto_focus_result) },
+	{ 108,	S5C73M3_METADATA_U8,	1,	S5C73M3_METADATA_FIELD(faces_count) },
+	{ 110,	S5C73M3_METADATA_LE16,	S5C73M3_METADATA_FACES_COUNT * 6,	S5C73M3_METADATA_FIELD(faces) },
+	{ 4046,	S5C73M3_METADATA_U8,	1,	S5C73M3_METADATA_FIELD(decoded) },
+	{ 4084,	S5C73M3_METADATA_BE32,	1,	S5C73M3_METADATA_FIELD(pointers_array_offset) },
+	{ 4088,	S5C73M3_METADATA_BE32,	1,	S5C73M3_METADATA_FIELD(pointers_array_size) },
+};
+
+/*
+ * Layouts are matched against the firmware version prefix, in order. Only the
+ * layout of the firmwares shipped on these devices is known so far: it is the
+ * fallback for any firmware, other layouts go before it.
+ */
+
+struct s5c73m3_metadata_layout s5c73m3_metadata_layouts[] = {
+	{
+		// Any firmware
+		.firmware = NULL,
+		.fields = (struct s5c73m3_metadata_field *) &s5c73m3_metadata_fields_default,
+		.fields_count = sizeof(s5c73m3_metadata_fields_default) / sizeof(s5c73m3_metadata_fields_default[0]),
+	},
+};
+
+int s5c73m3_metadata_layouts_count = sizeof(s5c73m3_metadata_layouts) / sizeof(s5c73m3_metadata_layouts[0]);
+
+int s5c73m3_metadata_type_length(int type)
+{
+	switch (type) {
+		case S5C73M3_METADATA_U8:
+			return 1;
+		case S5C73M3_METADATA_LE16:
+			return 2;
+		case S5C73M3_METADATA_BE32:
+			return 4;
+		default:
+			return -1;
+	}
+}
+
+int s5c73m3_metadata_layout_check(struct s5c73m3_metadata_layout *layout)
+{
+	struct s5c73m3_metadata_field *field;
+	int length;
+	int offset;
+	int i;
+
+	if (layout == NULL || layout->fields == NULL)
+		return -EINVAL;
+
+	offset = 0;
+
+	for (i = 0; i < layout->fields_count; i++) {
+		field = &layout->fields[i];
+
+		length = s5c73m3_metadata_type_length(field->type);
+		if (length < 0 || field->count <= 0 || field->offset < offset)
+			return -1;
+
+		if (field->offset + length * field->count > S5C73M3_METADATA_LENGTH)
+			return -1;
+
+		if (field->metadata_offset + length * field->count > (int) sizeof(struct s5c73m3_metadata))
+			return -1;
+
+		offset = field->offset + length * field->count;
+	}
+
+	return 0;
+}
+
+struct s5c73m3_metadata_layout *s5c73m3_metadata_layout_select(void)
+{
+	struct s5c73m3_metadata_layout *layout;
+	char firmware[64];
+	int length;
+	int fd;
+	int rc;
+	int i;
+
+	memset(&firmware, 0, sizeof(firmware));
+
+	fd = open(S5C73M3_FIRMWARE_PATH, O_RDONLY);
+	if (fd >= 0) {
+		length = read(fd, &firmware, sizeof(firmware) - 1);
+		if (length < 0)
+			length = 0;
+
+		firmware[length] = '\0';
+		close(fd);
+	} else {
+		ALOGE("%s: Unable to read firmware version", __func__);
+	}
+
+	for (i = 0; i < s5c73m3_metadata_layouts_count; i++) {
+		layout = &s5c73m3_metadata_layouts[i];
+
+		if (layout->firmware != NULL && strncmp(firmware, layout->firmware, strlen(layout->firmware)) != 0)
+			continue;
+
+		rc = s5c73m3_metadata_layout_check(layout);
+		if (rc < 0) {
+			ALOGE("%s: Invalid metadata layout", __func__);
+			continue;
+		}
+
+		ALOGD("%s: Using %s metadata layout for firmware %s", __func__, layout->firmware != NULL ? layout->firmware : "default", firmware);
+
+		return layout;
+	}
+
+	return NULL;
+}
+
+int s5c73m3_metadata_parse(struct s5c73m3_metadata_layout *layout,
+	void *data, int length, struct s5c73m3_metadata *metadata)
+{
+	struct s5c73m3_metadata_field *field;
+	unsigned char *metadata_p;
+	unsigned char *data_p;
+	unsigned short value16;
+	unsigned int value32;
+	int i, j;
+
+	if (layout == NULL || data == NULL || length < S5C73M3_METADATA_LENGTH || metadata == NULL)
+		return -EINVAL;
+
+	memset(metadata, 0, sizeof(struct s5c73m3_metadata));
+
+	for (i = 0; i < layout->fields_count; i++) {
+		field = &layout->fields[i];
+
+		data_p = (unsigned char *) data + field->offset;
+		metadata_p = (unsigned char *) metadata + field->metadata_offset;
+
+		switch (field->type) {
+			case S5C73M3_METADATA_U8:
+				memcpy(metadata_p, data_p, field->count);
+				break;
+			case S5C73M3_METADATA_LE16:
+				for (j = 0; j < field->count; j++) {
+					value16 = data_p[0] | data_p[1] << 8;
+					memcpy(metadata_p, &value16, sizeof(value16));
+					data_p += sizeof(value16);
+					metadata_p += sizeof(value16);
+				}
+				break;
+			case S5C73M3_METADATA_BE32:
+				for (j = 0; j < field->count; j++) {
+					value32 = (unsigned int) data_p[0] << 24 | data_p[1] << 16 | data_p[2] << 8 | data_p[3];
+					memcpy(metadata_p, &value32, sizeof(value32));
+					data_p += sizeof(value32);
+					metadata_p += sizeof(value32);
+				}
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The S5C73M3 interleaved buffer holds the YUV lines with JPEG chunks in the
+ * gaps between them. The YUV lines are compacted in place at the start of the
+ * buffer. The JPEG is only extracted when a destination is allocated for it,
+ * once its length is known: it is then described as a list of segments
+ * (relative to the start of the buffer) and gathered to the destination.
+ */
+
+int s5c73m3_interleaved_jpeg_gather(void *data,
+	struct exynos_camera_jpeg_segment *jpeg_segments, int jpeg_segments_count,
+	void *jpeg_data)
+{
+	unsigned char *jpeg_p;
+	int jpeg_length;
+	int i;
+
+	if (data == NULL || jpeg_segments == NULL || jpeg_data == NULL)
+		return -EINVAL;
+
+	jpeg_p = (unsigned char *) jpeg_data;
+	jpeg_length = 0;
+
+	for (i = 0; i < jpeg_segments_count; i++) {
+		memcpy(jpeg_p, (unsigned char *) data + jpeg_segments[i].offset, jpeg_segments[i].length);
+		jpeg_p += jpeg_segments[i].length;
+		jpeg_length += jpeg_segments[i].length;
+	}
+
+	return jpeg_length;
+}
+
+/*
+ * The pointers array is split in one range of lines per worker: the ranges
+ * are scanned concurrently, then the JPEG segments of each range are written
+ * at the position given by the sum of the preceding ranges.
+ */
+
+void s5c73m3_interleaved_scan(void *data, int index, int count)
+{
+	struct s5c73m3_interleaved_job *job;
+	struct s5c73m3_interleaved_range *range;
+	unsigned int yuv_offset_last;
+	unsigned int yuv_offset;
+	unsigned int line_size;
+	unsigned int interleaved_size;
+	int gap;
+	int i;
+
+	job = (struct s5c73m3_interleaved_job *) data;
+	if (index >= job->ranges_count)
+		return;
+
+	range = &job->ranges[index];
+	range->segments_count = 0;
+	range->jpeg_length = 0;
+	range->first_offset = 0;
+	range->rc = 0;
+
+	if (range->end <= range->start)
+		return;
+
+	line_size = job->line_size;
+	interleaved_size = job->interleaved_size;
+
+	exynos_gather_swab32(job->offsets + range->start, job->pointers + range->start, range->end - range->start);
+
+	// The previous line belongs to another range, read it from the array
+	yuv_offset_last = 0;
+	if (range->start > 0)
+		yuv_offset_last = BIG2LITTLE_ENDIAN(job->pointers[range->start - 1]);
+
+	for (i = range->start; i < range->end; i++) {
+		yuv_offset = job->offsets[i];
+
+		// Lines must end before the pointers array
+		if (yuv_offset > interleaved_size || line_size > interleaved_size - yuv_offset) {
+			range->rc = -1;
+			return;
+		}
+
+		if (i > 0 && yuv_offset < yuv_offset_last + line_size) {
+			ALOGE("%s: Overlapping interleaved lines", __func__);
+			range->rc = -1;
+			return;
+		}
+
+		gap = yuv_offset - yuv_offset_last - line_size;
+
+		if (gap > 0) {
+			if (range->segments_count == 0)
+				range->first_offset = yuv_offset_last + line_size;
+
+			range->segments_count++;
+			range->jpeg_length += gap;
+		}
+
+		yuv_offset_last = yuv_offset;
+	}
+}
+
+void s5c73m3_interleaved_extract(void *data, int index, int count)
+{
+	struct s5c73m3_interleaved_job *job;
+	struct s5c73m3_interleaved_range *range;
+	struct exynos_camera_jpeg_segment *jpeg_segments;
+	unsigned int yuv_offset_last;
+	unsigned int line_size;
+	int segments_count;
+	int gap;
+	int i;
+
+	job = (struct s5c73m3_interleaved_job *) data;
+	if (index >= job->ranges_count)
+		return;
+
+	range = &job->ranges[index];
+	line_size = job->line_size;
+
+	yuv_offset_last = range->start > 0 ? job->offsets[range->start - 1] : 0;
+	jpeg_segments = job->jpeg_segments + range->segments_start;
+	segments_count = 0;
+
+	for (i = range->start; i < range->end; i++) {
+		gap = job->offsets[i] - yuv_offset_last - line_size;
+
+		if (gap > 0) {
+			jpeg_segments[segments_count].offset = yuv_offset_last + line_size;
+			jpeg_segments[segments_count].length = gap;
+			segments_count++;
+		}
+
+		yuv_offset_last = job->offsets[i];
+	}
+
+	// The last range also takes the trailing segment
+	if (index == job->ranges_count - 1)
+		segments_count = job->jpeg_segments_count - range->segments_start;
+
+	if (job->jpeg_data != NULL)
+		s5c73m3_interleaved_jpeg_gather(job->data, jpeg_segments, segments_count, job->jpeg_data + range->jpeg_start);
+}
+
+void s5c73m3_interleaved_compact(void *data, int index, int count)
+{
+	struct s5c73m3_interleaved_job *job;
+	int start;
+	int end;
+	int lines;
+
+	job = (struct s5c73m3_interleaved_job *) data;
+
+	lines = job->compact_end - job->compact_start;
+	start = job->compact_start + (lines * index) / count;
+	end = job->compact_start + (lines * (index + 1)) / count;
+
+	if (end > start)
+		exynos_gather_rows(job->data + start * job->line_size, job->data, job->offsets + start, end - start, job->line_size);
+}
+
+void s5c73m3_interleaved_run(struct exynos_camera *exynos_camera,
+	struct s5c73m3_interleaved_job *job,
+	void (*function)(void *data, int index, int count))
+{
+	if (job->ranges_count > 1)
+		exynos_worker_pool_run(&exynos_camera->capture_workers, function, job);
+	else
+		function(job, 0, 1);
+}
+
+int s5c73m3_interleaved_decode(struct exynos_camera *exynos_camera, void *data, int size,
+	int *yuv_size, int yuv_width, int yuv_height, unsigned int *yuv_offsets,
+	struct exynos_camera_jpeg_segment *jpeg_segments, int *jpeg_segments_count,
+	void *(*jpeg_alloc)(struct exynos_camera *exynos_camera, int length),
+	int *jpeg_size, int *decoded, int *auto_focus_result,
+	camera_face_t *faces, int *faces_count, struct exynos_exif *exif)
+{
+	exif_attribute_t *attributes;
+	struct s5c73m3_metadata *metadata;
+	int yuv_length;
+	int jpeg_length;
+	int num_detected_faces;
+	int face;
+	unsigned int *pointers_p;
+	unsigned int pointers_array_offset;
+	unsigned int pointers_array_size;
+	unsigned int pointers_count;
+	unsigned int interleaved_size;
+	unsigned int metadata_offset;
+	unsigned int yuv_offset_last;
+	unsigned int yuv_line_size;
+	unsigned short *jpeg_start_p;
+	void *jpeg_data;
+	struct s5c73m3_interleaved_job job;
+	int workers_count;
+	int ranges_count;
+	int segments_count;
+	int start;
+	int end;
+	int gap;
+	unsigned int i;
+	int rc;
+
+	if (data == NULL || size < S5C73M3_METADATA_LENGTH || yuv_size == NULL || yuv_width <= 0 || yuv_height <= 0 || yuv_offsets == NULL || jpeg_segments == NULL || jpeg_segments_count == NULL || jpeg_size == NULL || decoded == NULL || auto_focus_result == NULL || faces == NULL || faces_count == NULL)
+		return -EINVAL;
+
+	metadata = &exynos_camera->capture_metadata;
+
+	// End of the first plane (interleaved buffer)
+	rc = s5c73m3_metadata_parse(exynos_camera->capture_metadata_layout, (unsigned char *) data + size - S5C73M3_METADATA_LENGTH, S5C73M3_METADATA_LENGTH, metadata);
+	if (rc < 0) {
+		ALOGE("%s: Unable to parse metadata", __func__);
+		return -1;
+	}
+
+	*decoded = (int) metadata->decoded;
+	*auto_focus_result = (int) metadata->auto_focus_result;
+
+	pointers_array_offset = metadata->pointers_array_offset;
+	pointers_array_size = metadata->pointers_array_size;
+	interleaved_size = pointers_array_offset;
+
+	// FaceDetection Information
+	num_detected_faces = (int) metadata->faces_count;
+
+	// Faces beyond what was copied must not be reported
+	if (num_detected_faces < 0 || num_detected_faces >= exynos_camera->max_detected_faces || num_detected_faces > S5C73M3_METADATA_FACES_COUNT)
+		num_detected_faces = 0;
+
+	// Faces go with the frame, the preview stage reports them
+	for (face = 0; face < num_detected_faces; face++) {
+		faces[face].rect[0] = metadata->faces[face].rect[0];
+		faces[face].rect[1] = metadata->faces[face].rect[1];
+		faces[face].rect[2] = metadata->faces[face].rect[2];
+		faces[face].rect[3] = metadata->faces[face].rect[3];
+		faces[face].score = metadata->faces[face].score;
+		faces[face].id = metadata->faces[face].id;
+	}
+	*faces_count = num_detected_faces;
+
+	if (!*decoded)
+		return 0;
+
+	attributes = &exif->attributes;
+
+	//Extract the EXIF from the Metadata
+	attributes->flash = (int) metadata->flash;
+	attributes->iso_speed_rating = metadata->iso;
+	attributes->brightness.num = (int) metadata->brightness;
+	attributes->exposure_bias.num = metadata->exposure_bias;
+	attributes->exposure_time.den = metadata->exposure_time;
+
+	ALOGD("%s: Interleaved pointers array is at offset 0x%x, 0x%x bytes long\n", __func__, pointers_array_offset, pointers_array_size);
+
+	// The pointers array lies between the interleaved data and the metadata
+	metadata_offset = size - S5C73M3_METADATA_LENGTH;
+
+	if (pointers_array_offset > metadata_offset || pointers_array_size > metadata_offset - pointers_array_offset || pointers_array_size < (unsigned int) yuv_height * sizeof(unsigned int)) {
+		ALOGE("%s: Invalid informations", __func__);
+		return -1;
+	}
+
+	pointers_p = (unsigned int *) ((unsigned char *) data + pointers_array_offset);
+	pointers_count = pointers_array_size / sizeof(unsigned int);
+
+	yuv_line_size = yuv_width * 2;
+
+	// Lines can't overlap, so there can't be more of them than what fits
+	if (pointers_count > interleaved_size / yuv_line_size) {
+		ALOGE("%s: Invalid informations", __func__);
+		return -1;
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.data = (unsigned char *) data;
+	job.size = size;
+	job.interleaved_size = interleaved_size;
+	job.pointers = pointers_p;
+	job.offsets = yuv_offsets;
+	job.count = pointers_count;
+	job.line_size = yuv_line_size;
+	job.jpeg_segments = jpeg_segments;
+
+	// Small frames are not worth waking up the workers
+	workers_count = exynos_worker_pool_count(&exynos_camera->capture_workers);
+	ranges_count = (pointers_count * yuv_line_size) / EXYNOS_CAMERA_DECODE_THREAD_MIN_LENGTH;
+
+	if (ranges_count > workers_count)
+		ranges_count = workers_count;
+	if (ranges_count < 1)
+		ranges_count = 1;
+
+	job.ranges_count = ranges_count;
+
+	for (i = 0; i < (unsigned int) ranges_count; i++) {
+		job.ranges[i].start = (pointers_count * i) / ranges_count;
+		job.ranges[i].end = (pointers_count * (i + 1)) / ranges_count;
+	}
+
+	// Walk the pointers array first: nothing is moved until it is validated
+
+	s5c73m3_interleaved_run(exynos_camera, &job, s5c73m3_interleaved_scan);
+
+	segments_count = 0;
+	jpeg_length = 0;
+
+	for (i = 0; i < (unsigned int) ranges_count; i++) {
+		if (job.ranges[i].rc < 0)
+			return -1;
+
+		if (segments_count == 0 && job.ranges[i].segments_count > 0) {
+			jpeg_start_p = (unsigned short *) (job.data + job.ranges[i].first_offset);
+			if (*jpeg_start_p != 0xd8ff) {
+				ALOGE("%s: Invalid jpeg start", __func__);
+				return -1;
+			}
+		}
+
+		job.ranges[i].segments_start = segments_count;
+		job.ranges[i].jpeg_start = jpeg_length;
+
+		segments_count += job.ranges[i].segments_count;
+		jpeg_length += job.ranges[i].jpeg_length;
+	}
+
+	yuv_offset_last = pointers_count > 0 ? yuv_offsets[pointers_count - 1] : 0;
+	gap = interleaved_size - yuv_offset_last - yuv_line_size;
+
+	if (gap > 0) {
+		jpeg_segments[segments_count].offset = yuv_offset_last + yuv_line_size;
+		jpeg_segments[segments_count].length = gap;
+		segments_count++;
+		jpeg_length += gap;
+	}
+
+	job.jpeg_segments_count = segments_count;
+
+	// The JPEG chunks get overwritten by the compacted lines, extract them first
+
+	jpeg_data = jpeg_alloc != NULL && jpeg_length > 0 ? jpeg_alloc(exynos_camera, jpeg_length) : NULL;
+
+	if (jpeg_data != NULL) {
+		job.jpeg_data = (unsigned char *) jpeg_data;
+		s5c73m3_interleaved_run(exynos_camera, &job, s5c73m3_interleaved_extract);
+	} else {
+		segments_count = 0;
+		jpeg_length = 0;
+	}
+
+	/*
+	 * Each line is moved to a lower (or the same) offset than its source, but
+	 * may land on the source of an earlier line. Lines [start, end) can only
+	 * be moved concurrently when none of them reaches the source of line
+	 * start, which is the lowest source that is left.
+	 */
+
+	start = 0;
+
+	while (start < (int) pointers_count) {
+		end = yuv_offsets[start] / yuv_line_size;
+
+		if (end > (int) pointers_count)
+			end = pointers_count;
+		if (end < start + 1)
+			end = start + 1;
+
+		if (ranges_count > 1 && (end - start) * yuv_line_size >= (unsigned int) ranges_count * EXYNOS_CAMERA_DECODE_THREAD_MIN_LENGTH) {
+			job.compact_start = start;
+			job.compact_end = end;
+
+			s5c73m3_interleaved_run(exynos_camera, &job, s5c73m3_interleaved_compact);
+		} else {
+			exynos_gather_rows(job.data + start * yuv_line_size, job.data, yuv_offsets + start, end - start, yuv_line_size);
+		}
+
+		start = end;
+	}
+
+	yuv_length = pointers_count * yuv_line_size;
+
+	*yuv_size = yuv_length;
+	*jpeg_segments_count = segments_count;
+	*jpeg_size = jpeg_length;
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define LOG_TAG "exynos_stage"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+/*
+ * A stage is a thread consuming capture frames from a ring filled by the
+ * capture thread. Rings carry frame indexes and have a single producer (the
+ * capture thread) and a single consumer (the stage thread), so head and tail
+ * are each only written by one side.
+ */
+
+// Ring
+
+int exynos_ring_push(struct exynos_ring *ring, int value)
+{
+	unsigned int head;
+
+	if (ring == NULL)
+		return -EINVAL;
+
+	head = ring->head;
+
+	if (head - ring->tail >= EXYNOS_CAMERA_RING_ENTRIES_COUNT)
+		return -1;
+
+	ring->entries[head % EXYNOS_CAMERA_RING_ENTRIES_COUNT] = value;
+
+	// The entry has to be visible before the head that covers it
+	__sync_synchronize();
+
+	ring->head = head + 1;
+
+	return 0;
+}
+
+int exynos_ring_pop(struct exynos_ring *ring, int *value)
+{
+	unsigned int tail;
+
+	if (ring == NULL || value == NULL)
+		return -EINVAL;
+
+	tail = ring->tail;
+
+	if (tail == ring->head)
+		return -1;
+
+	__sync_synchronize();
+
+	*value = ring->entries[tail % EXYNOS_CAMERA_RING_ENTRIES_COUNT];
+
+	// The entry has to be read before its slot is given back
+	__sync_synchronize();
+
+	ring->tail = tail + 1;
+
+	return 0;
+}
+
+int exynos_ring_count(struct exynos_ring *ring)
+{
+	if (ring == NULL)
+		return 0;
+
+	return (int) (ring->head - ring->tail);
+}
+
+// Stage
+
+void *exynos_stage_thread(void *data)
+{
+	struct exynos_camera *exynos_camera;
+	struct exynos_camera_frame *frame;
+	struct exynos_stage *stage;
+	eventfd_t value;
+	int index;
+	int rc;
+
+	if (data == NULL)
+		return NULL;
+
+	stage = (struct exynos_stage *) data;
+	exynos_camera = stage->exynos_camera;
+
+	while (1) {
+		rc = exynos_ring_pop(&stage->ring, &index);
+		if (rc < 0) {
+			// Frames queued before the stop are processed and released first
+			if (stage->exiting)
+				break;
+
+			// The eventfd counts queued frames and the stop, so no wake-up can be lost
+			eventfd_read(stage->event_fd, &value);
+			continue;
+		}
+
+		if (index < 0 || index >= EXYNOS_CAMERA_CAPTURE_BUFFERS_COUNT)
+			continue;
+
+		frame = &exynos_camera->capture_frames[index];
+
+		rc = stage->process(exynos_camera, frame);
+		if (rc < 0)
+			ALOGE("%s: Unable to process %s frame", __func__, stage->name);
+
+		exynos_camera_frame_release(exynos_camera, frame);
+	}
+
+	return NULL;
+}
+
+int exynos_stage_start(struct exynos_camera *exynos_camera,
+	struct exynos_stage *stage, char *name,
+	int (*process)(struct exynos_camera *exynos_camera,
+		struct exynos_camera_frame *frame))
+{
+	int rc;
+
+	if (exynos_camera == NULL || stage == NULL || process == NULL)
+		return -EINVAL;
+
+	ALOGD("%s(%s)", __func__, name);
+
+	if (stage->enabled) {
+		ALOGE("Stage was already started!");
+		return -1;
+	}
+
+	memset(&stage->ring, 0, sizeof(stage->ring));
+
+	stage->exynos_camera = exynos_camera;
+	stage->name = name;
+	stage->process = process;
+	stage->drops = 0;
+	stage->exiting = 0;
+
+	stage->event_fd = eventfd(0, 0);
+	if (stage->event_fd < 0) {
+		ALOGE("%s: Unable to create eventfd", __func__);
+		goto error;
+	}
+
+	rc = pthread_create(&stage->thread, NULL, exynos_stage_thread, (void *) stage);
+	if (rc != 0) {
+		ALOGE("%s: Unable to create thread", __func__);
+		goto error;
+	}
+
+	stage->enabled = 1;
+
+	rc = 0;
+	goto complete;
+
+error:
+	if (stage->event_fd >= 0) {
+		close(stage->event_fd);
+		stage->event_fd = -1;
+	}
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+void exynos_stage_stop(struct exynos_stage *stage)
+{
+	if (stage == NULL)
+		return;
+
+	ALOGD("%s(%s)", __func__, stage->name);
+
+	if (!stage->enabled) {
+		ALOGE("Stage was already stopped!");
+		return;
+	}
+
+	// The flag has to be visible before the wake-up, a full ring can't hold it back
+	stage->exiting = 1;
+	__sync_synchronize();
+
+	eventfd_write(stage->event_fd, 1);
+
+	pthread_join(stage->thread, NULL);
+
+	close(stage->event_fd);
+	stage->event_fd = -1;
+
+	stage->enabled = 0;
+}
+
+int exynos_stage_queue(struct exynos_stage *stage, int index)
+{
+	int rc;
+
+	if (stage == NULL || index < 0)
+		return -EINVAL;
+
+	if (!stage->enabled)
+		return -1;
+
+	rc = exynos_ring_push(&stage->ring, index);
+	if (rc < 0)
+		return -1;
+
+	eventfd_write(stage->event_fd, 1);
+
+	return 0;
+}
+
+int exynos_stage_pending(struct exynos_stage *stage)
+{
+	if (stage == NULL || !stage->enabled)
+		return 0;
+
+	return exynos_ring_count(&stage->ring);
+}
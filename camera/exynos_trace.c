@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "exynos_trace"
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "exynos_camera.h"
+
+/*
+ * Frames get an id from the capture thread when they are dequeued, which
+ * selects their entry in the trace ring. Stages then stamp the entry with the
+ * time they reach each point, unless it was already reused by a newer frame.
+ * Entries are never locked: the dump skips those that change while copied.
+ */
+
+static char *exynos_trace_points_names[] = {
+	"dqbuf",
+	"decode",
+	"output",
+	"gralloc",
+	"preview callback",
+	"recording callback",
+};
+
+// Point each stage is measured from
+static int exynos_trace_points_previous[] = {
+	-1,
+	EXYNOS_TRACE_DQBUF,
+	EXYNOS_TRACE_DECODE,
+	EXYNOS_TRACE_OUTPUT,
+	EXYNOS_TRACE_GRALLOC,
+	EXYNOS_TRACE_DECODE,
+};
+
+void exynos_trace_reset(struct exynos_trace *trace)
+{
+	if (trace == NULL)
+		return;
+
+	memset(trace, 0, sizeof(struct exynos_trace));
+}
+
+unsigned int exynos_trace_frame(struct exynos_trace *trace)
+{
+	struct exynos_trace_entry *entry;
+	unsigned int id;
+
+	if (trace == NULL)
+		return 0;
+
+	// Id 0 marks unused entries
+	id = ++trace->id;
+	if (id == 0)
+		id = ++trace->id;
+
+	entry = &trace->entries[id % EXYNOS_TRACE_ENTRIES_COUNT];
+
+	entry->id = 0;
+	__sync_synchronize();
+
+	memset(entry->times, 0, sizeof(entry->times));
+	entry->times[EXYNOS_TRACE_DQBUF] = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	__sync_synchronize();
+	entry->id = id;
+
+	return id;
+}
+
+void exynos_trace_point(struct exynos_trace *trace, unsigned int id,
+	enum exynos_trace_point point)
+{
+	struct exynos_trace_entry *entry;
+
+	if (trace == NULL || id == 0 || point <= EXYNOS_TRACE_DQBUF || point >= EXYNOS_TRACE_POINTS_COUNT)
+		return;
+
+	entry = &trace->entries[id % EXYNOS_TRACE_ENTRIES_COUNT];
+	if (entry->id != id)
+		return;
+
+	entry->times[point] = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+// Dump
+
+static void exynos_trace_print(int fd, const char *format, ...)
+{
+	char buffer[256];
+	va_list ap;
+	int length;
+
+	va_start(ap, format);
+	length = vsnprintf(buffer, sizeof(buffer), format, ap);
+	va_end(ap);
+
+	if (length <= 0)
+		return;
+
+	if (length >= (int) sizeof(buffer))
+		length = sizeof(buffer) - 1;
+
+	write(fd, buffer, length);
+}
+
+static int exynos_trace_compare(const void *a, const void *b)
+{
+	int64_t value_a = *((int64_t *) a);
+	int64_t value_b = *((int64_t *) b);
+
+	return value_a < value_b ? -1 : value_a > value_b;
+}
+
+static double exynos_trace_percentile(int64_t *samples, int count, int percentile)
+{
+	return (double) samples[((count - 1) * percentile) / 100] / 1000000.0;
+}
+
+void exynos_trace_dump(struct exynos_trace *trace, int fd)
+{
+	struct exynos_trace_entry entries[EXYNOS_TRACE_ENTRIES_COUNT];
+	int64_t stage[EXYNOS_TRACE_ENTRIES_COUNT];
+	int64_t total[EXYNOS_TRACE_ENTRIES_COUNT];
+	int64_t first, last;
+	int entries_count;
+	int count;
+	int previous;
+	int point;
+	int i;
+
+	if (trace == NULL || fd < 0)
+		return;
+
+	entries_count = 0;
+	first = last = 0;
+
+	for (i = 0; i < EXYNOS_TRACE_ENTRIES_COUNT; i++) {
+		memcpy(&entries[entries_count], &trace->entries[i], sizeof(struct exynos_trace_entry));
+		__sync_synchronize();
+
+		if (entries[entries_count].id == 0 || entries[entries_count].id != trace->entries[i].id)
+			continue;
+
+		if (first == 0 || entries[entries_count].times[EXYNOS_TRACE_DQBUF] < first)
+			first = entries[entries_count].times[EXYNOS_TRACE_DQBUF];
+		if (entries[entries_count].times[EXYNOS_TRACE_DQBUF] > last)
+			last = entries[entries_count].times[EXYNOS_TRACE_DQBUF];
+
+		entries_count++;
+	}
+
+	exynos_trace_print(fd, "Frames trace: %d frames", entries_count);
+	if (entries_count > 1 && last > first)
+		exynos_trace_print(fd, ", %.2f fps", (double) (entries_count - 1) * 1000000000.0 / (double) (last - first));
+	exynos_trace_print(fd, "\n");
+
+	for (point = EXYNOS_TRACE_DQBUF + 1; point < EXYNOS_TRACE_POINTS_COUNT; point++) {
+		count = 0;
+
+		for (i = 0; i < entries_count; i++) {
+			if (entries[i].times[point] == 0)
+				continue;
+
+			// Points that were not reached are skipped, e.g. without a window
+			previous = exynos_trace_points_previous[point];
+			while (previous > EXYNOS_TRACE_DQBUF && entries[i].times[previous] == 0)
+				previous = exynos_trace_points_previous[previous];
+
+			stage[count] = entries[i].times[point] - entries[i].times[previous];
+			total[count] = entries[i].times[point] - entries[i].times[EXYNOS_TRACE_DQBUF];
+			count++;
+		}
+
+		if (count == 0)
+			continue;
+
+		qsort(stage, count, sizeof(int64_t), exynos_trace_compare);
+		qsort(total, count, sizeof(int64_t), exynos_trace_compare);
+
+		exynos_trace_print(fd, "  %s: %d frames, stage p50/p95/p99 %.2f/%.2f/%.2f ms, since dqbuf %.2f/%.2f/%.2f ms\n",
+			exynos_trace_points_names[point], count,
+			exynos_trace_percentile(stage, count, 50), exynos_trace_percentile(stage, count, 95), exynos_trace_percentile(stage, count, 99),
+			exynos_trace_percentile(total, count, 50), exynos_trace_percentile(total, count, 95), exynos_trace_percentile(total, count, 99));
+	}
+}
@@ -79,11 +79,16 @@ int exynos_camera_buffer_length(int width, int height, int format)
 			break;
 		case V4L2_PIX_FMT_NV12:
 		case V4L2_PIX_FMT_NV12T:
+			bpp = 1.5f;
+			buffer_length = EXYNOS_CAMERA_ALIGN(width * height);
+			buffer_length += EXYNOS_CAMERA_ALIGN(width * height / 2);
+			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
+			// Both chroma planes are aligned, see exynos_camera_yuv_planes
 			bpp = 1.5f;
 			buffer_length = EXYNOS_CAMERA_ALIGN(width * height);
-			buffer_length += EXYNOS_CAMERA_ALIGN(width * height / 2);
+			buffer_length += EXYNOS_CAMERA_ALIGN(width * height / 4) * 2;
 			break;
 		case V4L2_PIX_FMT_NV21:
 			bpp = 1.5f;
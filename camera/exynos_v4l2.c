@@ -34,6 +34,7 @@
 
 #define LOG_TAG "exynos_v4l2"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include "exynos_camera.h"
 
@@ -44,6 +45,8 @@ int exynos_v4l2_init(struct exynos_camera *exynos_camera)
 	for (i = 0; i < EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT; i++)
 		exynos_camera->v4l2_fds[i] = -1;
 
+	memset(&exynos_camera->v4l2_sched, 0, sizeof(exynos_camera->v4l2_sched));
+
 	return 0;
 }
 
@@ -134,6 +137,100 @@ void exynos_v4l2_close(struct exynos_camera *exynos_camera, int exynos_v4l2_id)
 	exynos_camera->v4l2_fds[index] = -1;
 }
 
+/*
+ * FIMC instances marked as output in the config are shared by the outputs:
+ * an output asks for its preferred node when it starts, and gets another
+ * free one if that one is held, so that e.g. a picture doesn't have to wait
+ * for the scaler of an other output. Nodes are claimed atomically, since
+ * outputs are started from the stage and picture threads.
+ */
+
+int exynos_v4l2_sched_acquire(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int exynos_v4l2_id)
+{
+	struct exynos_v4l2_sched *sched;
+	struct exynos_v4l2_node *nodes;
+	int count;
+	int index;
+	int i;
+
+	if (exynos_camera == NULL || exynos_camera->config == NULL ||
+		exynos_camera->config->v4l2_nodes == NULL || output == NULL)
+		return -EINVAL;
+
+	sched = &exynos_camera->v4l2_sched;
+	nodes = exynos_camera->config->v4l2_nodes;
+	count = exynos_camera->config->v4l2_nodes_count;
+
+	index = exynos_v4l2_index(exynos_camera, exynos_v4l2_id);
+	if (index >= 0 && nodes[index].output && __sync_bool_compare_and_swap(&sched->owners[index], NULL, output))
+		goto complete;
+
+	for (i = 0; i < count; i++) {
+		if (i == index || !nodes[i].output || nodes[i].node == NULL)
+			continue;
+
+		if (__sync_bool_compare_and_swap(&sched->owners[i], NULL, output))
+			break;
+	}
+
+	if (i == count) {
+		ALOGE("%s: No free output node", __func__);
+		sched->exhausted++;
+		return -1;
+	}
+
+	ALOGD("%s: Node %d is held, using node %d", __func__, exynos_v4l2_id, nodes[i].id);
+	sched->moved++;
+
+	index = i;
+
+complete:
+	sched->acquire_times[index] = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	return nodes[index].id;
+}
+
+void exynos_v4l2_sched_release(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	struct exynos_v4l2_sched *sched;
+	int i;
+
+	if (exynos_camera == NULL || output == NULL)
+		return;
+
+	sched = &exynos_camera->v4l2_sched;
+
+	for (i = 0; i < EXYNOS_CAMERA_MAX_V4L2_NODES_COUNT; i++) {
+		if (sched->owners[i] != output)
+			continue;
+
+		sched->held[i] += systemTime(SYSTEM_TIME_MONOTONIC) - sched->acquire_times[i];
+
+		// The node is accounted for before it can be claimed again
+		__sync_synchronize();
+		sched->owners[i] = NULL;
+	}
+}
+
+void exynos_v4l2_sched_busy(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int64_t time)
+{
+	int index;
+
+	if (exynos_camera == NULL || time < 0)
+		return;
+
+	index = exynos_v4l2_index(exynos_camera, exynos_v4l2_id);
+	if (index < 0)
+		return;
+
+	// Only the output holding the node gets there
+	exynos_camera->v4l2_sched.busy[index] += time;
+	exynos_camera->v4l2_sched.jobs[index]++;
+}
+
 int exynos_v4l2_ioctl(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
 	int request, void *data)
 {
@@ -212,8 +309,8 @@ int exynos_v4l2_qbuf_out(struct exynos_camera *exynos_camera, int exynos_v4l2_id
 		V4L2_MEMORY_USERPTR, index, userptr);
 }
 
-int exynos_v4l2_dqbuf(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
-	int type, int memory)
+int exynos_v4l2_dqbuf_info(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
+	int type, int memory, int64_t *timestamp, unsigned int *sequence)
 {
 	struct v4l2_buffer buffer;
 	int rc;
@@ -229,9 +326,22 @@ int exynos_v4l2_dqbuf(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
 	if (rc < 0)
 		return rc;
 
+	if (timestamp != NULL)
+		*timestamp = (int64_t) buffer.timestamp.tv_sec * 1000000000LL + (int64_t) buffer.timestamp.tv_usec * 1000LL;
+
+	if (sequence != NULL)
+		*sequence = buffer.sequence;
+
 	return buffer.index;
 }
 
+int exynos_v4l2_dqbuf(struct exynos_camera *exynos_camera, int exynos_v4l2_id,
+	int type, int memory)
+{
+	return exynos_v4l2_dqbuf_info(exynos_camera, exynos_v4l2_id, type, memory,
+		NULL, NULL);
+}
+
 int exynos_v4l2_s_ext_ctrl_face_detection(struct exynos_camera *exynos_camera,
 	int id, void *value)
 {
@@ -302,6 +412,13 @@ int exynos_v4l2_dqbuf_cap(struct exynos_camera *exynos_camera,
 		V4L2_MEMORY_MMAP);
 }
 
+int exynos_v4l2_dqbuf_cap_info(struct exynos_camera *exynos_camera,
+	int exynos_v4l2_id, int64_t *timestamp, unsigned int *sequence)
+{
+	return exynos_v4l2_dqbuf_info(exynos_camera, exynos_v4l2_id, V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		V4L2_MEMORY_MMAP, timestamp, sequence);
+}
+
 int exynos_v4l2_dqbuf_out(struct exynos_camera *exynos_camera,
 	int exynos_v4l2_id)
 {
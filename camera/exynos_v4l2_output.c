@@ -30,10 +30,133 @@
 
 #define LOG_TAG "exynos_v4l2_output"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include "exynos_camera.h"
 
-int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
+// FIMC
+
+static int exynos_v4l2_output_fimc_dst(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int address)
+{
+	struct fimc_buf fimc_buffer;
+	int rc;
+
+	memset(&fimc_buffer, 0, sizeof(fimc_buffer));
+
+	exynos_camera_yuv_planes(output->width, output->height, output->format, address, (int *) &fimc_buffer.base[0], (int *) &fimc_buffer.base[1], (int *) &fimc_buffer.base[2]);
+
+	rc = exynos_v4l2_s_ctrl(exynos_camera, output->v4l2_id, V4L2_CID_DST_INFO, (int) &fimc_buffer);
+	if (rc < 0) {
+		ALOGE("%s: Unable to set dst info", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int exynos_v4l2_output_fimc_session_start(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int address)
+{
+	void *fb_base;
+	int width, height, format;
+	int v4l2_id;
+	int rc;
+
+	width = output->width;
+	height = output->height;
+	format = output->format;
+
+	v4l2_id = output->v4l2_id;
+
+	rc = exynos_v4l2_g_fbuf(exynos_camera, v4l2_id, &fb_base, NULL, NULL, NULL);
+	if (rc < 0) {
+		ALOGE("%s: Unable to get fbuf", __func__);
+		return -1;
+	}
+
+	rc = exynos_v4l2_s_fbuf(exynos_camera, v4l2_id, fb_base, width, height, format);
+	if (rc < 0) {
+		ALOGE("%s: Unable to set fbuf", __func__);
+		return -1;
+	}
+
+	rc = exynos_v4l2_output_fimc_dst(exynos_camera, output, address);
+	if (rc < 0)
+		return -1;
+
+	rc = exynos_v4l2_s_fmt_win(exynos_camera, v4l2_id, 0, 0, width, height);
+	if (rc < 0) {
+		ALOGE("%s: Unable to set overlay win", __func__);
+		return -1;
+	}
+
+	rc = exynos_v4l2_streamon_out(exynos_camera, v4l2_id);
+	if (rc < 0) {
+		ALOGE("%s: Unable to start stream", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int exynos_v4l2_output_fimc_qbuf(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int buffer_address)
+{
+	struct fimc_buf fimc_buffer;
+	int rc;
+
+	memset(&fimc_buffer, 0, sizeof(fimc_buffer));
+
+	exynos_camera_yuv_planes(output->buffer_width, output->buffer_height, output->buffer_format, buffer_address, (int *) &fimc_buffer.base[0], (int *) &fimc_buffer.base[1], (int *) &fimc_buffer.base[2]);
+
+	rc = exynos_v4l2_qbuf_out(exynos_camera, output->v4l2_id, 0, (unsigned long) &fimc_buffer);
+	if (rc < 0) {
+		ALOGE("%s: Unable to queue buffer", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int exynos_v4l2_output_fimc_queue(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int buffer_address)
+{
+	int rc;
+
+	rc = exynos_v4l2_output_fimc_qbuf(exynos_camera, output, buffer_address);
+	if (rc < 0)
+		return -1;
+
+	rc = exynos_v4l2_dqbuf_out(exynos_camera, output->v4l2_id);
+	if (rc < 0) {
+		ALOGE("%s: Unable to dequeue buffer", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void exynos_v4l2_output_fimc_stream_stop(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	int rc;
+
+	if (!output->stream_enabled)
+		return;
+
+	rc = exynos_v4l2_streamoff_out(exynos_camera, output->v4l2_id);
+	if (rc < 0)
+		ALOGE("%s: Unable to stop stream", __func__);
+
+	output->stream_enabled = 0;
+	output->stream_address = 0;
+
+	// Stopping the stream gives back a buffer that was still queued
+	output->pending = 0;
+}
+
+static int exynos_v4l2_output_fimc_start(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output)
 {
 	int width, height, format;
@@ -55,11 +178,6 @@ int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
 
 //	ALOGD("%s()", __func__);
 
-	if (output->enabled) {
-		ALOGE("Output was already started");
-		return -1;
-	}
-
 	width = output->width;
 	height = output->height;
 	format = output->format;
@@ -68,16 +186,23 @@ int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
 	buffer_height = output->buffer_height;
 	buffer_format = output->buffer_format;
 
-	v4l2_id = output->v4l2_id;
-
 	buffers_count = output->buffers_count;
 	if (buffers_count <= 0) {
 		ALOGE("%s: Invalid buffers count: %d", __func__, buffers_count);
-		goto error;
+		return -1;
 	}
 
 	buffer_length = exynos_camera_buffer_length(width, height, format);
 
+	// The output id is only a preference, the node actually used is kept
+	v4l2_id = exynos_v4l2_sched_acquire(exynos_camera, output, output->v4l2_id);
+	if (v4l2_id < 0) {
+		ALOGE("%s: Unable to get an output node", __func__);
+		return -1;
+	}
+
+	output->v4l2_id = v4l2_id;
+
 	rc = exynos_v4l2_open(exynos_camera, v4l2_id);
 	if (rc < 0) {
 		ALOGE("%s: Unable to open v4l2 device", __func__);
@@ -202,6 +327,18 @@ int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
 	output->buffers_count = buffers_count;
 	output->buffer_length = buffer_length;
 
+	if (output->streaming) {
+		rc = exynos_v4l2_output_fimc_session_start(exynos_camera, output, memory_address);
+		if (rc < 0) {
+			ALOGE("%s: Unable to start streaming, using a session per frame", __func__);
+			exynos_v4l2_streamoff_out(exynos_camera, v4l2_id);
+			output->streaming = 0;
+		} else {
+			output->stream_enabled = 1;
+			output->stream_address = memory_address;
+		}
+	}
+
 	output->enabled = 1;
 
 	rc = 0;
@@ -219,6 +356,7 @@ error:
 #endif
 
 	exynos_v4l2_close(exynos_camera, v4l2_id);
+	exynos_v4l2_sched_release(exynos_camera, output);
 
 	rc = -1;
 
@@ -226,7 +364,7 @@ complete:
 	return rc;
 }
 
-void exynos_v4l2_output_stop(struct exynos_camera *exynos_camera,
+static void exynos_v4l2_output_fimc_stop(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output)
 {
 	int v4l2_id;
@@ -237,13 +375,10 @@ void exynos_v4l2_output_stop(struct exynos_camera *exynos_camera,
 
 //	ALOGD("%s()", __func__);
 
-	if (!output->enabled) {
-		ALOGE("Output was already stopped");
-		return;
-	}
-
 	v4l2_id = output->v4l2_id;
 
+	exynos_v4l2_output_fimc_stream_stop(exynos_camera, output);
+
 	rc = exynos_v4l2_reqbufs_out(exynos_camera, v4l2_id, 0);
 	if (rc < 0)
 		ALOGE("%s: Unable to request buffers", __func__);
@@ -261,20 +396,39 @@ void exynos_v4l2_output_stop(struct exynos_camera *exynos_camera,
 #endif
 
 	exynos_v4l2_close(exynos_camera, v4l2_id);
+	exynos_v4l2_sched_release(exynos_camera, output);
 
 	output->enabled = 0;
 }
 
-int exynos_v4l2_output(struct exynos_camera *exynos_camera,
-	struct exynos_v4l2_output *output, int buffer_address)
+/*
+ * In streaming mode, the geometry is set and the stream started along with
+ * the output, so that frames only take a queue and dequeue, after the
+ * destination is updated when it changed. Otherwise, or if anything goes
+ * wrong while streaming, a whole session is set up for each frame.
+ */
+
+static int exynos_v4l2_output_fimc_stream_dst(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int address)
+{
+	int rc;
+
+	if (address == output->stream_address)
+		return 0;
+
+	rc = exynos_v4l2_output_fimc_dst(exynos_camera, output, address);
+	if (rc < 0)
+		return -1;
+
+	output->stream_address = address;
+
+	return 0;
+}
+
+static int exynos_v4l2_output_fimc(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, int buffer_address, int dst_address)
 {
-	struct fimc_buf fimc_buffer;
-	void *fb_base;
-	int width, height, format;
-	int buffer_width, buffer_height, buffer_format;
-	int buffer_length;
 	int address;
-	int v4l2_id;
 	int rc;
 
 	if (exynos_camera == NULL || output == NULL)
@@ -282,90 +436,343 @@ int exynos_v4l2_output(struct exynos_camera *exynos_camera,
 
 //	ALOGD("%s()", __func__);
 
-	if (!output->enabled) {
-		ALOGE("Output was not started");
-		return -1;
-	}
+	if (dst_address != 0)
+		address = dst_address;
+	else
+		address = output->memory_address + output->buffer_length * output->memory_index;
 
-	width = output->width;
-	height = output->height;
-	format = output->format;
+	if (output->stream_enabled) {
+		rc = exynos_v4l2_output_fimc_stream_dst(exynos_camera, output, address);
+		if (rc >= 0)
+			rc = exynos_v4l2_output_fimc_queue(exynos_camera, output, buffer_address);
 
-	buffer_width = output->buffer_width;
-	buffer_height = output->buffer_height;
-	buffer_format = output->buffer_format;
+		if (rc >= 0)
+			return 0;
 
-	buffer_length = output->buffer_length;
-	v4l2_id = output->v4l2_id;
+		ALOGE("%s: Unable to output in streaming mode, using a session per frame", __func__);
 
-	rc = exynos_v4l2_g_fbuf(exynos_camera, v4l2_id, &fb_base, NULL, NULL, NULL);
-	if (rc < 0) {
-		ALOGE("%s: Unable to get fbuf", __func__);
-		goto error;
+		exynos_v4l2_output_fimc_stream_stop(exynos_camera, output);
+		output->streaming = 0;
 	}
 
-	rc = exynos_v4l2_s_fbuf(exynos_camera, v4l2_id, fb_base, width, height, format);
+	rc = exynos_v4l2_output_fimc_session_start(exynos_camera, output, address);
+	if (rc < 0)
+		goto error;
+
+	rc = exynos_v4l2_output_fimc_queue(exynos_camera, output, buffer_address);
+	if (rc < 0)
+		goto error;
+
+	rc = exynos_v4l2_streamoff_out(exynos_camera, output->v4l2_id);
 	if (rc < 0) {
-		ALOGE("%s: Unable to set fbuf", __func__);
+		ALOGE("%s: Unable to stop stream", __func__);
 		goto error;
 	}
 
-	memset(&fimc_buffer, 0, sizeof(fimc_buffer));
+	rc = 0;
+	goto complete;
 
-	address = output->memory_address + buffer_length * output->memory_index;
+error:
+	rc = -1;
 
-	exynos_camera_yuv_planes(width, height, format, address, (int *) &fimc_buffer.base[0], (int *) &fimc_buffer.base[1], (int *) &fimc_buffer.base[2]);
+complete:
+	return rc;
+}
 
-	rc = exynos_v4l2_s_ctrl(exynos_camera, v4l2_id, V4L2_CID_DST_INFO, (int) &fimc_buffer);
-	if (rc < 0) {
-		ALOGE("%s: Unable to set dst info", __func__);
-		goto error;
-	}
+// Software
 
-	rc = exynos_v4l2_s_fmt_win(exynos_camera, v4l2_id, 0, 0, width, height);
-	if (rc < 0) {
-		ALOGE("%s: Unable to set overlay win", __func__);
-		goto error;
-	}
+static int exynos_v4l2_output_software_start(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	camera_memory_t *memory = NULL;
+	int buffers_count, buffer_length;
+	int rc;
 
-	rc = exynos_v4l2_streamon_out(exynos_camera, v4l2_id);
-	if (rc < 0) {
-		ALOGE("%s: Unable to start stream", __func__);
+	if (exynos_camera == NULL || output == NULL)
+		return -EINVAL;
+
+	buffers_count = output->buffers_count;
+	if (buffers_count <= 0) {
+		ALOGE("%s: Invalid buffers count: %d", __func__, buffers_count);
 		goto error;
 	}
 
-	memset(&fimc_buffer, 0, sizeof(fimc_buffer));
-
-	exynos_camera_yuv_planes(buffer_width, buffer_height, buffer_format, buffer_address, (int *) &fimc_buffer.base[0], (int *) &fimc_buffer.base[1], (int *) &fimc_buffer.base[2]);
-
-	rc = exynos_v4l2_qbuf_out(exynos_camera, v4l2_id, 0, (unsigned long) &fimc_buffer);
-	if (rc < 0) {
-		ALOGE("%s: Unable to queue buffer", __func__);
+	buffer_length = exynos_camera_buffer_length(output->width, output->height, output->format);
+	if (buffer_length <= 0) {
+		ALOGE("%s: Invalid buffer length", __func__);
 		goto error;
 	}
 
-	rc = exynos_v4l2_dqbuf_out(exynos_camera, v4l2_id);
+	rc = exynos_convert_start(&output->convert, output->buffer_width, output->buffer_height, output->buffer_format, output->width, output->height, output->format, EXYNOS_CAMERA_CONVERT_THREADS_COUNT);
 	if (rc < 0) {
-		ALOGE("%s: Unable to dequeue buffer", __func__);
+		ALOGE("%s: Unable to start convert", __func__);
 		goto error;
 	}
 
-	rc = exynos_v4l2_streamoff_out(exynos_camera, v4l2_id);
-	if (rc < 0) {
-		ALOGE("%s: Unable to stop stream", __func__);
+	if (EXYNOS_CAMERA_CALLBACK_DEFINED(request_memory)) {
+		memory = exynos_camera->callbacks.request_memory(-1, buffer_length, buffers_count, exynos_camera->callbacks.user);
+		if (memory == NULL || memory->data == NULL || memory->data == MAP_FAILED) {
+			ALOGE("%s: Unable to request memory", __func__);
+			goto error;
+		}
+	} else {
+		ALOGE("%s: No memory request function!", __func__);
 		goto error;
 	}
 
+	output->memory = memory;
+	output->memory_address = 0;
+#ifdef EXYNOS_ION
+	output->memory_ion_fd = -1;
+#endif
+	output->memory_index = 0;
+	output->buffers_count = buffers_count;
+	output->buffer_length = buffer_length;
+
+	output->software = 1;
+	output->enabled = 1;
+
 	rc = 0;
 	goto complete;
 
 error:
+	if (memory != NULL && memory->release != NULL)
+		memory->release(memory);
+
+	if (output->convert.enabled)
+		exynos_convert_stop(&output->convert);
+
 	rc = -1;
 
 complete:
 	return rc;
 }
 
+static void exynos_v4l2_output_software_stop(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	if (exynos_camera == NULL || output == NULL)
+		return;
+
+	if (output->memory != NULL && output->memory->release != NULL) {
+		output->memory->release(output->memory);
+		output->memory = NULL;
+	}
+
+	exynos_convert_stop(&output->convert);
+
+	output->software = 0;
+	output->enabled = 0;
+}
+
+static int exynos_v4l2_output_software(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer)
+{
+	void *dst;
+	int rc;
+
+	if (exynos_camera == NULL || output == NULL || buffer == NULL)
+		return -EINVAL;
+
+	if (buffer->pointer == NULL) {
+		ALOGE("%s: Invalid buffer pointer", __func__);
+		return -1;
+	}
+
+	dst = (void *) ((unsigned char *) output->memory->data + output->buffer_length * output->memory_index);
+
+	rc = exynos_convert(&output->convert, buffer->pointer, dst);
+	if (rc < 0) {
+		ALOGE("%s: Unable to convert", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Output
+
+/*
+ * When FIMC cannot be set up and the caller allows it with software_fallback,
+ * the output is converted in software to the output memory instead. There is
+ * no physical address in that case, so it is only suitable for outputs that
+ * are read back from memory.
+ */
+
+int exynos_v4l2_output_start(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	int rc;
+
+	if (exynos_camera == NULL || output == NULL)
+		return -EINVAL;
+
+	if (output->enabled) {
+		ALOGE("Output was already started");
+		return -1;
+	}
+
+	if (!output->software) {
+		rc = exynos_v4l2_output_fimc_start(exynos_camera, output);
+		if (rc >= 0 || !output->software_fallback)
+			return rc;
+
+		ALOGE("%s: Unable to start FIMC output, converting in software", __func__);
+	}
+
+	return exynos_v4l2_output_software_start(exynos_camera, output);
+}
+
+void exynos_v4l2_output_stop(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	if (exynos_camera == NULL || output == NULL)
+		return;
+
+	if (!output->enabled) {
+		ALOGE("Output was already stopped");
+		return;
+	}
+
+	if (output->software)
+		exynos_v4l2_output_software_stop(exynos_camera, output);
+	else
+		exynos_v4l2_output_fimc_stop(exynos_camera, output);
+}
+
+/*
+ * The conversion result goes to the output memory, unless a destination
+ * address is given, e.g. for a buffer of the preview window.
+ */
+
+int exynos_v4l2_output_dst(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer,
+	int dst_address)
+{
+	int64_t time;
+	int rc;
+
+	if (exynos_camera == NULL || output == NULL || buffer == NULL)
+		return -EINVAL;
+
+	if (!output->enabled) {
+		ALOGE("Output was not started");
+		return -1;
+	}
+
+	if (output->pending) {
+		ALOGE("%s: Output has a pending conversion", __func__);
+		return -1;
+	}
+
+	if (output->software) {
+		if (dst_address != 0) {
+			ALOGE("%s: Software output cannot write to a destination address", __func__);
+			return -1;
+		}
+
+		return exynos_v4l2_output_software(exynos_camera, output, buffer);
+	}
+
+	time = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	rc = exynos_v4l2_output_fimc(exynos_camera, output, buffer->address, dst_address);
+
+	exynos_v4l2_sched_busy(exynos_camera, output->v4l2_id, systemTime(SYSTEM_TIME_MONOTONIC) - time);
+
+	return rc;
+}
+
+int exynos_v4l2_output(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer)
+{
+	return exynos_v4l2_output_dst(exynos_camera, output, buffer, 0);
+}
+
+/*
+ * In streaming mode, a conversion can also be split: submit only queues the
+ * source buffer, so that the hardware runs while the caller goes on, and
+ * complete dequeues it once the node is ready. Submit returns 1 when the
+ * conversion is pending and 0 when it was done right away, which is always
+ * the case for software outputs and sessions per frame.
+ */
+
+int exynos_v4l2_output_submit(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output, struct exynos_camera_buffer *buffer,
+	int dst_address)
+{
+	int address;
+	int rc;
+
+	if (exynos_camera == NULL || output == NULL || buffer == NULL)
+		return -EINVAL;
+
+	if (!output->enabled || output->software || !output->stream_enabled || output->pending) {
+		rc = exynos_v4l2_output_dst(exynos_camera, output, buffer, dst_address);
+		if (rc < 0)
+			return -1;
+
+		return 0;
+	}
+
+	if (dst_address != 0)
+		address = dst_address;
+	else
+		address = output->memory_address + output->buffer_length * output->memory_index;
+
+	rc = exynos_v4l2_output_fimc_stream_dst(exynos_camera, output, address);
+	if (rc >= 0)
+		rc = exynos_v4l2_output_fimc_qbuf(exynos_camera, output, buffer->address);
+
+	if (rc < 0) {
+		ALOGE("%s: Unable to submit in streaming mode, using a session per frame", __func__);
+
+		exynos_v4l2_output_fimc_stream_stop(exynos_camera, output);
+		output->streaming = 0;
+
+		rc = exynos_v4l2_output_fimc(exynos_camera, output, buffer->address, dst_address);
+		if (rc < 0)
+			return -1;
+
+		return 0;
+	}
+
+	output->submit_time = systemTime(SYSTEM_TIME_MONOTONIC);
+	output->pending = 1;
+
+	return 1;
+}
+
+int exynos_v4l2_output_complete(struct exynos_camera *exynos_camera,
+	struct exynos_v4l2_output *output)
+{
+	int rc;
+
+	if (exynos_camera == NULL || output == NULL)
+		return -EINVAL;
+
+	if (!output->pending)
+		return 0;
+
+	output->pending = 0;
+
+	rc = exynos_v4l2_dqbuf_out(exynos_camera, output->v4l2_id);
+
+	// That includes the time it took to notice the completion
+	exynos_v4l2_sched_busy(exynos_camera, output->v4l2_id, systemTime(SYSTEM_TIME_MONOTONIC) - output->submit_time);
+
+	if (rc < 0) {
+		ALOGE("%s: Unable to dequeue buffer", __func__);
+
+		exynos_v4l2_output_fimc_stream_stop(exynos_camera, output);
+		output->streaming = 0;
+
+		return -1;
+	}
+
+	return 0;
+}
+
 int exynos_v4l2_output_release(struct exynos_camera *exynos_camera,
 	struct exynos_v4l2_output *output)
 {
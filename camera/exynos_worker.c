@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define LOG_TAG "exynos_worker"
+#include <utils/Log.h>
+
+#include "exynos_camera.h"
+
+/*
+ * The calling thread always takes part 0 of a job, so a pool of N workers
+ * splits each job in N + 1 parts.
+ */
+
+void *exynos_worker_thread(void *data)
+{
+	struct exynos_worker *worker;
+	struct exynos_worker_pool *pool;
+	void (*job)(void *data, int index, int count);
+	void *job_data;
+	int job_count;
+	int sequence;
+
+	if (data == NULL)
+		return NULL;
+
+	worker = (struct exynos_worker *) data;
+	pool = worker->pool;
+
+	// Jobs are counted from the pool start, so none can be missed
+	sequence = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (1) {
+		while (pool->enabled && pool->job_sequence == sequence)
+			pthread_cond_wait(&pool->start_cond, &pool->mutex);
+
+		if (!pool->enabled)
+			break;
+
+		sequence = pool->job_sequence;
+		job = pool->job;
+		job_data = pool->job_data;
+		job_count = pool->workers_count + 1;
+
+		pthread_mutex_unlock(&pool->mutex);
+
+		job(job_data, worker->index + 1, job_count);
+
+		pthread_mutex_lock(&pool->mutex);
+
+		pool->job_pending--;
+		if (pool->job_pending == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+int exynos_worker_pool_start(struct exynos_worker_pool *pool, int count)
+{
+	int rc;
+	int i;
+
+	if (pool == NULL || count <= 0 || count > EXYNOS_CAMERA_MAX_WORKERS_COUNT)
+		return -EINVAL;
+
+	ALOGD("%s(%d)", __func__, count);
+
+	if (pool->enabled) {
+		ALOGE("Worker pool was already started!");
+		return -1;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->start_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	pool->job = NULL;
+	pool->job_data = NULL;
+	pool->job_sequence = 0;
+	pool->job_pending = 0;
+	pool->workers_count = 0;
+	pool->enabled = 1;
+
+	for (i = 0; i < count; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+
+		rc = pthread_create(&pool->workers[i].thread, NULL, exynos_worker_thread, (void *) &pool->workers[i]);
+		if (rc != 0) {
+			ALOGE("%s: Unable to create thread", __func__);
+			goto error;
+		}
+
+		pool->workers_count++;
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	exynos_worker_pool_stop(pool);
+
+	rc = -1;
+
+complete:
+	return rc;
+}
+
+void exynos_worker_pool_stop(struct exynos_worker_pool *pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	ALOGD("%s()", __func__);
+
+	if (!pool->enabled) {
+		ALOGE("Worker pool was already stopped!");
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->enabled = 0;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->workers_count; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	pool->workers_count = 0;
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+int exynos_worker_pool_count(struct exynos_worker_pool *pool)
+{
+	if (pool == NULL || !pool->enabled)
+		return 1;
+
+	return pool->workers_count + 1;
+}
+
+int exynos_worker_pool_run(struct exynos_worker_pool *pool,
+	void (*job)(void *data, int index, int count), void *data)
+{
+	if (job == NULL)
+		return -EINVAL;
+
+	// Without workers, the whole job runs on the calling thread
+	if (pool == NULL || !pool->enabled || pool->workers_count == 0) {
+		job(data, 0, 1);
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->job = job;
+	pool->job_data = data;
+	pool->job_pending = pool->workers_count;
+	pool->job_sequence++;
+
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	job(data, 0, pool->workers_count + 1);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->job_pending > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return 0;
+}
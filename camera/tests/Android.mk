@@ -0,0 +1,47 @@
+#
+# Copyright (C) 2013 Paul Kocialkowski
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Host tests for the camera kernels, built against the stub headers in
+# include: out/host/<os>-x86/bin/exynos_camera_test [-b] [name...]
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	exynos_camera_test.c \
+	exynos_blit_test.c \
+	exynos_convert_test.c \
+	exynos_gather_test.c \
+	exynos_s5c73m3_test.c \
+	../exynos_gather.c \
+	../exynos_s5c73m3.c \
+	../exynos_worker.c \
+	../exynos_utils.c
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/include \
+	$(LOCAL_PATH)/../include \
+	$(LOCAL_PATH)/..
+
+LOCAL_CFLAGS := -DPAGE_SIZE=4096 -DEXYNOS_JPEG_HW
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := exynos_camera_test
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
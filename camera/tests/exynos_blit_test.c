@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+
+/*
+ * The blit is built in here rather than linked, so that its vectorized rows
+ * can be turned off: the scalar ones are the reference for every format,
+ * stride and alignment, and for the throughput.
+ */
+
+#include "../exynos_blit.c"
+
+#include "exynos_camera_test.h"
+
+struct exynos_blit_test_format {
+	int format;
+	char *name;
+};
+
+static struct exynos_blit_test_format exynos_blit_test_formats[] = {
+	{ V4L2_PIX_FMT_NV21, "NV21" },
+	{ V4L2_PIX_FMT_NV12, "NV12" },
+	{ V4L2_PIX_FMT_YUV420, "YV12" },
+	{ V4L2_PIX_FMT_RGB565, "RGB565" },
+	{ V4L2_PIX_FMT_RGB32, "RGBX8888" },
+	{ V4L2_PIX_FMT_UYVY, "UYVY" },
+};
+
+static int exynos_blit_test_formats_count = sizeof(exynos_blit_test_formats) / sizeof(exynos_blit_test_formats[0]);
+
+// Window buffers are either packed or padded to 32 pixels
+static int exynos_blit_test_stride(int width, int padded)
+{
+	return padded ? (width + 32 + 31) & ~31 : width;
+}
+
+static int exynos_blit_test_length(int width, int height)
+{
+	return exynos_camera_buffer_length(exynos_blit_test_stride(width, 1), height, V4L2_PIX_FMT_RGB32) + 0x20000;
+}
+
+int exynos_blit_test(void)
+{
+	int sizes[][2] = { { 176, 144 }, { 162, 90 }, { 320, 240 }, { 642, 482 }, { 1280, 720 } };
+	unsigned char *reference = NULL;
+	unsigned char *dst = NULL;
+	unsigned char *src = NULL;
+	unsigned int seed = 0xb1;
+	int width, height;
+	int dst_offset;
+	int src_offset;
+	int chroma;
+	int stride;
+	int format;
+	int length;
+	int i, j, k;
+	int rc;
+
+	length = exynos_blit_test_length(1280, 720) + 64;
+
+	reference = (unsigned char *) memalign(64, length);
+	dst = (unsigned char *) memalign(64, length);
+	src = (unsigned char *) memalign(64, length);
+
+	if (reference == NULL || dst == NULL || src == NULL)
+		goto error;
+
+	for (i = 0; i < length; i++)
+		src[i] = (unsigned char) exynos_camera_test_random(&seed);
+
+	for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+		width = sizes[i][0];
+		height = sizes[i][1];
+
+		for (j = 0; j < exynos_blit_test_formats_count; j++) {
+			format = exynos_blit_test_formats[j].format;
+
+			for (k = 0; k < 4; k++) {
+				stride = exynos_blit_test_stride(width, k & 1);
+
+				// Aligned buffers are streamed, the others take the unaligned path
+				dst_offset = k & 2 ? exynos_camera_test_random(&seed) % 16 : 0;
+				src_offset = k & 2 ? exynos_camera_test_random(&seed) % 16 : 0;
+
+				// Padding between rows has to be left as it was
+				memset(reference, 0x5a, length);
+				memset(dst, 0x5a, length);
+
+				exynos_blit_simd_enabled = 0;
+				rc = exynos_blit_preview(reference + dst_offset, stride, src + src_offset, width, height, format);
+				if (rc < 0)
+					goto error;
+
+				exynos_blit_simd_enabled = 1;
+				rc = exynos_blit_preview(dst + dst_offset, stride, src + src_offset, width, height, format);
+				if (rc < 0)
+					goto error;
+
+				if (memcmp(reference, dst, length) != 0) {
+					fprintf(stderr, "%s: %s %dx%d, stride %d, offsets %d/%d mismatch\n", __func__, exynos_blit_test_formats[j].name, width, height, stride, dst_offset, src_offset);
+					goto error;
+				}
+			}
+		}
+
+		// Chroma samples swap between NV12 and NV21
+		for (k = 0; k < 2; k++) {
+			stride = exynos_blit_test_stride(width, k);
+
+			memset(reference, 0x5a, length);
+			memset(dst, 0x5a, length);
+
+			exynos_blit_simd_enabled = 0;
+			rc = exynos_blit_preview_format(reference, stride, V4L2_PIX_FMT_NV21, src, width, height, V4L2_PIX_FMT_NV12);
+			if (rc < 0)
+				goto error;
+
+			exynos_blit_simd_enabled = 1;
+			rc = exynos_blit_preview_format(dst, stride, V4L2_PIX_FMT_NV21, src, width, height, V4L2_PIX_FMT_NV12);
+			if (rc < 0)
+				goto error;
+
+			if (memcmp(reference, dst, length) != 0) {
+				fprintf(stderr, "%s: NV12 to NV21 %dx%d, stride %d mismatch\n", __func__, width, height, stride);
+				goto error;
+			}
+
+			// FIMC writes the NV12 chroma plane aligned, after padding
+			chroma = EXYNOS_CAMERA_ALIGN(width * height);
+
+			if (reference[stride * height] != src[chroma + 1] || reference[stride * height + 1] != src[chroma] || reference[stride * (height + height / 2 - 1) + width - 2] != src[chroma + width * (height / 2) - 1]) {
+				fprintf(stderr, "%s: NV12 to NV21 %dx%d chroma not swapped\n", __func__, width, height);
+				goto error;
+			}
+		}
+
+		// Chroma planes are taken where FIMC writes them
+		for (k = 0; k < 2; k++) {
+			format = k ? V4L2_PIX_FMT_NV12 : V4L2_PIX_FMT_NV21;
+			chroma = k ? EXYNOS_CAMERA_ALIGN(width * height) : width * height;
+
+			rc = exynos_blit_preview(dst, width, src, width, height, format);
+			if (rc < 0)
+				goto error;
+
+			if (memcmp(dst + width * height, src + chroma, width * (height / 2)) != 0) {
+				fprintf(stderr, "%s: %s %dx%d chroma taken from the wrong place\n", __func__, k ? "NV12" : "NV21", width, height);
+				goto error;
+			}
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	exynos_blit_simd_enabled = 1;
+
+	if (reference != NULL)
+		free(reference);
+
+	if (dst != NULL)
+		free(dst);
+
+	if (src != NULL)
+		free(src);
+
+	return rc;
+}
+
+static int64_t exynos_blit_benchmark_run(void *dst, int dst_stride, void *src,
+	int width, int height, int format, int count)
+{
+	int64_t time;
+	int i;
+
+	time = exynos_camera_test_time();
+
+	for (i = 0; i < count; i++)
+		exynos_blit_preview(dst, dst_stride, src, width, height, format);
+
+	return exynos_camera_test_time() - time;
+}
+
+void exynos_blit_benchmark(void)
+{
+	int sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+	int64_t time_scalar;
+	int64_t time_simd;
+	void *src = NULL;
+	void *dst = NULL;
+	int width, height;
+	int stride;
+	int length;
+	int count;
+	int i, j, k;
+
+	length = exynos_blit_test_length(1920, 1080);
+	count = 30;
+
+	src = memalign(64, length);
+	dst = memalign(64, length);
+	if (src == NULL || dst == NULL)
+		goto complete;
+
+	memset(src, 0x80, length);
+	memset(dst, 0, length);
+
+	for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+		width = sizes[i][0];
+		height = sizes[i][1];
+
+		for (j = 0; j < exynos_blit_test_formats_count; j++) {
+			for (k = 0; k < 2; k++) {
+				stride = exynos_blit_test_stride(width, k);
+
+				exynos_blit_simd_enabled = 0;
+				time_scalar = exynos_blit_benchmark_run(dst, stride, src, width, height, exynos_blit_test_formats[j].format, count);
+
+				exynos_blit_simd_enabled = 1;
+				time_simd = exynos_blit_benchmark_run(dst, stride, src, width, height, exynos_blit_test_formats[j].format, count);
+
+				if (time_scalar <= 0 || time_simd <= 0)
+					continue;
+
+				length = exynos_camera_buffer_length(width, height, exynos_blit_test_formats[j].format);
+
+				printf("blit: %-8s %4dx%-4d stride %4d: %5lld MB/s portable, %5lld MB/s vectorized\n", exynos_blit_test_formats[j].name, width, height, stride,
+					(long long) ((int64_t) length * count * 1000 / time_scalar), (long long) ((int64_t) length * count * 1000 / time_simd));
+			}
+		}
+	}
+
+complete:
+	exynos_blit_simd_enabled = 1;
+
+	if (src != NULL)
+		free(src);
+
+	if (dst != NULL)
+		free(dst);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "exynos_camera_test.h"
+
+struct exynos_camera_test exynos_camera_tests[] = {
+	{ "blit", exynos_blit_test, exynos_blit_benchmark },
+	{ "convert", exynos_convert_test, exynos_convert_benchmark },
+	{ "gather", exynos_gather_test, NULL },
+	{ "s5c73m3", exynos_s5c73m3_test, exynos_s5c73m3_benchmark },
+};
+
+unsigned int exynos_camera_test_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+
+	return (*seed >> 16) & 0x7fff;
+}
+
+int64_t exynos_camera_test_time(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (int64_t) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/*
+ * Usage: exynos_camera_test [-b] [name...]
+ * All the tests run when no name is given, -b also runs their benchmarks.
+ */
+
+int main(int argc, char *argv[])
+{
+	struct exynos_camera_test *test;
+	int benchmark = 0;
+	int selected;
+	int failed = 0;
+	int count;
+	int rc;
+	int i, j, k;
+
+	count = sizeof(exynos_camera_tests) / sizeof(exynos_camera_tests[0]);
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-b") == 0) {
+			benchmark = 1;
+		} else {
+			fprintf(stderr, "Usage: %s [-b] [name...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	for (j = 0; j < count; j++) {
+		test = &exynos_camera_tests[j];
+
+		selected = i == argc;
+		for (k = i; k < argc; k++)
+			if (strcmp(argv[k], test->name) == 0)
+				selected = 1;
+
+		if (!selected)
+			continue;
+
+		rc = test->test();
+		printf("%s: %s\n", test->name, rc < 0 ? "FAIL" : "PASS");
+
+		if (rc < 0) {
+			failed++;
+			continue;
+		}
+
+		if (benchmark && test->benchmark != NULL)
+			test->benchmark();
+	}
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#ifndef _EXYNOS_CAMERA_TEST_H_
+#define _EXYNOS_CAMERA_TEST_H_
+
+/*
+ * Host tests for the camera kernels: each test checks the vectorized code
+ * against its scalar reference (or the expected result) and may run a
+ * benchmark when asked to.
+ */
+
+struct exynos_camera_test {
+	char *name;
+	int (*test)(void);
+	void (*benchmark)(void);
+};
+
+/*
+ * Utils
+ */
+
+unsigned int exynos_camera_test_random(unsigned int *seed);
+int64_t exynos_camera_test_time(void);
+
+/*
+ * Blit
+ */
+
+int exynos_blit_test(void);
+void exynos_blit_benchmark(void);
+
+/*
+ * Convert
+ */
+
+int exynos_convert_test(void);
+void exynos_convert_benchmark(void);
+
+/*
+ * Gather
+ */
+
+int exynos_gather_test(void);
+
+/*
+ * S5C73M3
+ */
+
+int exynos_s5c73m3_test(void);
+void exynos_s5c73m3_benchmark(void);
+
+#endif
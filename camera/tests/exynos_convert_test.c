@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+
+/*
+ * The conversion is built in here rather than linked, so that its vectorized
+ * kernels can be called directly and turned off: the scalar ones are the
+ * reference, row by row and for whole frames, and for the throughput.
+ */
+
+#include "../exynos_convert.c"
+
+#include "exynos_camera_test.h"
+
+struct exynos_convert_test_case {
+	int src_format;
+	int dst_format;
+	char *name;
+};
+
+static struct exynos_convert_test_case exynos_convert_test_cases[] = {
+	{ V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_NV21, "UYVY to NV21" },
+	{ V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV21, "YUYV to NV21" },
+	{ V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420, "YUYV to YV12" },
+	{ V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_YUYV, "UYVY to YUYV" },
+	{ V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, "NV12 to NV21" },
+	{ V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_RGB565, "NV21 to RGB565" },
+	{ V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_RGB32, "NV21 to RGBX8888" },
+};
+
+static int exynos_convert_test_cases_count = sizeof(exynos_convert_test_cases) / sizeof(exynos_convert_test_cases[0]);
+
+// Rows
+
+static int exynos_convert_test_rows(void)
+{
+#ifdef EXYNOS_CONVERT_SIMD
+	int widths[] = { 2, 16, 34, 176, 322, 1282 };
+	unsigned char *src = NULL;
+	unsigned char *reference = NULL;
+	unsigned char *data = NULL;
+	unsigned int seed = 0x17;
+	int length;
+	int weight;
+	int width;
+	int size;
+	int i, j;
+	int rc;
+
+	size = 4 * widths[sizeof(widths) / sizeof(int) - 1] + 64;
+
+	src = (unsigned char *) malloc(size);
+	reference = (unsigned char *) calloc(1, size);
+	data = (unsigned char *) calloc(1, size);
+
+	if (src == NULL || reference == NULL || data == NULL)
+		goto error;
+
+	for (j = 0; j < (int) (sizeof(widths) / sizeof(int)); j++) {
+		width = widths[j];
+		length = width / 2;
+
+		for (i = 0; i < size; i++)
+			src[i] = (unsigned char) exynos_camera_test_random(&seed);
+
+		for (i = 0; i < 2; i++) {
+			memset(reference, 0, size);
+			memset(data, 0, size);
+
+			exynos_convert_unpack_row_scalar(src, reference, reference + width, reference + width + length, width, i ? V4L2_PIX_FMT_UYVY : V4L2_PIX_FMT_YUYV);
+			exynos_convert_unpack_row_simd(src, data, data + width, data + width + length, width, i ? V4L2_PIX_FMT_UYVY : V4L2_PIX_FMT_YUYV);
+
+			if (memcmp(reference, data, size) != 0) {
+				fprintf(stderr, "%s: Unpack mismatch for %d pixels lines\n", __func__, width);
+				goto error;
+			}
+		}
+
+		exynos_convert_average_row_scalar(reference, src, src + size / 2, length);
+		exynos_convert_average_row_simd(data, src, src + size / 2, length);
+
+		exynos_convert_interleave_row_scalar(reference + length, src, src + length, src + 2 * length, src + 3 * length, length);
+		exynos_convert_interleave_row_simd(data + length, src, src + length, src + 2 * length, src + 3 * length, length);
+
+		if (memcmp(reference, data, size) != 0) {
+			fprintf(stderr, "%s: Chroma mismatch for %d pixels lines\n", __func__, width);
+			goto error;
+		}
+
+		weight = exynos_camera_test_random(&seed) % 255 + 1;
+
+		exynos_convert_blend_row_scalar(reference, src, src + size / 2, weight, width);
+		exynos_convert_blend_row_simd(data, src, src + size / 2, weight, width);
+
+		if (memcmp(reference, data, size) != 0) {
+			fprintf(stderr, "%s: Blend mismatch for %d pixels lines\n", __func__, width);
+			goto error;
+		}
+
+		for (i = 0; i < 2; i++) {
+			exynos_convert_rgb_row_scalar(reference, src, src + width, src + 2 * width, width, i ? V4L2_PIX_FMT_RGB565 : V4L2_PIX_FMT_RGB32);
+			exynos_convert_rgb_row_simd(data, src, src + width, src + 2 * width, width, i ? V4L2_PIX_FMT_RGB565 : V4L2_PIX_FMT_RGB32);
+
+			if (memcmp(reference, data, size) != 0) {
+				fprintf(stderr, "%s: RGB mismatch for %d pixels lines\n", __func__, width);
+				goto error;
+			}
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (src != NULL)
+		free(src);
+
+	if (reference != NULL)
+		free(reference);
+
+	if (data != NULL)
+		free(data);
+
+	return rc;
+#else
+	return 0;
+#endif
+}
+
+// Frames
+
+static int exynos_convert_test_frames(void)
+{
+	int sizes[][4] = {
+		{ 176, 144, 176, 144 },
+		{ 640, 480, 320, 240 },
+		{ 176, 144, 322, 242 },
+		{ 1280, 720, 640, 480 },
+	};
+	struct exynos_convert_test_case *test_case;
+	struct exynos_convert convert;
+	unsigned char *reference = NULL;
+	unsigned char *data = NULL;
+	unsigned char *src = NULL;
+	unsigned int seed = 0xc0;
+	int src_length;
+	int length;
+	int threads;
+	int i, j;
+	int rc;
+
+	memset(&convert, 0, sizeof(convert));
+
+	src_length = 1280 * 720 * 2;
+	length = exynos_camera_buffer_length(640, 480, V4L2_PIX_FMT_RGB32) + 64;
+
+	src = (unsigned char *) malloc(src_length);
+	reference = (unsigned char *) malloc(length);
+	data = (unsigned char *) malloc(length);
+
+	if (src == NULL || reference == NULL || data == NULL)
+		goto error;
+
+	for (i = 0; i < src_length; i++)
+		src[i] = (unsigned char) exynos_camera_test_random(&seed);
+
+	for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+		for (j = 0; j < exynos_convert_test_cases_count; j++) {
+			test_case = &exynos_convert_test_cases[j];
+
+			for (threads = 1; threads <= EXYNOS_CAMERA_CONVERT_THREADS_COUNT; threads++) {
+				rc = exynos_convert_start(&convert, sizes[i][0], sizes[i][1], test_case->src_format, sizes[i][2], sizes[i][3], test_case->dst_format, threads);
+				if (rc < 0) {
+					fprintf(stderr, "%s: Unable to start %s conversion\n", __func__, test_case->name);
+					goto error;
+				}
+
+				// Whatever is past the frame has to be left as it was
+				memset(reference, 0x5a, length);
+				memset(data, 0x5a, length);
+
+				exynos_convert_simd_enabled = 0;
+				exynos_convert(&convert, src, reference);
+
+				exynos_convert_simd_enabled = 1;
+				exynos_convert(&convert, src, data);
+
+				exynos_convert_stop(&convert);
+
+				if (memcmp(reference, data, length) != 0) {
+					fprintf(stderr, "%s: %s %dx%d to %dx%d, %d threads mismatch\n", __func__, test_case->name, sizes[i][0], sizes[i][1], sizes[i][2], sizes[i][3], threads);
+					goto error;
+				}
+			}
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	if (convert.enabled)
+		exynos_convert_stop(&convert);
+
+	rc = -1;
+
+complete:
+	exynos_convert_simd_enabled = 1;
+
+	if (src != NULL)
+		free(src);
+
+	if (reference != NULL)
+		free(reference);
+
+	if (data != NULL)
+		free(data);
+
+	return rc;
+}
+
+int exynos_convert_test(void)
+{
+	int rc;
+
+	rc = exynos_convert_test_rows();
+	if (rc < 0)
+		return -1;
+
+	rc = exynos_convert_test_frames();
+	if (rc < 0)
+		return -1;
+
+	return 0;
+}
+
+// Benchmark
+
+void exynos_convert_benchmark(void)
+{
+	int sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+	struct exynos_convert_test_case *test_case;
+	struct exynos_convert convert;
+	int64_t times[2];
+	void *src = NULL;
+	void *dst = NULL;
+	int width, height;
+	int threads;
+	int scale;
+	int count;
+	int i, j, k, l;
+	int rc;
+
+	src = memalign(64, 1920 * 1080 * 2);
+	dst = memalign(64, exynos_camera_buffer_length(1920, 1080, V4L2_PIX_FMT_RGB32));
+	if (src == NULL || dst == NULL)
+		goto complete;
+
+	memset(src, 0x80, 1920 * 1080 * 2);
+
+	count = 10;
+
+	for (l = 0; l < (int) (sizeof(sizes) / sizeof(sizes[0])); l++) {
+		width = sizes[l][0];
+		height = sizes[l][1];
+
+		for (i = 0; i < exynos_convert_test_cases_count; i++) {
+			test_case = &exynos_convert_test_cases[i];
+
+			// Same size, then half size as for a preview from a larger capture
+			for (scale = 1; scale <= 2; scale++) {
+				for (threads = 1; threads <= EXYNOS_CAMERA_MAX_WORKERS_COUNT + 1; threads += EXYNOS_CAMERA_MAX_WORKERS_COUNT) {
+					memset(&convert, 0, sizeof(convert));
+
+					rc = exynos_convert_start(&convert, width, height, test_case->src_format, width / scale, height / scale, test_case->dst_format, threads);
+					if (rc < 0)
+						continue;
+
+					for (j = 0; j < 2; j++) {
+						exynos_convert_simd_enabled = j;
+
+						times[j] = exynos_camera_test_time();
+						for (k = 0; k < count; k++)
+							exynos_convert(&convert, src, dst);
+						times[j] = (exynos_camera_test_time() - times[j]) / count;
+					}
+
+					exynos_convert_stop(&convert);
+
+					printf("convert: %-16s %4dx%-4d to %4dx%-4d, %d threads: %6lld us reference, %6lld us vectorized\n", test_case->name, width, height, width / scale, height / scale, threads,
+						(long long) (times[0] / 1000), (long long) (times[1] / 1000));
+				}
+			}
+		}
+	}
+
+complete:
+	exynos_convert_simd_enabled = 1;
+
+	if (src != NULL)
+		free(src);
+
+	if (dst != NULL)
+		free(dst);
+}
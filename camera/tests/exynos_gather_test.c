@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "exynos_camera.h"
+#include "exynos_camera_test.h"
+
+/*
+ * The gather is checked against a plain byte by byte reference: swapped
+ * pointers and rows moved in place, lines of any size overlapping the
+ * sources of the next ones.
+ */
+
+static void exynos_gather_test_reference(unsigned char *data,
+	unsigned int *offsets, int count, int line_size)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		memmove(data + i * line_size, data + offsets[i], line_size);
+}
+
+int exynos_gather_test(void)
+{
+	int line_sizes[] = { 1, 6, 15, 16, 17, 64, 100, 1280, 2562 };
+	unsigned char *reference = NULL;
+	unsigned char *data = NULL;
+	unsigned int *pointers = NULL;
+	unsigned int *offsets = NULL;
+	unsigned int seed = 0x2a;
+	unsigned int offset;
+	int line_size;
+	int count;
+	int size;
+	int gap;
+	int i, j;
+	int rc;
+
+	rc = exynos_gather_selftest();
+	if (rc < 0) {
+		fprintf(stderr, "%s: Vectorized gather differs from the scalar one\n", __func__);
+		goto error;
+	}
+
+	exynos_gather_init();
+
+	count = 61;
+	size = count * (line_sizes[sizeof(line_sizes) / sizeof(int) - 1] + 128) + 64;
+
+	reference = (unsigned char *) malloc(size);
+	data = (unsigned char *) malloc(size);
+	pointers = (unsigned int *) calloc(count, sizeof(unsigned int));
+	offsets = (unsigned int *) calloc(count, sizeof(unsigned int));
+
+	if (reference == NULL || data == NULL || pointers == NULL || offsets == NULL)
+		goto error;
+
+	for (j = 0; j < (int) (sizeof(line_sizes) / sizeof(int)); j++) {
+		line_size = line_sizes[j];
+
+		offset = exynos_camera_test_random(&seed) % 64;
+		for (i = 0; i < count; i++) {
+			offsets[i] = offset;
+
+			// Some lines are contiguous, the others leave a gap
+			gap = exynos_camera_test_random(&seed) % 128;
+			if (gap > 64)
+				gap = 0;
+
+			offset += line_size + gap;
+		}
+
+		for (i = 0; i < count; i++)
+			pointers[i] = (offsets[i] & 0xff) << 24 | (offsets[i] & 0xff00) << 8 | (offsets[i] & 0xff0000) >> 8 | (offsets[i] & 0xff000000) >> 24;
+
+		memset(offsets, 0, count * sizeof(unsigned int));
+		exynos_gather_swab32(offsets, pointers, count);
+
+		for (i = 0; i < count; i++) {
+			if (offsets[i] != ((pointers[i] & 0xff) << 24 | (pointers[i] & 0xff00) << 8 | (pointers[i] & 0xff0000) >> 8 | (pointers[i] & 0xff000000) >> 24)) {
+				fprintf(stderr, "%s: Pointer %d swapped wrong\n", __func__, i);
+				goto error;
+			}
+		}
+
+		for (i = 0; i < size; i++)
+			reference[i] = (unsigned char) exynos_camera_test_random(&seed);
+
+		memcpy(data, reference, size);
+
+		exynos_gather_test_reference(reference, offsets, count, line_size);
+		exynos_gather_rows(data, data, offsets, count, line_size);
+
+		if (memcmp(reference, data, size) != 0) {
+			fprintf(stderr, "%s: Rows gather mismatch for %d bytes lines\n", __func__, line_size);
+			goto error;
+		}
+	}
+
+	rc = 0;
+	goto complete;
+
+error:
+	rc = -1;
+
+complete:
+	if (reference != NULL)
+		free(reference);
+
+	if (data != NULL)
+		free(data);
+
+	if (pointers != NULL)
+		free(pointers);
+
+	if (offsets != NULL)
+		free(offsets);
+
+	return rc;
+}
@@ -0,0 +1,679 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "exynos_camera.h"
+#include "exynos_camera_test.h"
+
+/*
+ * Synthetic S5C73M3 interleaved frames: YUV lines starting at offset 0, each
+ * followed by a JPEG chunk, then the big endian pointers array and the
+ * metadata block at the end, written with the default layout. The decoded
+ * lines and JPEG are checked against what was laid out, and malformed
+ * frames must be rejected without any access outside of the buffers.
+ */
+
+extern struct s5c73m3_metadata_layout s5c73m3_metadata_layouts[];
+
+#define EXYNOS_S5C73M3_TEST_GUARD_LENGTH	64
+#define EXYNOS_S5C73M3_TEST_GUARD		0xa5
+#define EXYNOS_S5C73M3_TEST_FUZZ_COUNT		4000
+
+struct exynos_s5c73m3_test_resolution {
+	int width;
+	int height;
+	int snapshot_width;
+	int snapshot_height;
+};
+
+// Sizes of exynos_camera_videosnapshot_resolutions_s5c73m3
+struct exynos_s5c73m3_test_resolution exynos_s5c73m3_test_resolutions[] = {
+	{ 1920, 1080,	3264, 1836 },
+	{ 1280, 720,	3264, 1836 },
+	{ 720, 480,	3264, 2176 },
+	{ 640, 480,	3264, 2488 },
+	{ 352, 288,	3264, 2488 },
+	{ 320, 240,	3264, 2488 },
+	{ 176, 144,	3264, 2488 },
+};
+
+struct exynos_s5c73m3_test_frame {
+	int width;
+	int height;
+
+	unsigned char *data;
+	int size;
+	unsigned int *offsets;
+
+	unsigned char *yuv;
+	int yuv_length;
+	unsigned char *jpeg;
+	int jpeg_length;
+
+	int interleaved_size;
+	int pointers_offset;
+	int pointers_size;
+
+	struct s5c73m3_metadata_face faces[S5C73M3_METADATA_FACES_COUNT];
+	int faces_count;
+
+	camera_face_t decoded_faces[S5C73M3_METADATA_FACES_COUNT];
+	int decoded_faces_count;
+};
+
+static unsigned char *exynos_s5c73m3_test_jpeg_data = NULL;
+static int exynos_s5c73m3_test_jpeg_length = 0;
+
+// Buffers are followed by guard bytes, so that overflows are seen without ASan
+
+static void *exynos_s5c73m3_test_alloc(int length)
+{
+	unsigned char *data;
+
+	data = (unsigned char *) malloc(length + EXYNOS_S5C73M3_TEST_GUARD_LENGTH);
+	if (data == NULL)
+		return NULL;
+
+	memset(data + length, EXYNOS_S5C73M3_TEST_GUARD, EXYNOS_S5C73M3_TEST_GUARD_LENGTH);
+
+	return data;
+}
+
+static int exynos_s5c73m3_test_guard_check(unsigned char *data, int length)
+{
+	int i;
+
+	for (i = 0; i < EXYNOS_S5C73M3_TEST_GUARD_LENGTH; i++)
+		if (data[length + i] != EXYNOS_S5C73M3_TEST_GUARD)
+			return -1;
+
+	return 0;
+}
+
+static void *exynos_s5c73m3_test_jpeg_alloc(struct exynos_camera *exynos_camera,
+	int length)
+{
+	if (exynos_s5c73m3_test_jpeg_data != NULL)
+		free(exynos_s5c73m3_test_jpeg_data);
+
+	exynos_s5c73m3_test_jpeg_data = (unsigned char *) exynos_s5c73m3_test_alloc(length);
+	exynos_s5c73m3_test_jpeg_length = exynos_s5c73m3_test_jpeg_data != NULL ? length : 0;
+
+	return exynos_s5c73m3_test_jpeg_data;
+}
+
+static void exynos_s5c73m3_test_jpeg_free(void)
+{
+	if (exynos_s5c73m3_test_jpeg_data != NULL)
+		free(exynos_s5c73m3_test_jpeg_data);
+
+	exynos_s5c73m3_test_jpeg_data = NULL;
+	exynos_s5c73m3_test_jpeg_length = 0;
+}
+
+static void exynos_s5c73m3_test_be32(unsigned char *p, unsigned int value)
+{
+	p[0] = (value >> 24) & 0xff;
+	p[1] = (value >> 16) & 0xff;
+	p[2] = (value >> 8) & 0xff;
+	p[3] = value & 0xff;
+}
+
+// Fields are found by their place in struct s5c73m3_metadata, arrays included
+static void exynos_s5c73m3_test_metadata_set(unsigned char *block,
+	int metadata_offset, unsigned int value)
+{
+	struct s5c73m3_metadata_layout *layout;
+	struct s5c73m3_metadata_field *field;
+	unsigned char *p;
+	int size;
+	int i;
+
+	layout = &s5c73m3_metadata_layouts[0];
+
+	for (i = 0; i < layout->fields_count; i++) {
+		field = &layout->fields[i];
+
+		size = field->type == S5C73M3_METADATA_U8 ? 1 : field->type == S5C73M3_METADATA_LE16 ? 2 : 4;
+		if (metadata_offset < field->metadata_offset || metadata_offset >= field->metadata_offset + field->count * size)
+			continue;
+
+		p = block + field->offset + metadata_offset - field->metadata_offset;
+
+		switch (field->type) {
+			case S5C73M3_METADATA_U8:
+				p[0] = value & 0xff;
+				break;
+			case S5C73M3_METADATA_LE16:
+				p[0] = value & 0xff;
+				p[1] = (value >> 8) & 0xff;
+				break;
+			case S5C73M3_METADATA_BE32:
+				exynos_s5c73m3_test_be32(p, value);
+				break;
+		}
+	}
+}
+
+static void exynos_s5c73m3_test_frame_pointers(struct exynos_s5c73m3_test_frame *frame,
+	unsigned int pointers_offset, unsigned int pointers_size)
+{
+	unsigned char *block;
+
+	block = frame->data + frame->size - S5C73M3_METADATA_LENGTH;
+
+	exynos_s5c73m3_test_metadata_set(block, offsetof(struct s5c73m3_metadata, pointers_array_offset), pointers_offset);
+	exynos_s5c73m3_test_metadata_set(block, offsetof(struct s5c73m3_metadata, pointers_array_size), pointers_size);
+}
+
+static void exynos_s5c73m3_test_frame_free(struct exynos_s5c73m3_test_frame *frame)
+{
+	if (frame->data != NULL)
+		free(frame->data);
+
+	if (frame->offsets != NULL)
+		free(frame->offsets);
+
+	if (frame->yuv != NULL)
+		free(frame->yuv);
+
+	if (frame->jpeg != NULL)
+		free(frame->jpeg);
+
+	memset(frame, 0, sizeof(struct exynos_s5c73m3_test_frame));
+}
+
+static int exynos_s5c73m3_test_frame_create(struct exynos_s5c73m3_test_frame *frame,
+	int width, int height, int jpeg_length, unsigned int *seed)
+{
+	unsigned char *block;
+	unsigned char *yuv_p;
+	unsigned char *jpeg_p;
+	int line_size;
+	int chunk;
+	int left;
+	int offset;
+	int i, j;
+
+	memset(frame, 0, sizeof(struct exynos_s5c73m3_test_frame));
+
+	line_size = width * 2;
+
+	frame->width = width;
+	frame->height = height;
+	frame->yuv_length = line_size * height;
+	frame->jpeg_length = jpeg_length;
+	frame->interleaved_size = frame->yuv_length + jpeg_length;
+	frame->pointers_offset = frame->interleaved_size;
+	frame->pointers_size = height * sizeof(unsigned int);
+
+	// The driver buffer has some room between the pointers and the metadata
+	frame->size = frame->pointers_offset + frame->pointers_size + 256 + S5C73M3_METADATA_LENGTH;
+
+	frame->data = (unsigned char *) exynos_s5c73m3_test_alloc(frame->size);
+	frame->offsets = (unsigned int *) calloc(height, sizeof(unsigned int));
+	frame->yuv = (unsigned char *) malloc(frame->yuv_length);
+	frame->jpeg = (unsigned char *) malloc(jpeg_length);
+
+	if (frame->data == NULL || frame->offsets == NULL || frame->yuv == NULL || frame->jpeg == NULL)
+		goto error;
+
+	memset(frame->data, 0, frame->size);
+
+	for (i = 0; i < frame->yuv_length; i++)
+		frame->yuv[i] = (unsigned char) exynos_camera_test_random(seed);
+
+	for (i = 0; i < jpeg_length; i++)
+		frame->jpeg[i] = (unsigned char) exynos_camera_test_random(seed);
+
+	frame->jpeg[0] = 0xff;
+	frame->jpeg[1] = 0xd8;
+
+	yuv_p = frame->yuv;
+	jpeg_p = frame->jpeg;
+	left = jpeg_length;
+	offset = 0;
+
+	for (i = 0; i < height; i++) {
+		frame->offsets[i] = offset;
+		memcpy(frame->data + offset, yuv_p, line_size);
+		yuv_p += line_size;
+		offset += line_size;
+
+		// Uneven chunks, some lines are contiguous, the last one takes the rest
+		if (i == height - 1) {
+			chunk = left;
+		} else {
+			chunk = (int) (exynos_camera_test_random(seed) % ((2 * jpeg_length) / height + 1));
+			if (exynos_camera_test_random(seed) % 8 == 0)
+				chunk = 0;
+			if (chunk > left)
+				chunk = left;
+		}
+
+		memcpy(frame->data + offset, jpeg_p, chunk);
+		jpeg_p += chunk;
+		offset += chunk;
+		left -= chunk;
+	}
+
+	for (i = 0; i < height; i++)
+		exynos_s5c73m3_test_be32(frame->data + frame->pointers_offset + i * sizeof(unsigned int), frame->offsets[i]);
+
+	block = frame->data + frame->size - S5C73M3_METADATA_LENGTH;
+
+	exynos_s5c73m3_test_metadata_set(block, offsetof(struct s5c73m3_metadata, decoded), 1);
+	exynos_s5c73m3_test_frame_pointers(frame, frame->pointers_offset, frame->pointers_size);
+
+	frame->faces_count = exynos_camera_test_random(seed) % 4;
+	exynos_s5c73m3_test_metadata_set(block, offsetof(struct s5c73m3_metadata, faces_count), frame->faces_count);
+
+	for (i = 0; i < frame->faces_count * 6; i++) {
+		((short *) frame->faces)[i] = (short) exynos_camera_test_random(seed);
+		exynos_s5c73m3_test_metadata_set(block, offsetof(struct s5c73m3_metadata, faces) + i * sizeof(short), (unsigned short) ((short *) frame->faces)[i]);
+	}
+
+	for (j = 0; j < EXYNOS_S5C73M3_TEST_GUARD_LENGTH; j++)
+		frame->data[frame->size + j] = EXYNOS_S5C73M3_TEST_GUARD;
+
+	return 0;
+
+error:
+	exynos_s5c73m3_test_frame_free(frame);
+
+	return -1;
+}
+
+static int exynos_s5c73m3_test_decode(struct exynos_camera *exynos_camera,
+	struct exynos_s5c73m3_test_frame *frame, unsigned char *data, int jpeg,
+	int *yuv_size, int *jpeg_size)
+{
+	struct exynos_camera_jpeg_segment *jpeg_segments;
+	unsigned int *yuv_offsets;
+	struct exynos_exif exif;
+	int jpeg_segments_count;
+	int auto_focus_result;
+	int decoded;
+	int rc;
+
+	yuv_offsets = (unsigned int *) calloc(frame->size / (frame->width * 2), sizeof(unsigned int));
+	jpeg_segments = (struct exynos_camera_jpeg_segment *) calloc(frame->size / (frame->width * 2) + 1, sizeof(struct exynos_camera_jpeg_segment));
+
+	if (yuv_offsets == NULL || jpeg_segments == NULL) {
+		rc = -1;
+		goto complete;
+	}
+
+	memset(&exif, 0, sizeof(exif));
+
+	rc = s5c73m3_interleaved_decode(exynos_camera, data, frame->size, yuv_size, frame->width, frame->height, yuv_offsets, jpeg_segments, &jpeg_segments_count, jpeg ? exynos_s5c73m3_test_jpeg_alloc : NULL, jpeg_size, &decoded, &auto_focus_result, frame->decoded_faces, &frame->decoded_faces_count, &exif);
+
+complete:
+	if (yuv_offsets != NULL)
+		free(yuv_offsets);
+
+	if (jpeg_segments != NULL)
+		free(jpeg_segments);
+
+	return rc;
+}
+
+static struct exynos_camera *exynos_s5c73m3_test_camera(void)
+{
+	struct exynos_camera *exynos_camera;
+
+	exynos_camera = (struct exynos_camera *) calloc(1, sizeof(struct exynos_camera));
+	if (exynos_camera == NULL)
+		return NULL;
+
+	exynos_camera->capture_metadata_layout = &s5c73m3_metadata_layouts[0];
+	exynos_camera->max_detected_faces = S5C73M3_METADATA_FACES_COUNT;
+
+	return exynos_camera;
+}
+
+static int exynos_s5c73m3_test_jpeg_size(struct exynos_s5c73m3_test_resolution *resolution)
+{
+	// About what the sensor outputs for a detailed scene
+	return resolution->snapshot_width * resolution->snapshot_height / 4;
+}
+
+// Valid frames, decoded serially and on the worker pool
+
+static int exynos_s5c73m3_test_valid(struct exynos_camera *exynos_camera,
+	unsigned int *seed)
+{
+	struct exynos_s5c73m3_test_resolution *resolution;
+	struct exynos_s5c73m3_test_frame frame;
+	int yuv_size;
+	int jpeg_size;
+	int count;
+	int rc;
+	int i, j, k;
+
+	count = sizeof(exynos_s5c73m3_test_resolutions) / sizeof(exynos_s5c73m3_test_resolutions[0]);
+
+	for (i = 0; i < count; i++) {
+		resolution = &exynos_s5c73m3_test_resolutions[i];
+
+		rc = exynos_s5c73m3_test_frame_create(&frame, resolution->width, resolution->height, exynos_s5c73m3_test_jpeg_size(resolution), seed);
+		if (rc < 0)
+			return -1;
+
+		for (j = 0; j < 2; j++) {
+			if (j > 0) {
+				// Restore the interleaved data, the decode compacted it in place
+				exynos_s5c73m3_test_frame_free(&frame);
+				rc = exynos_s5c73m3_test_frame_create(&frame, resolution->width, resolution->height, exynos_s5c73m3_test_jpeg_size(resolution), seed);
+				if (rc < 0)
+					return -1;
+			}
+
+			rc = exynos_s5c73m3_test_decode(exynos_camera, &frame, frame.data, j == 0, &yuv_size, &jpeg_size);
+			if (rc < 0) {
+				fprintf(stderr, "%s: Unable to decode %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			if (yuv_size != frame.yuv_length || memcmp(frame.data, frame.yuv, frame.yuv_length) != 0) {
+				fprintf(stderr, "%s: YUV mismatch for %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			if (j == 0 && (jpeg_size != frame.jpeg_length || exynos_s5c73m3_test_jpeg_length != frame.jpeg_length || memcmp(exynos_s5c73m3_test_jpeg_data, frame.jpeg, frame.jpeg_length) != 0 || exynos_s5c73m3_test_guard_check(exynos_s5c73m3_test_jpeg_data, exynos_s5c73m3_test_jpeg_length) < 0)) {
+				fprintf(stderr, "%s: JPEG mismatch for %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			for (k = 0; k < frame.faces_count; k++)
+				if (frame.decoded_faces[k].rect[0] != frame.faces[k].rect[0] || frame.decoded_faces[k].rect[3] != frame.faces[k].rect[3] || frame.decoded_faces[k].score != frame.faces[k].score || frame.decoded_faces[k].id != frame.faces[k].id)
+					break;
+
+			if (frame.decoded_faces_count != frame.faces_count || k < frame.faces_count) {
+				fprintf(stderr, "%s: Faces mismatch for %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			if (j == 1 && jpeg_size != 0) {
+				fprintf(stderr, "%s: JPEG extracted without a destination for %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			if (exynos_s5c73m3_test_guard_check(frame.data, frame.size) < 0) {
+				fprintf(stderr, "%s: Write past the %dx%d frame\n", __func__, resolution->width, resolution->height);
+				goto error;
+			}
+
+			exynos_s5c73m3_test_jpeg_free();
+		}
+
+		exynos_s5c73m3_test_frame_free(&frame);
+	}
+
+	return 0;
+
+error:
+	exynos_s5c73m3_test_jpeg_free();
+	exynos_s5c73m3_test_frame_free(&frame);
+
+	return -1;
+}
+
+// Malformed pointers tables and metadata, which must be rejected or stay in bounds
+
+static void exynos_s5c73m3_test_mutate(struct exynos_s5c73m3_test_frame *frame,
+	int kind, unsigned int *seed)
+{
+	unsigned char *pointers;
+	unsigned char *block;
+	unsigned int value;
+	int line_size;
+	int index;
+	int i;
+
+	pointers = frame->data + frame->pointers_offset;
+	block = frame->data + frame->size - S5C73M3_METADATA_LENGTH;
+	line_size = frame->width * 2;
+	index = exynos_camera_test_random(seed) % frame->height;
+	value = exynos_camera_test_random(seed) << 17 ^ exynos_camera_test_random(seed) << 2 ^ exynos_camera_test_random(seed);
+
+	switch (kind) {
+		case 0:
+			// Random pointer
+			exynos_s5c73m3_test_be32(pointers + index * sizeof(unsigned int), value);
+			break;
+		case 1:
+			// Lines overlapping the previous one
+			if (index == 0)
+				index = 1;
+			exynos_s5c73m3_test_be32(pointers + index * sizeof(unsigned int), frame->offsets[index - 1] + line_size - 1 - value % line_size);
+			break;
+		case 2:
+			// Lines going backwards
+			for (i = index; i < frame->height; i++)
+				exynos_s5c73m3_test_be32(pointers + i * sizeof(unsigned int), frame->offsets[frame->height - 1 - i + index]);
+			break;
+		case 3:
+			// Lines ending past the interleaved data, or wrapping around
+			exynos_s5c73m3_test_be32(pointers + index * sizeof(unsigned int), value % 2 ? 0xffffffff - value % line_size : frame->interleaved_size - line_size + 1 + value % line_size);
+			break;
+		case 4:
+			// Pointers array anywhere, possibly over the metadata
+			exynos_s5c73m3_test_frame_pointers(frame, value % (frame->size + 64), frame->pointers_size);
+			break;
+		case 5:
+			// Pointers array of any size, possibly wrapping around
+			exynos_s5c73m3_test_frame_pointers(frame, frame->pointers_offset, value % 2 ? 0xffffffff - value % 16 : value % (frame->pointers_size * 2 + 1));
+			break;
+		case 6:
+			// No JPEG start marker
+			frame->data[line_size] ^= 0x01;
+			break;
+		case 7:
+			// Random metadata bytes
+			for (i = 0; i < 32; i++)
+				block[exynos_camera_test_random(seed) % S5C73M3_METADATA_LENGTH] = (unsigned char) exynos_camera_test_random(seed);
+			break;
+		default:
+			// Random pointers array
+			for (i = 0; i < frame->height; i++)
+				if (exynos_camera_test_random(seed) % 4 == 0)
+					exynos_s5c73m3_test_be32(pointers + i * sizeof(unsigned int), exynos_camera_test_random(seed) << 17 ^ exynos_camera_test_random(seed));
+			break;
+	}
+}
+
+static int exynos_s5c73m3_test_fuzz(struct exynos_camera *exynos_camera,
+	unsigned int *seed)
+{
+	struct exynos_s5c73m3_test_resolution *resolution;
+	struct exynos_s5c73m3_test_frame frame;
+	int yuv_size;
+	int jpeg_size;
+	int rejected = 0;
+	int count;
+	int kind;
+	int rc;
+	int i;
+
+	memset(&frame, 0, sizeof(frame));
+
+	count = sizeof(exynos_s5c73m3_test_resolutions) / sizeof(exynos_s5c73m3_test_resolutions[0]);
+
+	for (i = 0; i < EXYNOS_S5C73M3_TEST_FUZZ_COUNT; i++) {
+		// Mostly the small sizes, which are faster to build
+		resolution = &exynos_s5c73m3_test_resolutions[i % 16 == 0 ? (i / 16) % count : count - 1 - i % 3];
+		kind = i % 9;
+
+		rc = exynos_s5c73m3_test_frame_create(&frame, resolution->width, resolution->height, resolution->width * resolution->height / 8, seed);
+		if (rc < 0)
+			return -1;
+
+		exynos_s5c73m3_test_mutate(&frame, kind, seed);
+
+		yuv_size = jpeg_size = 0;
+
+		rc = exynos_s5c73m3_test_decode(exynos_camera, &frame, frame.data, i % 2 == 0, &yuv_size, &jpeg_size);
+		if (rc < 0) {
+			rejected++;
+		} else if (yuv_size < 0 || yuv_size > frame.interleaved_size || jpeg_size < 0 || jpeg_size > frame.interleaved_size) {
+			fprintf(stderr, "%s: Case %d (kind %d) decoded out of bounds sizes\n", __func__, i, kind);
+			goto error;
+		}
+
+		if (exynos_s5c73m3_test_guard_check(frame.data, frame.size) < 0 || (exynos_s5c73m3_test_jpeg_data != NULL && exynos_s5c73m3_test_guard_check(exynos_s5c73m3_test_jpeg_data, exynos_s5c73m3_test_jpeg_length) < 0)) {
+			fprintf(stderr, "%s: Case %d (kind %d) wrote out of bounds\n", __func__, i, kind);
+			goto error;
+		}
+
+		exynos_s5c73m3_test_jpeg_free();
+		exynos_s5c73m3_test_frame_free(&frame);
+	}
+
+	printf("s5c73m3: %d malformed frames, %d rejected\n", EXYNOS_S5C73M3_TEST_FUZZ_COUNT, rejected);
+
+	return 0;
+
+error:
+	exynos_s5c73m3_test_jpeg_free();
+	exynos_s5c73m3_test_frame_free(&frame);
+
+	return -1;
+}
+
+int exynos_s5c73m3_test(void)
+{
+	struct exynos_camera *exynos_camera;
+	unsigned int seed = 0x73;
+	int rc;
+
+	exynos_gather_init();
+
+	exynos_camera = exynos_s5c73m3_test_camera();
+	if (exynos_camera == NULL)
+		return -1;
+
+	rc = exynos_s5c73m3_test_valid(exynos_camera, &seed);
+	if (rc < 0)
+		goto complete;
+
+	rc = exynos_s5c73m3_test_fuzz(exynos_camera, &seed);
+	if (rc < 0)
+		goto complete;
+
+	// Same again, with the ranges split over the workers
+	rc = exynos_worker_pool_start(&exynos_camera->capture_workers, EXYNOS_CAMERA_DECODE_THREADS_COUNT - 1);
+	if (rc < 0)
+		goto complete;
+
+	rc = exynos_s5c73m3_test_valid(exynos_camera, &seed);
+	if (rc < 0)
+		goto complete;
+
+	rc = exynos_s5c73m3_test_fuzz(exynos_camera, &seed);
+
+complete:
+	if (exynos_camera->capture_workers.enabled)
+		exynos_worker_pool_stop(&exynos_camera->capture_workers);
+
+	free(exynos_camera);
+
+	return rc;
+}
+
+void exynos_s5c73m3_benchmark(void)
+{
+	struct exynos_s5c73m3_test_resolution *resolution;
+	struct exynos_s5c73m3_test_frame frame;
+	struct exynos_camera *exynos_camera;
+	unsigned char *data = NULL;
+	unsigned int seed = 0x73;
+	int64_t time;
+	int64_t times[2];
+	int yuv_size;
+	int jpeg_size;
+	int iterations;
+	int threads;
+	int count;
+	int rc;
+	int i, j, k;
+
+	exynos_gather_init();
+
+	exynos_camera = exynos_s5c73m3_test_camera();
+	if (exynos_camera == NULL)
+		return;
+
+	count = sizeof(exynos_s5c73m3_test_resolutions) / sizeof(exynos_s5c73m3_test_resolutions[0]);
+	iterations = 20;
+
+	for (threads = 1; threads <= EXYNOS_CAMERA_DECODE_THREADS_COUNT; threads += EXYNOS_CAMERA_DECODE_THREADS_COUNT - 1) {
+		if (threads > 1) {
+			rc = exynos_worker_pool_start(&exynos_camera->capture_workers, threads - 1);
+			if (rc < 0)
+				break;
+		}
+
+		for (i = 0; i < count; i++) {
+			resolution = &exynos_s5c73m3_test_resolutions[i];
+
+			rc = exynos_s5c73m3_test_frame_create(&frame, resolution->width, resolution->height, exynos_s5c73m3_test_jpeg_size(resolution), &seed);
+			if (rc < 0)
+				break;
+
+			data = (unsigned char *) malloc(frame.size);
+			if (data == NULL) {
+				exynos_s5c73m3_test_frame_free(&frame);
+				break;
+			}
+
+			// Without then with the JPEG, the frame is restored before each decode:
+			// throughput is given for the bytes that were walked through
+			for (j = 0; j < 2; j++) {
+				times[j] = 0;
+
+				for (k = 0; k < iterations; k++) {
+					memcpy(data, frame.data, frame.size);
+
+					time = exynos_camera_test_time();
+					exynos_s5c73m3_test_decode(exynos_camera, &frame, data, j, &yuv_size, &jpeg_size);
+					times[j] += exynos_camera_test_time() - time;
+
+					exynos_s5c73m3_test_jpeg_free();
+				}
+
+				times[j] /= iterations;
+			}
+
+			printf("s5c73m3: %4dx%-4d %d threads: %8lld ns/frame (%.2f GB/s), %8lld ns/frame with JPEG (%.2f GB/s)\n",
+				resolution->width, resolution->height, threads,
+				(long long) times[0], (double) frame.yuv_length / times[0],
+				(long long) times[1], (double) frame.interleaved_size / times[1]);
+
+			free(data);
+			exynos_s5c73m3_test_frame_free(&frame);
+		}
+
+		if (exynos_camera->capture_workers.enabled)
+			exynos_worker_pool_stop(&exynos_camera->capture_workers);
+	}
+
+	free(exynos_camera);
+}
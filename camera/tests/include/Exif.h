@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: only what the camera sources under test need.
+ */
+
+#ifndef _STUB_EXIF_H_
+#define _STUB_EXIF_H_
+
+typedef struct {
+	unsigned int num;
+	unsigned int den;
+} rational_t;
+
+typedef struct {
+	int num;
+	int den;
+} srational_t;
+
+typedef struct {
+	unsigned short flash;
+	unsigned short iso_speed_rating;
+	srational_t brightness;
+	srational_t exposure_bias;
+	rational_t exposure_time;
+} exif_attribute_t;
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: properties always take their default value.
+ */
+
+#ifndef _STUB_PROPERTIES_H_
+#define _STUB_PROPERTIES_H_
+
+#include <string.h>
+
+#define PROPERTY_VALUE_MAX	92
+
+static inline int property_get(const char *key, char *value,
+	const char *default_value)
+{
+	strncpy(value, default_value != NULL ? default_value : "", PROPERTY_VALUE_MAX - 1);
+	value[PROPERTY_VALUE_MAX - 1] = '\0';
+
+	return strlen(value);
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: only what the camera sources under test need.
+ */
+
+#ifndef _STUB_CAMERA_H_
+#define _STUB_CAMERA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hardware/hardware.h>
+
+typedef struct camera_memory {
+	void *data;
+	size_t size;
+	void *handle;
+	void (*release)(struct camera_memory *memory);
+} camera_memory_t;
+
+typedef struct camera_face {
+	int32_t rect[4];
+	int32_t score;
+	int32_t id;
+	int32_t left_eye[2];
+	int32_t right_eye[2];
+	int32_t mouth[2];
+} camera_face_t;
+
+typedef struct camera_frame_metadata {
+	int32_t number_of_faces;
+	camera_face_t *faces;
+} camera_frame_metadata_t;
+
+typedef camera_memory_t *(*camera_request_memory)(int fd, size_t buf_size,
+	unsigned int num_bufs, void *user);
+typedef void (*camera_notify_callback)(int32_t msg_type, int32_t ext1,
+	int32_t ext2, void *user);
+typedef void (*camera_data_callback)(int32_t msg_type,
+	const camera_memory_t *data, unsigned int index,
+	camera_frame_metadata_t *metadata, void *user);
+typedef void (*camera_data_timestamp_callback)(int64_t timestamp,
+	int32_t msg_type, const camera_memory_t *data, unsigned int index,
+	void *user);
+
+struct preview_stream_ops {
+	int (*dequeue_buffer)(struct preview_stream_ops *w,
+		buffer_handle_t **buffer, int *stride);
+	int (*enqueue_buffer)(struct preview_stream_ops *w,
+		buffer_handle_t *buffer);
+	int (*cancel_buffer)(struct preview_stream_ops *w,
+		buffer_handle_t *buffer);
+	int (*set_buffer_count)(struct preview_stream_ops *w, int count);
+	int (*set_buffers_geometry)(struct preview_stream_ops *w, int width,
+		int height, int format);
+	int (*set_crop)(struct preview_stream_ops *w, int left, int top,
+		int right, int bottom);
+	int (*set_usage)(struct preview_stream_ops *w, int usage);
+	int (*set_swap_interval)(struct preview_stream_ops *w, int interval);
+	int (*get_min_undequeued_buffer_count)(const struct preview_stream_ops *w,
+		int *count);
+	int (*lock_buffer)(struct preview_stream_ops *w,
+		buffer_handle_t *buffer);
+	int (*set_timestamp)(struct preview_stream_ops *w, int64_t timestamp);
+};
+
+#endif
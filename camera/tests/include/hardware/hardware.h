@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: only what the camera sources under test need.
+ */
+
+#ifndef _STUB_HARDWARE_H_
+#define _STUB_HARDWARE_H_
+
+#include <stdint.h>
+
+typedef struct hw_module_t {
+	uint32_t tag;
+	const char *id;
+	const char *name;
+} hw_module_t;
+
+typedef struct hw_device_t {
+	uint32_t tag;
+	uint32_t version;
+	struct hw_module_t *module;
+	int (*close)(struct hw_device_t *device);
+} hw_device_t;
+
+typedef struct native_handle {
+	int version;
+	int numFds;
+	int numInts;
+	int data[0];
+} native_handle_t;
+
+typedef const native_handle_t *buffer_handle_t;
+
+typedef struct gralloc_module_t {
+	struct hw_module_t common;
+	int (*lock)(struct gralloc_module_t const *module, buffer_handle_t handle,
+		int usage, int l, int t, int w, int h, void **vaddr);
+	int (*unlock)(struct gralloc_module_t const *module,
+		buffer_handle_t handle);
+} gralloc_module_t;
+
+#endif
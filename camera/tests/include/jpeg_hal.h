@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: only what the camera sources under test need.
+ */
+
+#ifndef _STUB_JPEG_HAL_H_
+#define _STUB_JPEG_HAL_H_
+
+struct jpeg_buf {
+	int num_planes;
+	void *start[3];
+	int length[3];
+	int memory;
+};
+
+#endif
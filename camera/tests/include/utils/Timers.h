@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stub: only what the camera sources under test need.
+ */
+
+#ifndef _STUB_TIMERS_H_
+#define _STUB_TIMERS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+typedef int64_t nsecs_t;
+
+enum {
+	SYSTEM_TIME_REALTIME = 0,
+	SYSTEM_TIME_MONOTONIC = 1,
+};
+
+static inline nsecs_t systemTime(int clock)
+{
+	struct timespec t;
+
+	clock_gettime(clock == SYSTEM_TIME_REALTIME ? CLOCK_REALTIME : CLOCK_MONOTONIC, &t);
+
+	return (nsecs_t) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+#endif